@@ -29,6 +29,50 @@ CREATE OR REPLACE FUNCTION public.jsonapi (
   OUT response            text
 ) RETURNS record AS '$libdir/pg-jsonapi.so', 'jsonapi' LANGUAGE C;
 
+-- chunks bound backend memory, the set is materialized: rows are received after the whole response is serialized
+CREATE OR REPLACE FUNCTION public.jsonapi_stream (
+  IN method               text,
+  IN uri                  text,
+  IN body                 text,
+  IN user_id              text,
+  IN company_id           text,
+  IN company_schema       text,
+  IN sharded_schema       text,
+  IN accounting_schema    text,
+  IN accounting_prefix    text,
+  OUT http_status         integer,
+  OUT chunk               text
+) RETURNS SETOF record AS '$libdir/pg-jsonapi.so', 'jsonapi_stream' LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION public.jsonapi_compressed (
+  IN method               text,
+  IN uri                  text,
+  IN body                 text,
+  IN user_id              text,
+  IN company_id           text,
+  IN company_schema       text,
+  IN sharded_schema       text,
+  IN accounting_schema    text,
+  IN accounting_prefix    text,
+  IN encoding             text,
+  OUT http_status         integer,
+  OUT content_encoding    text,
+  OUT response            bytea
+) RETURNS record AS '$libdir/pg-jsonapi.so', 'jsonapi_compressed' LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION public.jsonapi_batch (
+  IN requests             jsonb,
+  IN user_id              text,
+  IN company_id           text,
+  IN company_schema       text,
+  IN sharded_schema       text,
+  IN accounting_schema    text,
+  IN accounting_prefix    text,
+  OUT index               integer,
+  OUT http_status         integer,
+  OUT response            text
+) RETURNS SETOF record AS '$libdir/pg-jsonapi.so', 'jsonapi_batch' LANGUAGE C;
+
 CREATE OR REPLACE FUNCTION public.inside_jsonapi (
 ) RETURNS boolean AS '$libdir/pg-jsonapi.so', 'inside_jsonapi' LANGUAGE C;
 
@@ -49,3 +93,9 @@ CREATE OR REPLACE FUNCTION public.get_jsonapi_accounting_schema (
 
 CREATE OR REPLACE FUNCTION public.get_jsonapi_accounting_prefix (
 ) RETURNS text AS '$libdir/pg-jsonapi.so', 'get_jsonapi_accounting_prefix' LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION public.get_jsonapi_fragment_cache_stats (
+) RETURNS text AS '$libdir/pg-jsonapi.so', 'get_jsonapi_fragment_cache_stats' LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION public.get_jsonapi_page_cursor (
+) RETURNS text AS '$libdir/pg-jsonapi.so', 'get_jsonapi_page_cursor' LANGUAGE C;
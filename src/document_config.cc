@@ -50,11 +50,19 @@ pg_jsonapi::DocumentConfig::DocumentConfig (const std::string a_base_url) : base
     compound_                      = DefaultIsCompound();
     page_size_                     = DefaultPageSize();
     page_limit_                    = DefaultPageLimit();
+    serialization_threads_         = DefaultSerializationThreads();
+    serialization_threads_min_rows_ = DefaultSerializationThreadsMinRows();
+    fragment_cache_size_           = DefaultFragmentCacheSize();
+    fetch_batch_size_              = DefaultFetchBatchSize();
+    stream_chunk_size_             = DefaultStreamChunkSize();
+    page_cursor_ttl_               = DefaultPageCursorTtl();
+    url_cache_size_                = DefaultUrlCacheSize();
     show_links_                    = DefaultShowLinks();
     show_null_                     = DefaultShowNull();
     restrict_type_                 = DefaultTypeRestriction();
     restrict_attr_                 = DefaultAttrRestriction();
     empty_is_null_                 = DefaultEmptyIsNull();
+    read_only_subtransaction_      = DefaultReadOnlySubtransaction();
     use_request_accounting_schema_ = DefaultRequestAccountingSchema();
     use_request_sharded_schema_    = DefaultRequestShardedSchema();
     use_request_company_schema_    = DefaultRequestCompanySchema();
@@ -137,6 +145,7 @@ bool pg_jsonapi::DocumentConfig::LoadConfigFromDB (bool& o_config_exists)
                     {"type-restriction", &restrict_type_},
                     {"attribute-restriction", &restrict_attr_},
                     {"empty-is-null", &empty_is_null_},
+                    {"read-only-subtransaction", &read_only_subtransaction_},
                     {"request-accounting-schema", &use_request_accounting_schema_},
                     {"request-sharded-schema", &use_request_sharded_schema_},
                     {"request-company-schema", &use_request_company_schema_},
@@ -144,7 +153,14 @@ bool pg_jsonapi::DocumentConfig::LoadConfigFromDB (bool& o_config_exists)
                 };
                 UIntOption uint_options[] = {
                     {"page-size", &page_size_},
-                    {"page-limit", &page_limit_}
+                    {"page-limit", &page_limit_},
+                    {"serialization-threads", &serialization_threads_},
+                    {"serialization-threads-min-rows", &serialization_threads_min_rows_},
+                    {"fragment-cache-size", &fragment_cache_size_},
+                    {"fetch-batch-size", &fetch_batch_size_},
+                    {"stream-chunk-size", &stream_chunk_size_},
+                    {"page-cursor-ttl", &page_cursor_ttl_},
+                    {"url-cache-size", &url_cache_size_}
                 };
                 StringOption str_options[] = {
                     {"pg-search_path", &template_search_path_},
@@ -197,6 +213,12 @@ bool pg_jsonapi::DocumentConfig::LoadConfigFromDB (bool& o_config_exists)
                                 base_url_.c_str(), page_limit_);
                     rv = false;
                 }
+                if ( fetch_batch_size_ > 0 && serialization_threads_ > 1 ) {
+                    /* threads format values of rows that are still fetched, batches release them */
+                    g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA017"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid value for 'fetch-batch-size' for '%s', it cannot be used with 'serialization-threads'",
+                                base_url_.c_str());
+                    rv = false;
+                }
 
                 /* resource specification */
                 const JsonapiJson::Value&  resources = root["resources"];
@@ -221,7 +243,8 @@ bool pg_jsonapi::DocumentConfig::LoadConfigFromDB (bool& o_config_exists)
                                    rv = false;
                                }
                                if ( res.second ) {
-                                   rv &= res.first->second.SetValues(resources[index][key]);
+                                   /* compiled by the first request using it, an invalid resource only fails those requests */
+                                   res.first->second.SetConfig(resources[index][key]);
                                }
                            }
                         }
@@ -248,54 +271,87 @@ bool pg_jsonapi::DocumentConfig::LoadConfigFromDB (bool& o_config_exists)
     /* clean up memory */
     SPI_freetuptable(SPI_tuptable);
 
-    if ( rv ) {
-        rv = Validate();
-    }
+    is_valid_ = rv;
 
     return rv;
 }
 
 /**
- * @brief Validate the document configuration, checking resources and attributes according to global options.
+ * @brief Check if a resource, and every resource it may include, is only read from tables or views,
+ *        no function is called to obtain rows or attributes.
  *
- * @return @li true if operation succeeds
- *         @li false if an error occurs
+ * Resources reachable through relationships, at any depth, are checked without being compiled,
+ * resources not reachable from it don't matter; the result is kept by type for the next requests.
+ *
+ * @return @li true if none of those resources is configured with pg-function or pg-attributes-function
+ *         @li false otherwise
  */
-bool pg_jsonapi::DocumentConfig::Validate()
+bool pg_jsonapi::DocumentConfig::ReadsOnlyRelations (const std::string& a_type)
 {
-    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
-
-    bool rv = true;
+    std::map<std::string, bool>::const_iterator cached = reads_only_relations_.find(a_type);
+    if ( reads_only_relations_.end() != cached ) {
+        return cached->second;
+    }
 
-    for ( std::map<std::string, pg_jsonapi::ResourceConfig>::const_iterator res = resources_.begin(); res != resources_.end(); ++res ) {
-        ereport(DEBUG3, (errmsg_internal("jsonapi: %s res=%s", __FUNCTION__, res->first.c_str())));
+    bool      rv = true;
+    StringSet visited;
+    std::vector<std::string> pending(1, a_type);
+    while ( rv && pending.size() ) {
+        const std::string type = pending.back();
+        pending.pop_back();
+        if ( ! visited.insert(type).second ) {
+            continue;
+        }
+        ResourceConfigMapIterator it = resources_.find(type);
+        if ( resources_.end() == it ) {
+            /* not configured, read from the table named by type */
+            continue;
+        }
+        if ( ! it->second.ReadsOnlyRelation() ) {
+            rv = false;
+            break;
+        }
+        StringSet related;
+        it->second.GetRelatedTypes(related);
+        pending.insert(pending.end(), related.begin(), related.end());
+    }
 
-        for ( ResourceConfig::RelationshipMap::const_iterator rel = GetResource(res->first).GetRelationships().begin(); rel != GetResource(res->first).GetRelationships().end(); ++rel ) {
-            ereport(DEBUG3, (errmsg_internal("jsonapi: %s res=%s rel=%s", __FUNCTION__, res->first.c_str(), rel->first.c_str())));
+    reads_only_relations_[a_type] = rv;
+    return rv;
+}
 
-            if ( 0 == resources_.count( GetResource(res->first).GetFieldResourceType(rel->first) ) ) {
-                if ( HasTypeRestriction() ) {
-                    g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA017"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "resource '%s' is not configured for '%s'",
-                               GetResource(res->first).GetFieldResourceType(rel->first).c_str(), base_url_.c_str());
-                    rv = false;
-                } else {
-                    Resource( GetResource(res->first).GetFieldResourceType(rel->first) );
-                }
-            }
-        }
+/**
+ * @brief Get the configuration of a resource used by a request, compiling it on first use.
+ *
+ * @return @li the resource configuration
+ *         @li NULL if the resource is not configured while types are restricted, or if its configuration is invalid
+ */
+pg_jsonapi::ResourceConfig* pg_jsonapi::DocumentConfig::CompiledResource (const std::string& a_type)
+{
+    if ( HasTypeRestriction() && 0 == resources_.count(a_type) ) {
+        g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA017"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "resource '%s' is not configured for '%s'",
+                   a_type.c_str(), base_url_.c_str());
+        return NULL;
     }
 
-    if ( rv ) {
-        for ( std::map<std::string, pg_jsonapi::ResourceConfig>::const_iterator res = resources_.begin(); res != resources_.end(); ++res ) {
-            if ( ! Resource(res->first)->ValidatePG(false) ) {
-                rv = false;
-            }
-        }
+    ResourceConfig* rc = Resource(a_type);
+    if ( ! rc->Compile() ) {
+        return NULL;
     }
+    return rc;
+}
 
-    is_valid_ = rv;
+/**
+ * @brief Compile the configuration of a resource named by a request parameter, if it's configured.
+ *
+ * @return @li true if operation succeeds
+ *         @li false if its configuration is invalid
+ */
+bool pg_jsonapi::DocumentConfig::CompileResource (const std::string& a_type)
+{
+    ResourceConfigMapIterator it = resources_.find(a_type);
 
-    return rv;
+    return resources_.end() == it || it->second.Compile();
 }
 
 /**
@@ -321,8 +377,8 @@ bool pg_jsonapi::DocumentConfig::ValidateRequest(const std::string& a_type, cons
             return false;
         }
     }
-    ResourceConfig* rc = Resource(a_type);
-    if ( ! rc->ValidatePG(true) ) {
+    ResourceConfig* rc = CompiledResource(a_type);
+    if ( NULL == rc || ! rc->ValidatePG(true) ) {
         return false;
     }
     if ( a_related.size() ) {
@@ -337,14 +393,8 @@ bool pg_jsonapi::DocumentConfig::ValidateRequest(const std::string& a_type, cons
         ereport(DEBUG3, (errmsg_internal("jsonapi: %s res=%s rel=%s", __FUNCTION__, a_type.c_str(), rel->first.c_str())));
 
         const std::string& rel_type = rc->GetFieldResourceType(rel->first);
-        if ( HasTypeRestriction() ) {
-            if ( 0 == resources_.count( rel_type ) ) {
-                g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA017"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "resource '%s' is not configured for '%s'",
-                                                                                                        rel_type.c_str(), base_url_.c_str());
-                return false;
-            }
-        }
-        if ( ! Resource(rel_type)->ValidatePG(true) ) {
+        ResourceConfig*    rel_rc   = CompiledResource(rel_type);
+        if ( NULL == rel_rc || ! rel_rc->ValidatePG(true) ) {
             return false;
         }
     }
@@ -358,14 +408,8 @@ bool pg_jsonapi::DocumentConfig::ValidateRequest(const std::string& a_type, cons
             stat_type_is_valid = ( stat->first == rc->GetFieldResourceType(rel->first) );
         }
         if ( !stat_type_is_valid ) {
-            if ( HasTypeRestriction() ) {
-                if ( 0 == resources_.count( stat->first ) ) {
-                    g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA017"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "resource '%s' is not configured for '%s'",
-                                                                                                            stat->first.c_str(), base_url_.c_str());
-                    return false;
-                }
-            }
-            if ( ! Resource(stat->first)->ValidatePG(true) ) {
+            ResourceConfig* stat_rc = CompiledResource(stat->first);
+            if ( NULL == stat_rc || ! stat_rc->ValidatePG(true) ) {
                 return false;
             }
         }
@@ -373,3 +417,21 @@ bool pg_jsonapi::DocumentConfig::ValidateRequest(const std::string& a_type, cons
 
     return true;
 }
+
+/**
+ * @brief Compile and validate a resource reached by an include path or a compound document,
+ *        before it's queried for inclusion.
+ *
+ * Related resources are not validated with the request, so only those actually included are compiled.
+ *
+ * @return @li true if operation succeeds
+ *         @li false if its configuration is invalid or its relation does not exist
+ */
+bool pg_jsonapi::DocumentConfig::ValidateIncluded (const std::string& a_type)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s %s", __FUNCTION__, a_type.c_str())));
+
+    ResourceConfig* rc = CompiledResource(a_type);
+
+    return NULL != rc && rc->ValidatePG(false);
+}
@@ -50,11 +50,19 @@ namespace pg_jsonapi
         bool        compound_;
         uint        page_size_;
         uint        page_limit_;
+        uint        serialization_threads_;
+        uint        serialization_threads_min_rows_;
+        uint        fragment_cache_size_;
+        uint        fetch_batch_size_;
+        uint        stream_chunk_size_;
+        uint        page_cursor_ttl_;
+        uint        url_cache_size_;
         bool        show_links_;
         bool        show_null_;
         bool        restrict_type_;
         bool        restrict_attr_;
         bool        empty_is_null_;
+        bool        read_only_subtransaction_;
         std::string default_order_by_;
         bool        use_request_accounting_schema_;
         bool        use_request_sharded_schema_;
@@ -62,10 +70,11 @@ namespace pg_jsonapi
         bool        use_request_accounting_prefix_;
         std::string template_search_path_;
         std::map<std::string, pg_jsonapi::ResourceConfig> resources_;
+        std::map<std::string, bool> reads_only_relations_;  // by requested type, see ReadsOnlyRelations
 
     private: // Methods
-        bool Validate();
-        ResourceConfig*       Resource (const std::string& a_type);
+        ResourceConfig*       Resource         (const std::string& a_type);
+        ResourceConfig*       CompiledResource (const std::string& a_type);
 
     public: // Methods
         DocumentConfig (const std::string a_base_url);
@@ -78,11 +87,19 @@ namespace pg_jsonapi
         static uint DefaultPageSize   ();
         static uint DefaultPageLimit  ();
         static uint MaximumPageLimit  ();
+        static uint DefaultSerializationThreads ();
+        static uint DefaultSerializationThreadsMinRows ();
+        static uint DefaultFragmentCacheSize ();
+        static uint DefaultFetchBatchSize ();
+        static uint DefaultStreamChunkSize ();
+        static uint DefaultPageCursorTtl ();
+        static uint DefaultUrlCacheSize ();
         static bool DefaultShowLinks  ();
         static bool DefaultShowNull   ();
         static bool DefaultTypeRestriction();
         static bool DefaultAttrRestriction();
         static bool DefaultEmptyIsNull();
+        static bool DefaultReadOnlySubtransaction();
         static bool DefaultRequestAccountingSchema();
         static bool DefaultRequestShardedSchema();
         static bool DefaultRequestCompanySchema();
@@ -92,11 +109,20 @@ namespace pg_jsonapi
         bool IsCompound                 () const;
         uint PageSize                   () const;
         uint PageLimit                  () const;
+        uint SerializationThreads       () const;
+        uint SerializationThreadsMinRows() const;
+        uint FragmentCacheSize          () const;
+        uint FetchBatchSize             () const;
+        uint StreamChunkSize            () const;
+        uint PageCursorTtl              () const;
+        uint UrlCacheSize               () const;
         bool ShowLinks                  () const;
         bool ShowNull                   () const;
         bool HasTypeRestriction         () const;
         bool HasAttrRestriction         () const;
         bool EmptyIsNull                () const;
+        bool ReadOnlySubtransaction     () const;
+        bool ReadsOnlyRelations         (const std::string& a_type);
         bool UseRequestAccountingSchema () const;
         bool UseRequestShardedSchema    () const;
         bool UseRequestCompanySchema    () const;
@@ -105,6 +131,8 @@ namespace pg_jsonapi
         const std::string& SearchPathTemplate () const;
 
         bool ValidateRequest    (const std::string& a_type, const std::string& a_related);
+        bool ValidateIncluded   (const std::string& a_type);
+        bool CompileResource    (const std::string& a_type);
         bool IsIdentifier       (const std::string& a_name) const;
         bool IsValidField       (const std::string& a_type, const std::string& a_field) const;
 
@@ -141,6 +169,41 @@ namespace pg_jsonapi
         return 1048576; // we will not allow to return results above maximum number of lines on excel
     }
 
+    inline uint DocumentConfig::DefaultSerializationThreads ()
+    {
+        return 0;
+    }
+
+    inline uint DocumentConfig::DefaultSerializationThreadsMinRows ()
+    {
+        return 10000;
+    }
+
+    inline uint DocumentConfig::DefaultFragmentCacheSize ()
+    {
+        return 16 * 1024 * 1024;
+    }
+
+    inline uint DocumentConfig::DefaultFetchBatchSize ()
+    {
+        return 0;
+    }
+
+    inline uint DocumentConfig::DefaultStreamChunkSize ()
+    {
+        return 64 * 1024;
+    }
+
+    inline uint DocumentConfig::DefaultPageCursorTtl ()
+    {
+        return 300;
+    }
+
+    inline uint DocumentConfig::DefaultUrlCacheSize ()
+    {
+        return 256;
+    }
+
     inline bool DocumentConfig::DefaultShowLinks ()
     {
         return true;
@@ -166,6 +229,11 @@ namespace pg_jsonapi
         return false;
     }
 
+    inline bool DocumentConfig::DefaultReadOnlySubtransaction ()
+    {
+        return true;
+    }
+
     inline bool DocumentConfig::DefaultRequestAccountingSchema ()
     {
         return false;
@@ -206,6 +274,41 @@ namespace pg_jsonapi
         return page_limit_;
     }
 
+    inline uint DocumentConfig::SerializationThreads () const
+    {
+        return serialization_threads_;
+    }
+
+    inline uint DocumentConfig::SerializationThreadsMinRows () const
+    {
+        return serialization_threads_min_rows_;
+    }
+
+    inline uint DocumentConfig::FragmentCacheSize () const
+    {
+        return fragment_cache_size_;
+    }
+
+    inline uint DocumentConfig::FetchBatchSize () const
+    {
+        return fetch_batch_size_;
+    }
+
+    inline uint DocumentConfig::StreamChunkSize () const
+    {
+        return stream_chunk_size_;
+    }
+
+    inline uint DocumentConfig::PageCursorTtl () const
+    {
+        return page_cursor_ttl_;
+    }
+
+    inline uint DocumentConfig::UrlCacheSize () const
+    {
+        return url_cache_size_;
+    }
+
     inline bool DocumentConfig::ShowLinks () const
     {
         return show_links_;
@@ -231,6 +334,11 @@ namespace pg_jsonapi
         return empty_is_null_;
     }
 
+    inline bool DocumentConfig::ReadOnlySubtransaction () const
+    {
+        return read_only_subtransaction_;
+    }
+
     inline bool DocumentConfig::UseRequestAccountingSchema () const
     {
         return use_request_accounting_schema_;
@@ -0,0 +1,112 @@
+/**
+ * @file fragment_cache.cc Implementation of FragmentCache
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fragment_cache.h"
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::FragmentCache::FragmentCache ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    budget_ = 0;
+    bytes_  = 0;
+    hits_   = 0;
+    misses_ = 0;
+}
+
+/**
+ * @brief Destructor
+ */
+pg_jsonapi::FragmentCache::~FragmentCache ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+}
+
+/**
+ * @brief Set maximum bytes kept, evicting entries if it's lower than current usage.
+ */
+void pg_jsonapi::FragmentCache::SetBudget (size_t a_budget)
+{
+    budget_ = a_budget;
+    Evict(budget_);
+}
+
+/**
+ * @brief Append cached fragment to buffer.
+ *
+ * @return @li true if fragment was found and appended
+ *         @li false otherwise
+ */
+bool pg_jsonapi::FragmentCache::Append (const std::string& a_key, StringInfo a_buffer)
+{
+    EntryIndex::iterator it = index_.find(a_key);
+
+    if ( index_.end() == it ) {
+        misses_++;
+        return false;
+    }
+    hits_++;
+    if ( entries_.begin() != it->second ) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+    }
+    appendBinaryStringInfo(a_buffer, it->second->second.data(), (int) it->second->second.size());
+
+    return true;
+}
+
+/**
+ * @brief Keep fragment, unless it alone exceeds a tenth of the budget.
+ */
+void pg_jsonapi::FragmentCache::Put (const std::string& a_key, const char* a_data, size_t a_len)
+{
+    size_t size = a_key.size() + a_len;
+
+    if ( size > budget_ / 10 || index_.count(a_key) ) {
+        return;
+    }
+    Evict(budget_ - size);
+
+    entries_.push_front(Entry(a_key, std::string(a_data, a_len)));
+    index_[a_key] = entries_.begin();
+    bytes_ += size;
+}
+
+/**
+ * @brief Drop all entries, statistics are kept.
+ */
+void pg_jsonapi::FragmentCache::Clear ()
+{
+    entries_.clear();
+    index_.clear();
+    bytes_ = 0;
+}
+
+void pg_jsonapi::FragmentCache::Evict (size_t a_budget)
+{
+    while ( bytes_ > a_budget && ! entries_.empty() ) {
+        const Entry& last = entries_.back();
+        bytes_ -= last.first.size() + last.second.size();
+        index_.erase(last.first);
+        entries_.pop_back();
+    }
+}
@@ -0,0 +1,114 @@
+/**
+ * @file fragment_cache.h Declaration of FragmentCache
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CLD_PG_JSONAPI_FRAGMENT_CACHE_H
+#define CLD_PG_JSONAPI_FRAGMENT_CACHE_H
+
+#include <string>
+#include <list>
+#include <unordered_map>
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "postgres.h"
+#include "lib/stringinfo.h"
+#pragma GCC diagnostic pop
+} // extern "C"
+
+namespace pg_jsonapi
+{
+
+    /**
+     * @brief Serialized resource fragments kept by process, evicted by least recent use
+     *        when the byte budget is exceeded.
+     *
+     * Keys must identify the row version, so entries never need to be invalidated.
+     */
+    class FragmentCache
+    {
+    private:
+
+        typedef std::pair<std::string, std::string> Entry;   // key, fragment
+        typedef std::list<Entry>                     EntryList;
+        typedef std::unordered_map<std::string, EntryList::iterator> EntryIndex;
+
+    private: // Attributes
+        EntryList entries_;   // most recently used first
+        EntryIndex index_;
+        size_t    budget_;    // maximum bytes, zero disables cache
+        size_t    bytes_;     // bytes used by keys and fragments
+        uint64    hits_;
+        uint64    misses_;
+
+    private: // Methods
+        void Evict (size_t a_budget);
+
+    public: // Methods
+        FragmentCache ();
+        virtual ~FragmentCache ();
+
+        void   SetBudget (size_t a_budget);
+        bool   Append    (const std::string& a_key, StringInfo a_buffer);
+        void   Put       (const std::string& a_key, const char* a_data, size_t a_len);
+        void   Clear     ();
+
+        bool   IsEnabled () const;
+        size_t Entries   () const;
+        size_t Bytes     () const;
+        uint64 Hits      () const;
+        uint64 Misses    () const;
+        double HitRatio  () const;
+    };
+
+    inline bool FragmentCache::IsEnabled () const
+    {
+        return budget_ > 0;
+    }
+
+    inline size_t FragmentCache::Entries () const
+    {
+        return index_.size();
+    }
+
+    inline size_t FragmentCache::Bytes () const
+    {
+        return bytes_;
+    }
+
+    inline uint64 FragmentCache::Hits () const
+    {
+        return hits_;
+    }
+
+    inline uint64 FragmentCache::Misses () const
+    {
+        return misses_;
+    }
+
+    inline double FragmentCache::HitRatio () const
+    {
+        return ( hits_ + misses_ ) ? (double) hits_ / (double) ( hits_ + misses_ ) : 0.0;
+    }
+
+} // namespace pg_jsonapi
+
+#endif // CLD_PG_JSONAPI_FRAGMENT_CACHE_H
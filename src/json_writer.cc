@@ -0,0 +1,918 @@
+/**
+ * @file json_writer.cc Implementation of JsonWriter
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "json_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+/* wider kernels are compiled with target attributes and chosen at run time, the build targets plain x86-64 */
+#if ( defined(__x86_64__) || defined(__i386__) ) && defined(__GNUC__)
+#define JSONAPI_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "fmgr.h"
+#include "access/tupmacs.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/datetime.h"
+#include "utils/timestamp.h"
+#if PG_MAJORVERSION_NUM >= 12
+#include "common/shortest_dec.h"
+#endif
+#pragma GCC diagnostic pop
+} // extern "C"
+
+namespace
+{
+    const char k_digit_pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    const uint64 k_powers_of_ten[] = {
+        UINT64CONST(1),                   UINT64CONST(10),
+        UINT64CONST(100),                 UINT64CONST(1000),
+        UINT64CONST(10000),               UINT64CONST(100000),
+        UINT64CONST(1000000),             UINT64CONST(10000000),
+        UINT64CONST(100000000),           UINT64CONST(1000000000),
+        UINT64CONST(10000000000),         UINT64CONST(100000000000),
+        UINT64CONST(1000000000000),       UINT64CONST(10000000000000),
+        UINT64CONST(100000000000000),     UINT64CONST(1000000000000000),
+        UINT64CONST(10000000000000000),   UINT64CONST(100000000000000000),
+        UINT64CONST(1000000000000000000), UINT64CONST(10000000000000000000)
+    };
+
+    /*
+     * On-disk numeric layout, as defined in src/backend/utils/adt/numeric.c;
+     * it's not exported by any server header but it is stable across versions.
+     */
+    const uint16 k_numeric_sign_mask              = 0xC000;
+    const uint16 k_numeric_neg                    = 0x4000;
+    const uint16 k_numeric_short                  = 0x8000;
+    const uint16 k_numeric_special                = 0xC000;
+    const uint16 k_numeric_ext_sign_mask          = 0xF000;
+    const uint16 k_numeric_pinf                   = 0xD000;
+    const uint16 k_numeric_ninf                   = 0xF000;
+    const uint16 k_numeric_short_sign_mask        = 0x2000;
+    const uint16 k_numeric_short_dscale_mask      = 0x1F80;
+    const int    k_numeric_short_dscale_shift     = 7;
+    const uint16 k_numeric_short_weight_sign_mask = 0x0040;
+    const uint16 k_numeric_short_weight_mask      = 0x003F;
+    const uint16 k_numeric_dscale_mask            = 0x3FFF;
+    const int    k_numeric_dec_digits             = 4;   // decimal digits per NBASE digit
+
+    inline int16 ReadInt16 (const char* a_src)
+    {
+        int16 value;
+        memcpy(&value, a_src, sizeof(value)); // packed varlena data is not aligned
+        return value;
+    }
+
+    const char k_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    /* write a value below 100, zero padded to two digits */
+    inline char* WriteTwoDigits (char* a_dst, int a_value)
+    {
+        memcpy(a_dst, &k_digit_pairs[a_value * 2], 2);
+        return a_dst + 2;
+    }
+
+    /* write one NBASE digit, all 4 decimal digits */
+    inline char* WriteNBaseDigit (char* a_dst, int a_digit)
+    {
+        memcpy(a_dst,     &k_digit_pairs[(a_digit / 100) * 2], 2);
+        memcpy(a_dst + 2, &k_digit_pairs[(a_digit % 100) * 2], 2);
+        return a_dst + 4;
+    }
+
+#if defined(JSONAPI_X86_DISPATCH)
+    /* checked once, also safe from the threads of ParallelWriter */
+    bool HasAvx2 ()
+    {
+        static const bool has_avx2 = ( __builtin_cpu_init(), 0 != __builtin_cpu_supports("avx2") );
+        return has_avx2;
+    }
+
+    /* skip 32 byte blocks without chars to escape, return position of the block holding one or where blocks end */
+    __attribute__((target("avx2")))
+    int SkipCleanBlocksAvx2 (const char* a_str, int a_len)
+    {
+        const __m256i quote32     = _mm256_set1_epi8('"');
+        const __m256i backslash32 = _mm256_set1_epi8('\\');
+        const __m256i control32   = _mm256_set1_epi8(0x1F);
+        int           pos         = 0;
+        for ( ; pos + 32 <= a_len; pos += 32 ) {
+            __m256i chunk = _mm256_loadu_si256((const __m256i*) (a_str + pos));
+            __m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote32),
+                                                            _mm256_cmpeq_epi8(chunk, backslash32)),
+                                            _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control32), chunk));
+            uint32 mask = (uint32) _mm256_movemask_epi8(found);
+            if ( 0 != mask ) {
+                return pos + __builtin_ctz(mask);
+            }
+        }
+        return pos;
+    }
+
+    bool HasSsse3 ()
+    {
+        static const bool has_ssse3 = ( __builtin_cpu_init(), 0 != __builtin_cpu_supports("ssse3") );
+        return has_ssse3;
+    }
+
+    /* encode 12 input bytes to 16 base64 chars per iteration while 16 bytes can be loaded, return chars written */
+    __attribute__((target("ssse3")))
+    size_t EncodeBlocksSsse3 (char* a_dst, const unsigned char* a_src, size_t a_len)
+    {
+        const __m128i shuffle   = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+        const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                                '/' - 63, 'A', 0, 0);
+        char*         start     = a_dst;
+        /* 16 bytes are loaded but only 12 are consumed */
+        while ( a_len >= 16 ) {
+            __m128i in      = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) a_src), shuffle);
+            __m128i t0      = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+            __m128i t1      = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+            __m128i indices = _mm_or_si128(t0, t1);
+            __m128i offset  = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+            offset = _mm_or_si128(offset, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+            _mm_storeu_si128((__m128i*) a_dst, _mm_add_epi8(_mm_shuffle_epi8(shift_lut, offset), indices));
+            a_src += 12;
+            a_len -= 12;
+            a_dst += 16;
+        }
+        return (size_t) ( a_dst - start );
+    }
+#endif
+}
+
+/**
+ * @brief Write decimal representation of an unsigned integer, two digits at a time.
+ *
+ * @return number of chars written (not NUL terminated), at most 20.
+ */
+int pg_jsonapi::JsonWriter::WriteUInt64 (char* a_dst, uint64 a_value)
+{
+    if ( 0 == a_value ) {
+        a_dst[0] = '0';
+        return 1;
+    }
+
+    /* number of digits from the number of significant bits: log10(2) ~ 1233/4096 */
+    int    t   = ( (64 - __builtin_clzll(a_value)) * 1233 ) >> 12;
+    int    len = t + ( a_value >= k_powers_of_ten[t] );
+    char*  end = a_dst + len;
+
+    while ( a_value >= 100 ) {
+        uint32 pair = (uint32) (a_value % 100);
+        a_value /= 100;
+        end -= 2;
+        memcpy(end, &k_digit_pairs[pair * 2], 2);
+    }
+    if ( a_value >= 10 ) {
+        end -= 2;
+        memcpy(end, &k_digit_pairs[a_value * 2], 2);
+    } else {
+        *--end = (char) ('0' + a_value);
+    }
+    return len;
+}
+
+void pg_jsonapi::JsonWriter::AppendInt16 (StringInfo a_buffer, int16 a_value)
+{
+    AppendInt64(a_buffer, a_value);
+}
+
+void pg_jsonapi::JsonWriter::AppendInt32 (StringInfo a_buffer, int32 a_value)
+{
+    AppendInt64(a_buffer, a_value);
+}
+
+void pg_jsonapi::JsonWriter::AppendInt64 (StringInfo a_buffer, int64 a_value)
+{
+    enlargeStringInfo(a_buffer, k_max_number_len_);
+    a_buffer->len += WriteInt64(a_buffer->data + a_buffer->len, a_value);
+    a_buffer->data[a_buffer->len] = '\0';
+}
+
+void pg_jsonapi::JsonWriter::AppendFloat4 (StringInfo a_buffer, float4 a_value)
+{
+    enlargeStringInfo(a_buffer, k_max_number_len_);
+    a_buffer->len += WriteFloat4(a_buffer->data + a_buffer->len, a_value);
+    a_buffer->data[a_buffer->len] = '\0';
+}
+
+void pg_jsonapi::JsonWriter::AppendFloat8 (StringInfo a_buffer, float8 a_value)
+{
+    enlargeStringInfo(a_buffer, k_max_number_len_);
+    a_buffer->len += WriteFloat8(a_buffer->data + a_buffer->len, a_value);
+    a_buffer->data[a_buffer->len] = '\0';
+}
+
+/**
+ * @brief Write signed integer.
+ *
+ * @return number of chars written (not NUL terminated), at most 20.
+ */
+int pg_jsonapi::JsonWriter::WriteInt64 (char* a_dst, int64 a_value)
+{
+    if ( a_value < 0 ) {
+        a_dst[0] = '-';
+        return 1 + WriteUInt64(a_dst + 1, (uint64) 0 - (uint64) a_value);
+    }
+    return WriteUInt64(a_dst, (uint64) a_value);
+}
+
+/**
+ * @brief Write float4 using the shortest representation that reads back to the same value.
+ *
+ * NaN and infinities are not valid JSON numbers, so like to_json() they are written as strings.
+ *
+ * @return number of chars written (not NUL terminated), at most k_max_number_len_.
+ */
+int pg_jsonapi::JsonWriter::WriteFloat4 (char* a_dst, float4 a_value)
+{
+    if ( isnan(a_value) || isinf(a_value) ) {
+        return WriteFloat8(a_dst, a_value);
+    }
+#if PG_MAJORVERSION_NUM >= 12
+    return float_to_shortest_decimal_bufn(a_value, a_dst);
+#else
+    return snprintf(a_dst, k_max_number_len_, "%.9g", a_value);
+#endif
+}
+
+/**
+ * @brief Write float8 using the shortest representation that reads back to the same value.
+ *
+ * NaN and infinities are not valid JSON numbers, so like to_json() they are written as strings.
+ *
+ * @return number of chars written (not NUL terminated), at most k_max_number_len_.
+ */
+int pg_jsonapi::JsonWriter::WriteFloat8 (char* a_dst, float8 a_value)
+{
+    if ( isnan(a_value) ) {
+        memcpy(a_dst, "\"NaN\"", 5);
+        return 5;
+    } else if ( isinf(a_value) ) {
+        if ( a_value > 0 ) {
+            memcpy(a_dst, "\"Infinity\"", 10);
+            return 10;
+        }
+        memcpy(a_dst, "\"-Infinity\"", 11);
+        return 11;
+    }
+#if PG_MAJORVERSION_NUM >= 12
+    return double_to_shortest_decimal_bufn(a_value, a_dst);
+#else
+    return snprintf(a_dst, k_max_number_len_, "%.17g", a_value);
+#endif
+}
+
+/**
+ * @brief Append numeric reading base 10000 digits straight from the (possibly short header) varlena,
+ *        same output as numeric_out but without detoast copies or intermediate strings.
+ */
+void pg_jsonapi::JsonWriter::AppendNumeric (StringInfo a_buffer, Datum a_value)
+{
+    struct varlena* num     = PG_DETOAST_DATUM_PACKED(a_value);
+    const char*     data    = VARDATA_ANY(num);
+    int             datalen = (int) VARSIZE_ANY_EXHDR(num);
+    uint16          header  = (uint16) ReadInt16(data);
+    bool            is_neg;
+    int             weight;
+    int             dscale;
+    const char*     digits;
+    int             ndigits;
+
+    if ( k_numeric_special == (header & k_numeric_sign_mask) ) {
+        switch ( header & k_numeric_ext_sign_mask ) {
+            case k_numeric_pinf:
+                appendBinaryStringInfo(a_buffer, "\"Infinity\"", 10);
+                break;
+            case k_numeric_ninf:
+                appendBinaryStringInfo(a_buffer, "\"-Infinity\"", 11);
+                break;
+            default:
+                appendBinaryStringInfo(a_buffer, "\"NaN\"", 5);
+                break;
+        }
+    } else {
+        if ( header & k_numeric_short ) {
+            is_neg = ( 0 != (header & k_numeric_short_sign_mask) );
+            dscale = ( header & k_numeric_short_dscale_mask ) >> k_numeric_short_dscale_shift;
+            weight = ( (header & k_numeric_short_weight_sign_mask) ? ~k_numeric_short_weight_mask : 0 )
+                     | ( header & k_numeric_short_weight_mask );
+            digits = data + sizeof(uint16);
+        } else {
+            is_neg = ( k_numeric_neg == (header & k_numeric_sign_mask) );
+            dscale = header & k_numeric_dscale_mask;
+            weight = ReadInt16(data + sizeof(uint16));
+            digits = data + sizeof(uint16) + sizeof(int16);
+        }
+        ndigits = (int) ( (data + datalen - digits) / sizeof(int16) );
+
+        /* worst case: sign, integer part, point, fraction rounded up to full NBASE digits */
+        enlargeStringInfo(a_buffer, 2 + ( weight >= 0 ? (weight + 1) * k_numeric_dec_digits : 1 ) + dscale + k_numeric_dec_digits);
+
+        char* dst = a_buffer->data + a_buffer->len;
+        int   d;
+
+        if ( is_neg && ndigits > 0 ) {
+            *dst++ = '-';
+        }
+
+        /* integer part, leading zeros of first digit suppressed */
+        if ( weight < 0 ) {
+            d = weight + 1;
+            *dst++ = '0';
+        } else {
+            for ( d = 0; d <= weight; d++ ) {
+                int dig = ( d < ndigits ) ? ReadInt16(digits + d * sizeof(int16)) : 0;
+                if ( 0 == d ) {
+                    dst += WriteUInt64(dst, (uint64) dig);
+                } else {
+                    dst = WriteNBaseDigit(dst, dig);
+                }
+            }
+        }
+
+        /* fraction part, truncated to dscale */
+        if ( dscale > 0 ) {
+            char* end = dst + 1 + dscale;
+            *dst++ = '.';
+            for ( int i = 0; i < dscale; d++, i += k_numeric_dec_digits ) {
+                int dig = ( d >= 0 && d < ndigits ) ? ReadInt16(digits + d * sizeof(int16)) : 0;
+                dst = WriteNBaseDigit(dst, dig);
+            }
+            dst = end;
+        }
+
+        a_buffer->len = (int) (dst - a_buffer->data);
+        a_buffer->data[a_buffer->len] = '\0';
+    }
+
+    if ( (Pointer) num != DatumGetPointer(a_value) ) {
+        pfree(num);
+    }
+}
+
+void pg_jsonapi::JsonWriter::AppendBool (StringInfo a_buffer, bool a_value)
+{
+    if ( a_value ) {
+        appendBinaryStringInfo(a_buffer, "true", 4);
+    } else {
+        appendBinaryStringInfo(a_buffer, "false", 5);
+    }
+}
+
+/**
+ * @brief Find first char that must be escaped in a JSON string: quote, backslash or control char.
+ *
+ * Scans 32 (AVX2, when the CPU has it) or 16 (SSE2) bytes at a time, falling back to a scalar loop for the tail.
+ *
+ * @return position of that char, or a_len if none.
+ */
+int pg_jsonapi::JsonWriter::FindEscape (const char* a_str, int a_len)
+{
+    int pos = 0;
+
+#if defined(JSONAPI_X86_DISPATCH)
+    if ( a_len >= 32 && HasAvx2() ) {
+        pos = SkipCleanBlocksAvx2(a_str, a_len);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i quote16     = _mm_set1_epi8('"');
+    const __m128i backslash16 = _mm_set1_epi8('\\');
+    const __m128i control16   = _mm_set1_epi8(0x1F);
+    for ( ; pos + 16 <= a_len; pos += 16 ) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (a_str + pos));
+        __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote16),
+                                                  _mm_cmpeq_epi8(chunk, backslash16)),
+                                     _mm_cmpeq_epi8(_mm_min_epu8(chunk, control16), chunk));
+        uint32 mask = (uint32) _mm_movemask_epi8(found);
+        if ( 0 != mask ) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for ( ; pos < a_len; pos++ ) {
+        unsigned char c = (unsigned char) a_str[pos];
+        if ( c < ' ' || '"' == c || '\\' == c ) {
+            return pos;
+        }
+    }
+    return a_len;
+}
+
+/**
+ * @brief Append quoted and escaped JSON string, same output as escape_json but copying clean runs in bulk.
+ */
+void pg_jsonapi::JsonWriter::AppendEscaped (StringInfo a_buffer, const char* a_str, int a_len)
+{
+    appendStringInfoCharMacro(a_buffer, '"');
+    while ( a_len > 0 ) {
+        int run = FindEscape(a_str, a_len);
+        if ( run > 0 ) {
+            appendBinaryStringInfo(a_buffer, a_str, run);
+        }
+        if ( run == a_len ) {
+            break;
+        }
+        enlargeStringInfo(a_buffer, 6);
+        a_buffer->len += WriteEscapedChar(a_buffer->data + a_buffer->len, a_str[run]);
+        a_buffer->data[a_buffer->len] = '\0';
+        a_str += run + 1;
+        a_len -= run + 1;
+    }
+    appendStringInfoCharMacro(a_buffer, '"');
+}
+
+/**
+ * @brief Write escape sequence of a char found by FindEscape.
+ *
+ * @return number of chars written, at most 6.
+ */
+int pg_jsonapi::JsonWriter::WriteEscapedChar (char* a_dst, char a_char)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    a_dst[0] = '\\';
+    switch ( a_char ) {
+        case '\b': a_dst[1] = 'b';  return 2;
+        case '\f': a_dst[1] = 'f';  return 2;
+        case '\n': a_dst[1] = 'n';  return 2;
+        case '\r': a_dst[1] = 'r';  return 2;
+        case '\t': a_dst[1] = 't';  return 2;
+        case '"':  a_dst[1] = '"';  return 2;
+        case '\\': a_dst[1] = '\\'; return 2;
+        default:
+            a_dst[1] = 'u';
+            a_dst[2] = '0';
+            a_dst[3] = '0';
+            a_dst[4] = hex[((unsigned char) a_char >> 4) & 0xF];
+            a_dst[5] = hex[(unsigned char) a_char & 0xF];
+            return 6;
+    }
+}
+
+/**
+ * @brief Append quoted and escaped C string.
+ */
+void pg_jsonapi::JsonWriter::AppendEscaped (StringInfo a_buffer, const char* a_str)
+{
+    AppendEscaped(a_buffer, a_str, (int) strlen(a_str));
+}
+
+/**
+ * @brief Append text or varchar value, escaped straight from the detoasted varlena.
+ */
+void pg_jsonapi::JsonWriter::AppendText (StringInfo a_buffer, Datum a_value)
+{
+    struct varlena* txt = PG_DETOAST_DATUM_PACKED(a_value);
+
+    AppendEscaped(a_buffer, VARDATA_ANY(txt), (int) VARSIZE_ANY_EXHDR(txt));
+
+    if ( (Pointer) txt != DatumGetPointer(a_value) ) {
+        pfree(txt);
+    }
+}
+
+/**
+ * @brief Append one dimension array of a common element type, walking array data in place.
+ *
+ * Same output as array_to_json, without deconstructing the array nor calling output functions per element.
+ *
+ * @return @li true if value was written
+ *         @li false for other element types or multi dimension arrays, left to array_to_json_internal
+ */
+bool pg_jsonapi::JsonWriter::AppendArray (StringInfo a_buffer, Datum a_value)
+{
+    ArrayType* arr      = DatumGetArrayTypeP(a_value);
+    int        ndim     = ARR_NDIM(arr);
+    int16      typlen   = -1;
+    bool       typbyval = false;
+    char       typalign = 'i';
+
+    switch ( ARR_ELEMTYPE(arr) ) {
+        case INT2OID:
+            typlen = sizeof(int16); typbyval = true;  typalign = 's';
+            break;
+        case INT4OID:
+        case FLOAT4OID:
+            typlen = sizeof(int32); typbyval = true;  typalign = 'i';
+            break;
+        case INT8OID:
+        case FLOAT8OID:
+            typlen = sizeof(int64); typbyval = FLOAT8PASSBYVAL; typalign = 'd';
+            break;
+        case NUMERICOID:
+        case TEXTOID:
+        case VARCHAROID:
+            /* varlena, defaults above */
+            break;
+        default:
+            ndim = -1;
+            break;
+    }
+    if ( ndim < 0 || ndim > 1 ) {
+        if ( (Pointer) arr != DatumGetPointer(a_value) ) {
+            pfree(arr);
+        }
+        return false;
+    }
+
+    int    nitems = ( 0 == ndim ) ? 0 : ARR_DIMS(arr)[0];
+    bits8* bitmap = ARR_NULLBITMAP(arr);
+    char*  ptr    = ARR_DATA_PTR(arr);
+
+    appendStringInfoCharMacro(a_buffer, '[');
+    for ( int i = 0; i < nitems; i++ ) {
+        if ( i > 0 ) {
+            appendStringInfoCharMacro(a_buffer, ',');
+        }
+        if ( NULL != bitmap && 0 == (bitmap[i / 8] & (1 << (i % 8))) ) {
+            appendBinaryStringInfo(a_buffer, "null", 4);
+            continue;
+        }
+
+        Datum elem = fetch_att(ptr, typbyval, typlen);
+        ptr = att_addlength_pointer(ptr, typlen, ptr);
+        ptr = (char*) att_align_nominal(ptr, typalign);
+
+        switch ( ARR_ELEMTYPE(arr) ) {
+            case INT2OID:
+                AppendInt16(a_buffer, DatumGetInt16(elem));
+                break;
+            case INT4OID:
+                AppendInt32(a_buffer, DatumGetInt32(elem));
+                break;
+            case INT8OID:
+                AppendInt64(a_buffer, DatumGetInt64(elem));
+                break;
+            case FLOAT4OID:
+                AppendFloat4(a_buffer, DatumGetFloat4(elem));
+                break;
+            case FLOAT8OID:
+                AppendFloat8(a_buffer, DatumGetFloat8(elem));
+                break;
+            case NUMERICOID:
+                AppendNumeric(a_buffer, elem);
+                break;
+            default:
+                AppendText(a_buffer, elem);
+                break;
+        }
+    }
+    appendStringInfoCharMacro(a_buffer, ']');
+
+    if ( (Pointer) arr != DatumGetPointer(a_value) ) {
+        pfree(arr);
+    }
+    return true;
+}
+
+/**
+ * @brief Write base64 encoding of a_src, with padding.
+ *
+ * When the CPU has SSSE3, 12 input bytes are expanded to 16 output chars per iteration using shuffles
+ * and a nibble lookup, remaining bytes are encoded 3 at a time.
+ *
+ * @return end of written chars.
+ */
+char* pg_jsonapi::JsonWriter::WriteBase64 (char* a_dst, const unsigned char* a_src, size_t a_len)
+{
+#if defined(JSONAPI_X86_DISPATCH)
+    if ( a_len >= 16 && HasSsse3() ) {
+        size_t done = EncodeBlocksSsse3(a_dst, a_src, a_len);
+        a_src += done / 4 * 3;
+        a_len -= done / 4 * 3;
+        a_dst += done;
+    }
+#endif
+    while ( a_len >= 3 ) {
+        uint32 triple = ( (uint32) a_src[0] << 16 ) | ( (uint32) a_src[1] << 8 ) | a_src[2];
+        a_dst[0] = k_base64_chars[(triple >> 18) & 0x3F];
+        a_dst[1] = k_base64_chars[(triple >> 12) & 0x3F];
+        a_dst[2] = k_base64_chars[(triple >>  6) & 0x3F];
+        a_dst[3] = k_base64_chars[ triple        & 0x3F];
+        a_src += 3;
+        a_len -= 3;
+        a_dst += 4;
+    }
+    if ( a_len > 0 ) {
+        uint32 triple = ( (uint32) a_src[0] << 16 ) | ( a_len > 1 ? (uint32) a_src[1] << 8 : 0 );
+        a_dst[0] = k_base64_chars[(triple >> 18) & 0x3F];
+        a_dst[1] = k_base64_chars[(triple >> 12) & 0x3F];
+        a_dst[2] = ( a_len > 1 ) ? k_base64_chars[(triple >> 6) & 0x3F] : '=';
+        a_dst[3] = '=';
+        a_dst += 4;
+    }
+    return a_dst;
+}
+
+/**
+ * @brief Append bytea value as a base64 string, encoded straight from the detoasted varlena.
+ */
+void pg_jsonapi::JsonWriter::AppendBase64 (StringInfo a_buffer, Datum a_value)
+{
+    struct varlena* bin = PG_DETOAST_DATUM_PACKED(a_value);
+    size_t          len = VARSIZE_ANY_EXHDR(bin);
+
+    enlargeStringInfo(a_buffer, (int) ( (len + 2) / 3 * 4 + 2 ));
+
+    char* dst = a_buffer->data + a_buffer->len;
+    *dst++ = '"';
+    dst = WriteBase64(dst, (const unsigned char*) VARDATA_ANY(bin), len);
+    *dst++ = '"';
+    a_buffer->len = (int) (dst - a_buffer->data);
+    a_buffer->data[a_buffer->len] = '\0';
+
+    if ( (Pointer) bin != DatumGetPointer(a_value) ) {
+        pfree(bin);
+    }
+}
+
+/**
+ * @brief Append json value as is, straight from the detoasted text.
+ */
+void pg_jsonapi::JsonWriter::AppendJson (StringInfo a_buffer, Datum a_value)
+{
+    struct varlena* txt = PG_DETOAST_DATUM_PACKED(a_value);
+
+    appendBinaryStringInfo(a_buffer, VARDATA_ANY(txt), (int) VARSIZE_ANY_EXHDR(txt));
+
+    if ( (Pointer) txt != DatumGetPointer(a_value) ) {
+        pfree(txt);
+    }
+}
+
+/**
+ * @brief Append jsonb value, written by JsonbToCString directly into the buffer without an intermediate string.
+ */
+void pg_jsonapi::JsonWriter::AppendJsonb (StringInfo a_buffer, Datum a_value)
+{
+    Jsonb* jb = DatumGetJsonbP(a_value);
+
+    JsonbToCString(a_buffer, &jb->root, VARSIZE(jb));
+
+    if ( (Pointer) jb != DatumGetPointer(a_value) ) {
+        pfree(jb);
+    }
+}
+
+/**
+ * @brief Write ISO date, year zero padded to 4 digits, as EncodeDateOnly does for USE_ISO_DATES.
+ *
+ * @return end of written chars, the " BC" suffix is left to the caller.
+ */
+char* pg_jsonapi::JsonWriter::WriteDate (char* a_dst, int a_year, int a_mon, int a_mday)
+{
+    int year = ( a_year > 0 ) ? a_year : -(a_year - 1);
+
+    if ( year < 10000 ) {
+        a_dst = WriteTwoDigits(a_dst, year / 100);
+        a_dst = WriteTwoDigits(a_dst, year % 100);
+    } else {
+        a_dst += WriteUInt64(a_dst, (uint64) year);
+    }
+    *a_dst++ = '-';
+    a_dst = WriteTwoDigits(a_dst, a_mon);
+    *a_dst++ = '-';
+    return WriteTwoDigits(a_dst, a_mday);
+}
+
+/**
+ * @brief Write ISO time with microseconds, trailing zeros of fraction removed, as AppendTimestampSeconds does.
+ */
+char* pg_jsonapi::JsonWriter::WriteTime (char* a_dst, int a_hour, int a_min, int a_sec, fsec_t a_fsec)
+{
+    a_dst = WriteTwoDigits(a_dst, a_hour);
+    *a_dst++ = ':';
+    a_dst = WriteTwoDigits(a_dst, a_min);
+    *a_dst++ = ':';
+    a_dst = WriteTwoDigits(a_dst, a_sec);
+    if ( 0 != a_fsec ) {
+        int value = ( a_fsec < 0 ) ? -a_fsec : a_fsec;
+        int digits = 6;
+        while ( 0 == value % 10 ) {
+            value /= 10;
+            digits--;
+        }
+        *a_dst++ = '.';
+        for ( int i = digits - 1; i >= 0; i-- ) {
+            a_dst[i] = (char) ('0' + value % 10);
+            value /= 10;
+        }
+        a_dst += digits;
+    }
+    return a_dst;
+}
+
+/**
+ * @brief Append quoted date, as date_out would write it with DateStyle ISO.
+ *
+ * @return @li true if value was written
+ *         @li false for infinite dates, left to the type output function
+ */
+bool pg_jsonapi::JsonWriter::AppendDate (StringInfo a_buffer, DateADT a_value)
+{
+    int year, mon, mday;
+
+    if ( DATE_NOT_FINITE(a_value) ) {
+        return false;
+    }
+    j2date(a_value + POSTGRES_EPOCH_JDATE, &year, &mon, &mday);
+
+    enlargeStringInfo(a_buffer, 32);
+    char* dst = a_buffer->data + a_buffer->len;
+    *dst++ = '"';
+    dst = WriteDate(dst, year, mon, mday);
+    if ( year <= 0 ) {
+        memcpy(dst, " BC", 3);
+        dst += 3;
+    }
+    *dst++ = '"';
+    a_buffer->len = (int) (dst - a_buffer->data);
+    a_buffer->data[a_buffer->len] = '\0';
+    return true;
+}
+
+/**
+ * @brief Append quoted timestamp, as timestamp_out would write it with DateStyle ISO.
+ *
+ * @return @li true if value was written
+ *         @li false for infinite or out of range values, left to the type output function
+ */
+bool pg_jsonapi::JsonWriter::AppendTimestamp (StringInfo a_buffer, Timestamp a_value)
+{
+    struct pg_tm tm;
+    fsec_t       fsec;
+
+    if ( TIMESTAMP_NOT_FINITE(a_value) || 0 != timestamp2tm(a_value, NULL, &tm, &fsec, NULL, NULL) ) {
+        return false;
+    }
+
+    enlargeStringInfo(a_buffer, 48);
+    char* dst = a_buffer->data + a_buffer->len;
+    *dst++ = '"';
+    dst = WriteDate(dst, tm.tm_year, tm.tm_mon, tm.tm_mday);
+    *dst++ = ' ';
+    dst = WriteTime(dst, tm.tm_hour, tm.tm_min, tm.tm_sec, fsec);
+    if ( tm.tm_year <= 0 ) {
+        memcpy(dst, " BC", 3);
+        dst += 3;
+    }
+    *dst++ = '"';
+    a_buffer->len = (int) (dst - a_buffer->data);
+    a_buffer->data[a_buffer->len] = '\0';
+    return true;
+}
+
+/**
+ * @brief Append quoted timestamp with time zone, as timestamptz_out would write it with DateStyle ISO.
+ *
+ * @param a_timezone the session time zone, resolved once per request.
+ *
+ * @return @li true if value was written
+ *         @li false for infinite or out of range values, left to the type output function
+ */
+bool pg_jsonapi::JsonWriter::AppendTimestampTz (StringInfo a_buffer, TimestampTz a_value, pg_tz* a_timezone)
+{
+    struct pg_tm tm;
+    fsec_t       fsec;
+    int          tz;
+
+    if ( TIMESTAMP_NOT_FINITE(a_value) || 0 != timestamp2tm(a_value, &tz, &tm, &fsec, NULL, a_timezone) ) {
+        return false;
+    }
+
+    enlargeStringInfo(a_buffer, 64);
+    char* dst = a_buffer->data + a_buffer->len;
+    *dst++ = '"';
+    dst = WriteDate(dst, tm.tm_year, tm.tm_mon, tm.tm_mday);
+    *dst++ = ' ';
+    dst = WriteTime(dst, tm.tm_hour, tm.tm_min, tm.tm_sec, fsec);
+
+    /* time zone as EncodeTimezone: seconds west of UTC, minutes and seconds only when not zero */
+    int sec  = ( tz < 0 ) ? -tz : tz;
+    int min  = sec / SECS_PER_MINUTE;
+    sec -= min * SECS_PER_MINUTE;
+    int hour = min / MINS_PER_HOUR;
+    min -= hour * MINS_PER_HOUR;
+    *dst++ = ( tz <= 0 ) ? '+' : '-';
+    dst = WriteTwoDigits(dst, hour);
+    if ( 0 != sec ) {
+        *dst++ = ':';
+        dst = WriteTwoDigits(dst, min);
+        *dst++ = ':';
+        dst = WriteTwoDigits(dst, sec);
+    } else if ( 0 != min ) {
+        *dst++ = ':';
+        dst = WriteTwoDigits(dst, min);
+    }
+
+    if ( tm.tm_year <= 0 ) {
+        memcpy(dst, " BC", 3);
+        dst += 3;
+    }
+    *dst++ = '"';
+    a_buffer->len = (int) (dst - a_buffer->data);
+    a_buffer->data[a_buffer->len] = '\0';
+    return true;
+}
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::JsonValue::JsonValue ()
+{
+    Reset();
+}
+
+void pg_jsonapi::JsonValue::Reset ()
+{
+    type_  = InvalidOid;
+    data_  = NULL;
+    len_   = 0;
+    jsonb_ = NULL;
+}
+
+/**
+ * @brief Detoast json or jsonb value, keeping it for later checks and serialization.
+ */
+void pg_jsonapi::JsonValue::Set (Datum a_value, Oid a_type)
+{
+    Reset();
+    type_ = a_type;
+    if ( JSONBOID == a_type ) {
+        jsonb_ = DatumGetJsonbP(a_value);
+    } else {
+        struct varlena* txt = PG_DETOAST_DATUM_PACKED(a_value);
+        data_ = VARDATA_ANY(txt);
+        len_  = VARSIZE_ANY_EXHDR(txt);
+    }
+}
+
+/**
+ * @brief Check if value is an object ('{') or an array ('['), in constant time.
+ */
+bool pg_jsonapi::JsonValue::IsRoot (char a_open) const
+{
+    if ( NULL != jsonb_ ) {
+        if ( '{' == a_open ) {
+            return JB_ROOT_IS_OBJECT(jsonb_);
+        }
+        return JB_ROOT_IS_ARRAY(jsonb_) && ! JB_ROOT_IS_SCALAR(jsonb_);
+    }
+    return ( len_ > 0 && a_open == data_[0] && ( '{' == a_open ? '}' : ']' ) == data_[len_-1] );
+}
+
+/**
+ * @brief Size of serialized value, estimated from the binary size for jsonb.
+ */
+size_t pg_jsonapi::JsonValue::Size () const
+{
+    return ( NULL != jsonb_ ) ? VARSIZE(jsonb_) : len_;
+}
+
+void pg_jsonapi::JsonValue::AppendTo (StringInfo a_buffer) const
+{
+    if ( NULL != jsonb_ ) {
+        JsonbToCString(a_buffer, &jsonb_->root, VARSIZE(jsonb_));
+    } else {
+        appendBinaryStringInfo(a_buffer, data_, (int) len_);
+    }
+}
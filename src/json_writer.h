@@ -0,0 +1,122 @@
+/**
+ * @file json_writer.h Declaration of JsonWriter
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CLD_PG_JSONAPI_JSON_WRITER_H
+#define CLD_PG_JSONAPI_JSON_WRITER_H
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "postgres.h"
+#include "lib/stringinfo.h"
+#include "utils/timestamp.h"
+#include "pgtime.h"
+#include "utils/date.h"
+#include "utils/jsonb.h"
+#pragma GCC diagnostic pop
+} // extern "C"
+
+#if PG_MAJORVERSION_NUM < 11
+#define DatumGetJsonbP(d) DatumGetJsonb(d)
+#endif
+
+namespace pg_jsonapi
+{
+
+    /**
+     * @brief Serialization kernels writing scalar values straight into the response buffer,
+     *        without varargs formatting nor intermediate palloc'ed strings.
+     */
+    class JsonWriter
+    {
+
+    public:
+
+        static void AppendInt16   (StringInfo a_buffer, int16 a_value);
+        static void AppendInt32   (StringInfo a_buffer, int32 a_value);
+        static void AppendInt64   (StringInfo a_buffer, int64 a_value);
+        static void AppendFloat4  (StringInfo a_buffer, float4 a_value);
+        static void AppendFloat8  (StringInfo a_buffer, float8 a_value);
+        static void AppendNumeric (StringInfo a_buffer, Datum a_value);
+        static void AppendBool    (StringInfo a_buffer, bool a_value);
+
+        static void AppendEscaped (StringInfo a_buffer, const char* a_str, int a_len);
+        static void AppendEscaped (StringInfo a_buffer, const char* a_str);
+        static void AppendText    (StringInfo a_buffer, Datum a_value);
+        static bool AppendArray   (StringInfo a_buffer, Datum a_value);
+        static void AppendBase64  (StringInfo a_buffer, Datum a_value);
+        static void AppendJson    (StringInfo a_buffer, Datum a_value);
+        static void AppendJsonb   (StringInfo a_buffer, Datum a_value);
+
+        static bool AppendDate        (StringInfo a_buffer, DateADT a_value);
+        static bool AppendTimestamp   (StringInfo a_buffer, Timestamp a_value);
+        static bool AppendTimestampTz (StringInfo a_buffer, TimestampTz a_value, pg_tz* a_timezone);
+
+    public: // raw buffer kernels, never calling palloc nor ereport
+
+        static const int k_max_number_len_ = 32;  // enough for any number written below
+
+        static int   WriteUInt64       (char* a_dst, uint64 a_value);
+        static int   WriteInt64        (char* a_dst, int64 a_value);
+        static int   WriteFloat4       (char* a_dst, float4 a_value);
+        static int   WriteFloat8       (char* a_dst, float8 a_value);
+        static int   FindEscape        (const char* a_str, int a_len);
+        static int   WriteEscapedChar  (char* a_dst, char a_char);
+
+    private:
+
+        static char* WriteBase64   (char* a_dst, const unsigned char* a_src, size_t a_len);
+        static char* WriteDate     (char* a_dst, int a_year, int a_mon, int a_mday);
+        static char* WriteTime     (char* a_dst, int a_hour, int a_min, int a_sec, fsec_t a_fsec);
+
+    };
+
+    /**
+     * @brief json or jsonb value detoasted only once, json text is kept as pointer and length
+     *        so it can be checked and appended without copies nor strlen.
+     */
+    class JsonValue
+    {
+    public:
+        Oid          type_;    // JSONOID or JSONBOID, InvalidOid if not set
+        const char*  data_;    // json text, not NUL terminated
+        size_t       len_;     // json text length
+        Jsonb*       jsonb_;   // detoasted jsonb
+
+    public: // Methods
+        JsonValue ();
+
+        void   Set      (Datum a_value, Oid a_type);
+        void   Reset    ();
+        bool   IsSet    () const;
+        bool   IsRoot   (char a_open) const;
+        size_t Size     () const;
+        void   AppendTo (StringInfo a_buffer) const;
+    };
+
+    inline bool JsonValue::IsSet () const
+    {
+        return InvalidOid != type_;
+    }
+
+} // namespace pg_jsonapi
+
+#endif // CLD_PG_JSONAPI_JSON_WRITER_H
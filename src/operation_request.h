@@ -25,12 +25,11 @@
 #include <stdlib.h>
 #include <string>
 
-#include "json/json.h"
-
 #include "resource_data.h"
 #include "error_object.h"
 #include "observed_stat.h"
 #include "utils_adt_json.h"
+#include "request_body.h"
 
 namespace pg_jsonapi
 {
@@ -57,7 +56,7 @@ namespace pg_jsonapi
         std::string                 rq_related_;
         bool                        rq_relationship_;
         std::string                 rq_attribute_;
-        const JsonapiJson::Value*   rq_body_data_;
+        OperationBody               rq_body_;
 
     private: // Attributes - used to query postgres and keep results
         std::string        q_buffer_;
@@ -70,11 +69,12 @@ namespace pg_jsonapi
         bool ParsePath (std::string a_patch_path);
 
         bool BodyHasValidResourceData();
-        bool BodyHasValidAttributes(const JsonapiJson::Value& a_value);
-        bool BodyHasValidRelationships(const JsonapiJson::Value& a_value);
-        bool BodyHasValidRelationshipData(const JsonapiJson::Value& a_value);
+        bool BodyHasValidAttributes();
+        bool BodyHasValidRelationships();
+        bool BodyHasValidRelationshipData(const BodyIdentifier& a_value);
 
-        void GetArrayAsSQLValue(const JsonapiJson::Value& a_value, std::string& a_sql_value);
+        void GetArrayAsSQLValue(const StringVector& a_elements, std::string& a_sql_value);
+        void GetAttributeAsSQLValue(const BodyAttribute& a_attribute, std::string& a_sql_value);
 
         const std::string& GetResourceInsertCmd();
         const std::string& GetResourceUpdateCmd();
@@ -93,7 +93,7 @@ namespace pg_jsonapi
         static void        AddQuotedStringToBuffer(std::string& a_buffer, const char* a_value, bool a_quote_value);
 
         void               SetRequestType(int a_index, OperationType a_type);
-        bool               SetRequest(const JsonapiJson::Value* a_data, std::string a_path = std::string());
+        bool               SetRequest(OperationBody& a_body, std::string a_path = std::string());
         const std::string& GetInsertCmd();
         const std::string& GetUpdateCmd();
         const std::string& GetDeleteCmd();
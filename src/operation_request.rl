@@ -35,7 +35,6 @@ pg_jsonapi::OperationRequest::OperationRequest ()
     rq_index_        = 0;
     rq_type_         = E_OP_UNDEFINED;
     rq_relationship_ = false;
-    rq_body_data_    = NULL;
     q_required_count_ = 1;
 }
 
@@ -161,38 +160,37 @@ bool pg_jsonapi::OperationRequest::BodyHasValidResourceData()
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 
-    if (! (*rq_body_data_).isObject() ) {
+    const BodyIdentifier& data = rq_body_.data_;
+
+    if ( E_BODY_OBJECT != data.kind_ ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "resource value must be a valid jsonapi resource object");
         return false;
     }
 
-    const JsonapiJson::Value::Members& members = (*rq_body_data_).getMemberNames();
-    for ( JsonapiJson::Value::Members::const_iterator key = members.begin(); key != members.end(); ++key ) {
-        if ( "type" == *key ) {
-            if ( ! (*rq_body_data_)["type"].isString()
-                || (*rq_body_data_)["type"].asString() != rq_resource_type_ ) {
-                AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "type in body is required, must match path and be a non-empty string");
-                return false;
-            }
-        } else if ( "id" == *key ) {
-            if ( ! (*rq_body_data_)["id"].isString()
-                || ( rq_resource_id_.length() && (*rq_body_data_)["id"].asString() != rq_resource_id_ ) ) {
-                AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "id in body is required, must match path and be a non-empty string");
-                return false;
-            }
-            rq_resource_id_ = (*rq_body_data_)["id"].asString();
-        } else if ( "attributes" == *key ) {
-            if ( ! BodyHasValidAttributes((*rq_body_data_)["attributes"]) ) {
-                return false;
-            }
-        } else if ( "relationships" == *key ) {
-            if ( ! BodyHasValidRelationships((*rq_body_data_)["relationships"]) ) {
-                return false;
-            }
-        } else {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "resource value must be a valid jsonapi resource object");
+    if ( E_BODY_ABSENT != data.type_kind_ ) {
+        if (   E_BODY_STRING != data.type_kind_
+            || rq_resource_type_ != data.type_ ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "type in body is required, must match path and be a non-empty string");
+            return false;
+        }
+    }
+    if ( E_BODY_ABSENT != data.id_kind_ ) {
+        if (   E_BODY_STRING != data.id_kind_
+            || ( rq_resource_id_.length() && rq_resource_id_ != data.id_ ) ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "id in body is required, must match path and be a non-empty string");
             return false;
         }
+        rq_resource_id_ = data.id_;
+    }
+    if ( E_BODY_ABSENT != rq_body_.attributes_kind_ && ! BodyHasValidAttributes() ) {
+        return false;
+    }
+    if ( E_BODY_ABSENT != rq_body_.relationships_kind_ && ! BodyHasValidRelationships() ) {
+        return false;
+    }
+    if ( ! rq_body_.unknown_member_.empty() ) {
+        AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "resource value must be a valid jsonapi resource object");
+        return false;
     }
 
     return true;
@@ -204,31 +202,26 @@ bool pg_jsonapi::OperationRequest::BodyHasValidResourceData()
  * @return @li true if is a valid attributes object data
  *         @li false if not
  */
-bool pg_jsonapi::OperationRequest::BodyHasValidAttributes(const JsonapiJson::Value& a_value)
+bool pg_jsonapi::OperationRequest::BodyHasValidAttributes()
 {
-    if ( a_value.isNull() ) {
+    if ( E_BODY_NULL == rq_body_.attributes_kind_ ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "null value for attributes");
         return false;
     }
 
-    if (   ! a_value.isObject() ) {
+    if ( E_BODY_OBJECT != rq_body_.attributes_kind_ ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid value for attributes");
         return false;
     }
 
-    const JsonapiJson::Value::Members& attrs = a_value.getMemberNames();
-    for ( JsonapiJson::Value::Members::const_iterator key = attrs.begin(); key != attrs.end(); ++key ) {
-        if ( a_value[*key].isString() ) {
-            if ( !g_qb->AttributeIsValidUsingXssValidators(key->c_str(), a_value[*key].asString().c_str()) ){
+    for ( BodyAttributeVector::const_iterator attr = rq_body_.attributes_.begin(); attr != rq_body_.attributes_.end(); ++attr ) {
+        if ( E_BODY_STRING == attr->kind_ ) {
+            if ( !g_qb->AttributeIsValidUsingXssValidators(attr->name_, attr->value_) ){
                 return false;
             }
-        } else if (      a_value[*key].isArray()
-                    &&   a_value[*key].size()
-                    && ! a_value[*key][0].isObject()
-                    && ! a_value[*key].isNull()
-                   ) {
-            for ( JsonapiJson::ArrayIndex i = 0; i < a_value[*key].size(); i++ ) {
-                if ( !g_qb->AttributeIsValidUsingXssValidators(key->c_str(), a_value[*key][i].asString().c_str()) ){
+        } else if ( E_BODY_ARRAY == attr->kind_ && ! attr->is_json_ ) {
+            for ( StringVector::const_iterator element = attr->elements_.begin(); element != attr->elements_.end(); ++element ) {
+                if ( !g_qb->AttributeIsValidUsingXssValidators(attr->name_, *element) ){
                     return false;
                 }
             }
@@ -244,44 +237,33 @@ bool pg_jsonapi::OperationRequest::BodyHasValidAttributes(const JsonapiJson::Val
  * @return @li true if is a valid relationships object data
  *         @li false if not
  */
-bool pg_jsonapi::OperationRequest::BodyHasValidRelationships(const JsonapiJson::Value& a_value)
+bool pg_jsonapi::OperationRequest::BodyHasValidRelationships()
 {
-    if ( a_value.isNull() ) {
+    if ( E_BODY_NULL == rq_body_.relationships_kind_ ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "null value for relationships");
         return false;
     }
 
-    if (   ! a_value.isObject() ) {
+    if ( E_BODY_OBJECT != rq_body_.relationships_kind_ ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid value for relationships");
         return false;
     }
 
-    if ( ! a_value.isObject() ) {
-        AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid data for \"relationships\"");
-        return false;
-    }
-
-    const JsonapiJson::Value::Members& members = a_value.getMemberNames();
-    for ( JsonapiJson::Value::Members::const_iterator related = members.begin(); related != members.end(); ++related ) {
+    for ( BodyRelationshipVector::const_iterator relationship = rq_body_.relationships_.begin(); relationship != rq_body_.relationships_.end(); ++relationship ) {
         //#warning joana TODO: check key? check to-one vs to-many?
-
-        if ( 1 != a_value[*related].size() || ! a_value[*related].isMember("data") ) {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid data for relationship \"%s\"", (*related).c_str());
+        if ( E_BODY_OBJECT != relationship->kind_ || 1 != relationship->members_ || E_BODY_ABSENT == relationship->data_kind_ ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid data for relationship \"%s\"", relationship->name_.c_str());
             return false;
         }
 
-        if ( a_value[*related]["data"].isObject() ) {
-            if ( ! BodyHasValidRelationshipData(a_value[*related]["data"]) ) {
-                return false;
-            }
-        } else if ( a_value[*related]["data"].isArray() ) {
-            for (unsigned int index = 0; index < a_value[*related]["data"].size(); index++) {
-                if ( ! BodyHasValidRelationshipData( a_value[*related][index] ) ) {
+        if ( E_BODY_OBJECT == relationship->data_kind_ || E_BODY_ARRAY == relationship->data_kind_ ) {
+            for ( BodyIdentifierVector::const_iterator data = relationship->data_.begin(); data != relationship->data_.end(); ++data ) {
+                if ( ! BodyHasValidRelationshipData(*data) ) {
                     return false;
                 }
             }
         } else {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid value for relationship \"%s\"", (*related).c_str());
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid value for relationship \"%s\"", relationship->name_.c_str());
             return false;
         }
     }
@@ -295,17 +277,10 @@ bool pg_jsonapi::OperationRequest::BodyHasValidRelationships(const JsonapiJson::
  * @return @li true if data is valid relationships object data
  *         @li false if not
  */
-bool pg_jsonapi::OperationRequest::BodyHasValidRelationshipData(const JsonapiJson::Value& a_value)
+bool pg_jsonapi::OperationRequest::BodyHasValidRelationshipData(const BodyIdentifier& a_value)
 {
-    if ( a_value.isNull() ) {
-        return true;
-    }
-
-    if (   ! a_value.isObject()
-        || ( 2 != a_value.getMemberNames().size() )
-        || ( !a_value.isMember("type") || !a_value["type"].isString() || a_value["type"].asString().empty() )
-        || ( !a_value.isMember("id")   || !a_value["id"].isString()   || a_value["id"].asString().empty()   )
-        || ( rq_relationship_ && a_value["type"].asString() != rq_related_ )
+    if (   ! a_value.IsValid()
+        || ( E_BODY_OBJECT == a_value.kind_ && rq_relationship_ && a_value.type_ != rq_related_ )
         ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid value for relationship");
         return false;
@@ -317,15 +292,17 @@ bool pg_jsonapi::OperationRequest::BodyHasValidRelationshipData(const JsonapiJso
 /**
  * @brief Set content of request and validates the request data.
  *
+ * @param a_body Values read from the request body for this operation, moved into the operation.
+ *
  * @return @li true if data is valid
  *         @li false if an error occurs
  */
-bool pg_jsonapi::OperationRequest::SetRequest (const JsonapiJson::Value* a_data, std::string a_patch_path)
+bool pg_jsonapi::OperationRequest::SetRequest (OperationBody& a_body, std::string a_patch_path)
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 
     bool rv = true;
-    rq_body_data_     = a_data;
+    std::swap(rq_body_, a_body);
 
     if ( a_patch_path.length() ) {
         if ( ! ParsePath(a_patch_path) ) {
@@ -349,18 +326,18 @@ bool pg_jsonapi::OperationRequest::SetRequest (const JsonapiJson::Value* a_data,
             AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "attribute can only be specified on path for replace operations");
             rv = false;
         }
-        if ( !(*rq_body_data_).isConvertibleTo(JsonapiJson::stringValue) ) {
+        if ( ! rq_body_.IsConvertibleToString() ) {
             AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid value for attribute '%s'", rq_attribute_.c_str());
             rv = false;
         }
     } else if ( rq_relationship_ ) {
-        if ( (*rq_body_data_).isObject() ) {
-            if ( ! BodyHasValidRelationshipData(*rq_body_data_) ) {
+        if ( E_BODY_OBJECT == rq_body_.data_.kind_ ) {
+            if ( ! BodyHasValidRelationshipData(rq_body_.data_) ) {
                 rv = false;
             }
-        } else if ( (*rq_body_data_).isArray() ) {
-            for (unsigned int index = 0; index < (*rq_body_data_).size(); index++) {
-                if ( ! BodyHasValidRelationshipData((*rq_body_data_)[index]) ) {
+        } else if ( E_BODY_ARRAY == rq_body_.data_.kind_ ) {
+            for ( BodyIdentifierVector::const_iterator element = rq_body_.elements_.begin(); element != rq_body_.elements_.end(); ++element ) {
+                if ( ! BodyHasValidRelationshipData(*element) ) {
                     rv = false;
                 }
             }
@@ -369,14 +346,13 @@ bool pg_jsonapi::OperationRequest::SetRequest (const JsonapiJson::Value* a_data,
             rv = false;
         }
     } else { // resource object
-        if ( NULL != rq_body_data_  ) {
+        if ( E_BODY_ABSENT != rq_body_.data_.kind_ ) {
             if ( !BodyHasValidResourceData() ) {
                 return false;
             }
             if (   ( E_OP_UPDATE == rq_type_ || E_OP_DELETE == rq_type_ )
-                && (   ! (*rq_body_data_).isMember("id")
-                    || ! (*rq_body_data_)["id"].isString()
-                    || (*rq_body_data_)["id"].asString().empty() ) ) {
+                && (   E_BODY_STRING != rq_body_.data_.id_kind_
+                    || rq_body_.data_.id_.empty() ) ) {
                     AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "type and id must be specified in body" );
                     rv = false;
                 }
@@ -401,20 +377,38 @@ bool pg_jsonapi::OperationRequest::SetRequest (const JsonapiJson::Value* a_data,
 /**
  * @brief Get a Json Array converted to a SQL Array Value to be used on insert/update.
  */
-void pg_jsonapi::OperationRequest::GetArrayAsSQLValue(const JsonapiJson::Value& a_value, std::string& a_sql_value)
+void pg_jsonapi::OperationRequest::GetArrayAsSQLValue(const StringVector& a_elements, std::string& a_sql_value)
 {
     a_sql_value += "'{";
     const char* sep = "";
-    for ( JsonapiJson::ArrayIndex i = 0; i < a_value.size(); i++ ) {
+    for ( StringVector::const_iterator element = a_elements.begin(); element != a_elements.end(); ++element ) {
         a_sql_value += sep;
         a_sql_value += '"';
-        AddQuotedStringToBuffer(a_sql_value, a_value[i].asString().c_str(), /*quote*/ false);
+        AddQuotedStringToBuffer(a_sql_value, element->c_str(), /*quote*/ false);
         a_sql_value += '"';
         sep = ",";
     }
     a_sql_value += "}'";
 }
 
+/**
+ * @brief Get an attribute value as a SQL Value to be used on insert/update.
+ */
+void pg_jsonapi::OperationRequest::GetAttributeAsSQLValue(const BodyAttribute& a_attribute, std::string& a_sql_value)
+{
+    if ( E_BODY_NULL == a_attribute.kind_ ) {
+        a_sql_value += "NULL";
+    } else if ( E_BODY_ARRAY == a_attribute.kind_ && ! a_attribute.is_json_ ) {
+        /* temporary hack only serialize using old version when array does not have objects
+           TODO: get tupdesc from DB and serialize as json depending on column definition
+        */
+        GetArrayAsSQLValue(a_attribute.elements_, a_sql_value);
+    } else {
+        /* strings decoded, other values as their json text */
+        AddQuotedStringToBuffer(a_sql_value, a_attribute.value_.c_str(), /*quote*/ true);
+    }
+}
+
 /**
  * @brief Get a command to INSERT a resource returning it's id.
  */
@@ -423,20 +417,16 @@ const std::string& pg_jsonapi::OperationRequest::GetResourceInsertCmd()
     const ResourceConfig& rc = g_qb->GetDocumentConfig()->GetResource(rq_resource_type_);
     std::string values;
 
-    JsonapiJson::FastWriter writer;
-    writer.omitEndingLineFeed();
-
     q_buffer_ = "INSERT INTO ";
     rc.AddPGQueryFromItem(q_buffer_);
 
-    if ( (*rq_body_data_).isMember("id") ) {
+    if ( E_BODY_ABSENT != rq_body_.data_.id_kind_ ) {
         q_buffer_ += " (" + rc.GetPGQueryColId();
         values += " VALUES (";
-        AddQuotedStringToBuffer(values, (*rq_body_data_)["id"].asString().c_str(), /*quote*/ true);
+        AddQuotedStringToBuffer(values, rq_body_.data_.id_.c_str(), /*quote*/ true);
     }
 
-    const JsonapiJson::Value::Members& attrs = (*rq_body_data_)["attributes"].getMemberNames();
-    for ( JsonapiJson::Value::Members::const_iterator key = attrs.begin(); key != attrs.end(); ++key ) {
+    for ( BodyAttributeVector::const_iterator attr = rq_body_.attributes_.begin(); attr != rq_body_.attributes_.end(); ++attr ) {
         if ( values.empty() ) {
             q_buffer_ += " (" ;
             values = " VALUES (";
@@ -444,28 +434,12 @@ const std::string& pg_jsonapi::OperationRequest::GetResourceInsertCmd()
             q_buffer_ += ",";
             values    += ",";
         }
-        q_buffer_ += rc.GetPGQueryColumn(*key);
-
-        if ( (*rq_body_data_)["attributes"][*key].isString() ) {
-            AddQuotedStringToBuffer(values, (*rq_body_data_)["attributes"][*key].asString().c_str(), /*quote*/ true);
-        } else if ( (*rq_body_data_)["attributes"][*key].isNull() ) {
-            values += "NULL";
-        } else if (      (*rq_body_data_)["attributes"][*key].isArray()
-                    &&   (*rq_body_data_)["attributes"][*key].size()
-                    && ! (*rq_body_data_)["attributes"][*key][0].isObject()
-                   ) {
-            /* temporary hack only serialize using old version when array does not have objects 
-               TODO: get tupdesc from DB and serialize as json depending on column definition
-            */
-            GetArrayAsSQLValue((*rq_body_data_)["attributes"][*key], values);
-        } else {
-            values += '\'' + writer.write((*rq_body_data_)["attributes"][*key]) + '\'' ;
-        }
+        q_buffer_ += rc.GetPGQueryColumn(attr->name_);
+        GetAttributeAsSQLValue(*attr, values);
     }
 
-    const JsonapiJson::Value::Members& relats = (*rq_body_data_)["relationships"].getMemberNames();
-    for ( JsonapiJson::Value::Members::const_iterator key = relats.begin(); key != relats.end(); ++key ) {
-        if ( ! rc.IsPGChildRelation(*key) ) { // relationship on parent table
+    for ( BodyRelationshipVector::const_iterator relat = rq_body_.relationships_.begin(); relat != rq_body_.relationships_.end(); ++relat ) {
+        if ( ! rc.IsPGChildRelation(relat->name_) && E_BODY_OBJECT == relat->data_kind_ ) { // relationship on parent table
             if ( values.empty() ) {
                 q_buffer_ += " (" ;
                 values = " VALUES (";
@@ -473,8 +447,8 @@ const std::string& pg_jsonapi::OperationRequest::GetResourceInsertCmd()
                 q_buffer_ += ",";
                 values    += ",";
             }
-            q_buffer_ += rc.GetPGQueryColumn(*key);
-            AddQuotedStringToBuffer(values, (*rq_body_data_)["relationships"][*key]["data"]["id"].asString().c_str(), /*quote*/ true);
+            q_buffer_ += rc.GetPGQueryColumn(relat->name_);
+            AddQuotedStringToBuffer(values, relat->data_[0].id_.c_str(), /*quote*/ true);
         }
     }
 //#warning TODO "relationships that are NOT in same table"
@@ -517,14 +491,10 @@ const std::string& pg_jsonapi::OperationRequest::GetResourceUpdateCmd()
     const ResourceConfig& rc = g_qb->GetDocumentConfig()->GetResource(rq_resource_type_);
     bool first = true;
 
-    JsonapiJson::FastWriter writer;
-    writer.omitEndingLineFeed();
-
     q_buffer_ = "UPDATE ";
     rc.AddPGQueryFromItem(q_buffer_);
 
-    const JsonapiJson::Value::Members& attrs = (*rq_body_data_)["attributes"].getMemberNames();
-    for ( JsonapiJson::Value::Members::const_iterator key =attrs.begin(); key != attrs.end(); ++key ) {
+    for ( BodyAttributeVector::const_iterator attr = rq_body_.attributes_.begin(); attr != rq_body_.attributes_.end(); ++attr ) {
         if ( first ) {
             first = false;
             q_buffer_ += " SET " ;
@@ -532,36 +502,20 @@ const std::string& pg_jsonapi::OperationRequest::GetResourceUpdateCmd()
             q_buffer_ += ",";
         }
 
-
-        q_buffer_ += rc.GetPGQueryColumn(*key) + "=";
-        if ( (*rq_body_data_)["attributes"][*key].isString() ) {
-            AddQuotedStringToBuffer(q_buffer_, (*rq_body_data_)["attributes"][*key].asString().c_str(), /*quote*/ true);
-        } else if ( (*rq_body_data_)["attributes"][*key].isNull() ) {
-            q_buffer_ += "NULL";
-        } else if (      (*rq_body_data_)["attributes"][*key].isArray()
-                    &&   (*rq_body_data_)["attributes"][*key].size()
-                    && ! (*rq_body_data_)["attributes"][*key][0].isObject()
-                   ) {
-            /* temporary hack only serialize using old version when array does not have objects 
-               TODO: get tupdesc from DB and serialize as json depending on column definition
-            */
-            GetArrayAsSQLValue((*rq_body_data_)["attributes"][*key], q_buffer_);
-        } else {
-            q_buffer_ += '\'' + writer.write((*rq_body_data_)["attributes"][*key]) + '\'' ;
-        }
+        q_buffer_ += rc.GetPGQueryColumn(attr->name_) + "=";
+        GetAttributeAsSQLValue(*attr, q_buffer_);
     }
 
-    const JsonapiJson::Value::Members& relats = (*rq_body_data_)["relationships"].getMemberNames();
-    for ( JsonapiJson::Value::Members::const_iterator key = relats.begin(); key != relats.end(); ++key ) {
-        if ( ! rc.IsPGChildRelation(*key) ) { // relationship on parent table
+    for ( BodyRelationshipVector::const_iterator relat = rq_body_.relationships_.begin(); relat != rq_body_.relationships_.end(); ++relat ) {
+        if ( ! rc.IsPGChildRelation(relat->name_) && E_BODY_OBJECT == relat->data_kind_ ) { // relationship on parent table
             if ( first ) {
                 first = false;
                 q_buffer_ += " SET " ;
             } else {
                 q_buffer_ += ",";
             }
-            q_buffer_ += rc.GetPGQueryColumn(*key) + "=";
-            AddQuotedStringToBuffer(q_buffer_, (*rq_body_data_)["relationships"][*key]["data"]["id"].asString().c_str(), /*quote*/ true);
+            q_buffer_ += rc.GetPGQueryColumn(relat->name_) + "=";
+            AddQuotedStringToBuffer(q_buffer_, relat->data_[0].id_.c_str(), /*quote*/ true);
         }
     }
     q_buffer_ += " WHERE ";
@@ -638,14 +592,14 @@ const std::string& pg_jsonapi::OperationRequest::GetPGChildRelationshipInsertCmd
     q_buffer_ += " VALUES (" + rc.GetPGRelationQueryColParentId(rq_related_)
               + "," + rc.GetPGRelationQueryColChildId(rq_related_) + ") ";
 
-    if ( (*rq_body_data_).isObject() ) {
-        q_buffer_ += "('" + rq_resource_id_ + "', '" + (*rq_body_data_)["id"].asString() + "') ";
-    } else { // (*rq_body_data_).isArray()
-        for (unsigned int index = 0; index < (*rq_body_data_).size(); index++) {
-            if ( index ) {
+    if ( E_BODY_OBJECT == rq_body_.data_.kind_ ) {
+        q_buffer_ += "('" + rq_resource_id_ + "', '" + rq_body_.data_.id_ + "') ";
+    } else { // E_BODY_ARRAY == rq_body_.data_.kind_
+        for ( BodyIdentifierVector::const_iterator element = rq_body_.elements_.begin(); element != rq_body_.elements_.end(); ++element ) {
+            if ( element != rq_body_.elements_.begin() ) {
                 q_buffer_ += ",";
             }
-            q_buffer_ += "('" + rq_resource_id_ + "', '" + (*rq_body_data_)["id"].asString() + "') ";
+            q_buffer_ += "('" + rq_resource_id_ + "', '" + element->id_ + "') ";
         }
     }
     //#warning TODO JOANA RETURNING
@@ -691,10 +645,10 @@ const std::string& pg_jsonapi::OperationRequest::GetInsertCmd ()
         if ( rc.IsPGChildRelation(rq_related_ ) ) {
             GetPGChildRelationshipInsertCmd();
         } else {
-            GetFieldUpdateCmd(rq_related_, (*rq_body_data_)["id"].asString().c_str());
+            GetFieldUpdateCmd(rq_related_, rq_body_.data_.id_.c_str());
         }
     } else if ( !rq_attribute_.empty() ) {
-        GetFieldUpdateCmd(rq_attribute_, (*rq_body_data_).asString().c_str());
+        GetFieldUpdateCmd(rq_attribute_, rq_body_.value_.c_str());
     } else { // resource object
         GetResourceInsertCmd();
     }
@@ -716,10 +670,10 @@ const std::string& pg_jsonapi::OperationRequest::GetUpdateCmd ()
             GetPGChildRelationshipDeleteCmd();
             GetPGChildRelationshipInsertCmd();
         } else {
-            GetFieldUpdateCmd(rq_related_, ((*rq_body_data_)["id"].asString().c_str()));
+            GetFieldUpdateCmd(rq_related_, rq_body_.data_.id_.c_str());
         }
     } else if ( !rq_attribute_.empty() ) {
-        GetFieldUpdateCmd(rq_attribute_, (*rq_body_data_).asString().c_str());
+        GetFieldUpdateCmd(rq_attribute_, rq_body_.value_.c_str());
     } else { // resource object
         GetResourceUpdateCmd();
     }
@@ -0,0 +1,405 @@
+/**
+ * @file parallel_writer.cc Implementation of ParallelWriter
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parallel_writer.h"
+
+#include <new>
+#include <signal.h>
+#include <pthread.h>
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "fmgr.h"
+#include "access/parallel.h"
+#pragma GCC diagnostic pop
+} // extern "C"
+
+namespace
+{
+    /* below this number of values per thread it's not worth to start one */
+    const size_t k_min_values_per_thread = 1024;
+}
+
+/**
+ * @brief Constructor, no threads are started until Grow() is called.
+ */
+pg_jsonapi::WorkerPool::WorkerPool ()
+{
+    pending_ = 0;
+}
+
+/**
+ * @brief The backend's pool, created on first use and never destroyed.
+ *
+ * Threads are left waiting when the backend exits, so neither them nor the mutex they wait on may be torn down.
+ *
+ * @return The pool or NULL if out of memory.
+ */
+pg_jsonapi::WorkerPool* pg_jsonapi::WorkerPool::GetInstance ()
+{
+    static WorkerPool* s_instance = NULL;
+
+    if ( NULL == s_instance ) {
+        s_instance = new (std::nothrow) WorkerPool();
+    }
+    return s_instance;
+}
+
+/**
+ * @brief Start threads until the pool has a_count of them.
+ *
+ * @return The number of threads in the pool, may be less than a_count if a thread could not be started.
+ */
+size_t pg_jsonapi::WorkerPool::Grow (size_t a_count)
+{
+    if ( threads_.size() >= a_count ) {
+        return threads_.size();
+    }
+
+    sigset_t all_signals;
+    sigset_t old_signals;
+
+    /* threads must never handle backend signals, they inherit the blocked mask */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    try {
+        threads_.reserve(a_count);
+        while ( threads_.size() < a_count ) {
+            threads_.push_back(std::thread(&WorkerPool::Run, this));
+        }
+    } catch (...) {
+        /* keep the threads already started */
+    }
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    return threads_.size();
+}
+
+/**
+ * @brief Queue a task for the next idle thread.
+ *
+ * @return @li true if the task was queued
+ *         @li false if out of memory, the task will not run
+ */
+bool pg_jsonapi::WorkerPool::Post (const std::function<void()>& a_task)
+{
+    try {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(a_task);
+        pending_++;
+    } catch (...) {
+        return false;
+    }
+    work_cv_.notify_one();
+    return true;
+}
+
+/**
+ * @brief Block until all posted tasks are finished.
+ */
+void pg_jsonapi::WorkerPool::Wait ()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] () { return 0 == pending_; });
+}
+
+void pg_jsonapi::WorkerPool::Run ()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for ( ;; ) {
+        work_cv_.wait(lock, [this] () { return ! tasks_.empty(); });
+
+        std::function<void()> task;
+        task.swap(tasks_.front());
+        tasks_.pop_front();
+
+        lock.unlock();
+        try {
+            task();
+        } catch (...) {
+            /* task reports its own failure */
+        }
+        task = nullptr;
+        lock.lock();
+
+        if ( 0 == --pending_ ) {
+            done_cv_.notify_all();
+        }
+    }
+}
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::ParallelWriter::ParallelWriter ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    active_         = false;
+    deferred_bytes_ = 0;
+}
+
+/**
+ * @brief Destructor
+ */
+pg_jsonapi::ParallelWriter::~ParallelWriter ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+}
+
+/**
+ * @brief Threads are never started inside parallel query workers.
+ */
+bool pg_jsonapi::ParallelWriter::IsAllowed ()
+{
+    return ! IsParallelWorker();
+}
+
+/**
+ * @brief Start keeping values apart from the skeleton being serialized.
+ */
+void pg_jsonapi::ParallelWriter::Begin ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    values_.clear();
+    deferred_bytes_ = 0;
+    active_         = true;
+}
+
+void pg_jsonapi::ParallelWriter::Clear ()
+{
+    values_.clear();
+    deferred_bytes_ = 0;
+    active_         = false;
+}
+
+void pg_jsonapi::ParallelWriter::Defer (StringInfo a_skeleton, ValueKind a_kind, int64 a_int, float8 a_float, const char* a_str, size_t a_len)
+{
+    DeferredValue value;
+
+    value.pos_   = a_skeleton->len;
+    value.kind_  = a_kind;
+    value.int_   = a_int;
+    value.float_ = a_float;
+    value.str_   = a_str;
+    value.len_   = a_len;
+    values_.push_back(value);
+
+    deferred_bytes_ += ( E_VALUE_TEXT == a_kind ) ? a_len + 2 : 8;
+}
+
+void pg_jsonapi::ParallelWriter::AppendInt64 (StringInfo a_buffer, int64 a_value)
+{
+    if ( active_ ) {
+        Defer(a_buffer, E_VALUE_INT64, a_value, 0, NULL, 0);
+    } else {
+        JsonWriter::AppendInt64(a_buffer, a_value);
+    }
+}
+
+void pg_jsonapi::ParallelWriter::AppendFloat4 (StringInfo a_buffer, float4 a_value)
+{
+    if ( active_ ) {
+        Defer(a_buffer, E_VALUE_FLOAT4, 0, a_value, NULL, 0);
+    } else {
+        JsonWriter::AppendFloat4(a_buffer, a_value);
+    }
+}
+
+void pg_jsonapi::ParallelWriter::AppendFloat8 (StringInfo a_buffer, float8 a_value)
+{
+    if ( active_ ) {
+        Defer(a_buffer, E_VALUE_FLOAT8, 0, a_value, NULL, 0);
+    } else {
+        JsonWriter::AppendFloat8(a_buffer, a_value);
+    }
+}
+
+/**
+ * @brief Append text or varchar value, detoasted here on the main thread and escaped later by a worker.
+ */
+void pg_jsonapi::ParallelWriter::AppendText (StringInfo a_buffer, Datum a_value)
+{
+    if ( active_ ) {
+        /* detoasted copy, if any, must live until End() */
+        struct varlena* txt = PG_DETOAST_DATUM_PACKED(a_value);
+        Defer(a_buffer, E_VALUE_TEXT, 0, 0, VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt));
+    } else {
+        JsonWriter::AppendText(a_buffer, a_value);
+    }
+}
+
+/**
+ * @brief Write skeleton bytes [a_from, a_to) with values [a_first, a_last) in their places.
+ *
+ * Runs on worker threads: only std::string and raw JsonWriter kernels may be used here.
+ */
+void pg_jsonapi::ParallelWriter::RenderRange (const char* a_skeleton, size_t a_from, size_t a_to, size_t a_first, size_t a_last, std::string& o_out) const
+{
+    char   number[JsonWriter::k_max_number_len_];
+    char   escaped[6];
+    size_t cursor = a_from;
+    size_t estimate = a_to - a_from;
+
+    for ( size_t i = a_first; i < a_last; i++ ) {
+        estimate += ( E_VALUE_TEXT == values_[i].kind_ ) ? values_[i].len_ + 2 : 8;
+    }
+    o_out.reserve(estimate + estimate / 16);
+
+    for ( size_t i = a_first; i < a_last; i++ ) {
+        const DeferredValue& value = values_[i];
+
+        o_out.append(a_skeleton + cursor, value.pos_ - cursor);
+        cursor = value.pos_;
+
+        switch ( value.kind_ ) {
+            case E_VALUE_INT64:
+                o_out.append(number, JsonWriter::WriteInt64(number, value.int_));
+                break;
+
+            case E_VALUE_FLOAT4:
+                o_out.append(number, JsonWriter::WriteFloat4(number, (float4) value.float_));
+                break;
+
+            case E_VALUE_FLOAT8:
+                o_out.append(number, JsonWriter::WriteFloat8(number, value.float_));
+                break;
+
+            case E_VALUE_TEXT:
+            {
+                const char* str = value.str_;
+                int         len = (int) value.len_;
+
+                o_out.push_back('"');
+                while ( len > 0 ) {
+                    int run = JsonWriter::FindEscape(str, len);
+                    o_out.append(str, run);
+                    if ( run == len ) {
+                        break;
+                    }
+                    o_out.append(escaped, JsonWriter::WriteEscapedChar(escaped, str[run]));
+                    str += run + 1;
+                    len -= run + 1;
+                }
+                o_out.push_back('"');
+                break;
+            }
+        }
+    }
+    o_out.append(a_skeleton + cursor, a_to - cursor);
+}
+
+/**
+ * @brief Format deferred values into the skeleton using up to a_threads threads, appending the result to response.
+ *
+ * The skeleton is split in ranges with the same number of values, first range is done by the main thread
+ * while the others are posted to the backend's WorkerPool, and any range not done by a worker (task not
+ * posted or failed) is redone by the main thread.
+ */
+void pg_jsonapi::ParallelWriter::End (const StringInfoData& a_skeleton, StringInfoData& a_response, uint a_threads)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    size_t nvalues  = values_.size();
+    size_t nthreads = Max((size_t) 1, Min((size_t) a_threads, nvalues / k_min_values_per_thread));
+    bool   rv       = true;
+
+    active_ = false;
+    {
+        std::vector<size_t>      first(nthreads + 1);
+        std::vector<size_t>      from(nthreads);
+        std::vector<size_t>      to(nthreads);
+        std::vector<std::string> outputs(nthreads);
+        std::vector<char>        done(nthreads, 0);
+
+        for ( size_t i = 0; i <= nthreads; i++ ) {
+            first[i] = nvalues * i / nthreads;
+        }
+        for ( size_t i = 0; i < nthreads; i++ ) {
+            from[i] = ( 0 == i ) ? 0 : values_[first[i]].pos_;
+            to[i]   = ( nthreads - 1 == i ) ? (size_t) a_skeleton.len : values_[first[i + 1]].pos_;
+        }
+
+        WorkerPool* pool   = ( nthreads > 1 ) ? WorkerPool::GetInstance() : NULL;
+        bool        posted = false;
+
+        /* ranges are queued, so a pool smaller than requested still runs all of them */
+        if ( NULL != pool && pool->Grow(nthreads - 1) > 0 ) {
+            for ( size_t i = 1; i < nthreads; i++ ) {
+                if ( false == pool->Post([this, &a_skeleton, &first, &from, &to, &outputs, &done, i] () {
+                    try {
+                        RenderRange(a_skeleton.data, from[i], to[i], first[i], first[i + 1], outputs[i]);
+                        done[i] = 1;
+                    } catch (...) {
+                        outputs[i].clear();
+                    }
+                }) ) {
+                    break;
+                }
+                posted = true;
+            }
+        }
+
+        try {
+            RenderRange(a_skeleton.data, from[0], to[0], first[0], first[1], outputs[0]);
+            done[0] = 1;
+        } catch (...) {
+            outputs[0].clear();
+        }
+
+        /* no ereport before this point: posted tasks reference the vectors above */
+        if ( posted ) {
+            pool->Wait();
+        }
+
+        for ( size_t i = 0; i < nthreads; i++ ) {
+            if ( ! done[i] ) {
+                try {
+                    outputs[i].clear();
+                    RenderRange(a_skeleton.data, from[i], to[i], first[i], first[i + 1], outputs[i]);
+                    done[i] = 1;
+                } catch (...) {
+                    rv = false;
+                }
+            }
+        }
+
+        if ( rv ) {
+            size_t total = 0;
+            for ( size_t i = 0; i < nthreads; i++ ) {
+                total += outputs[i].size();
+            }
+            enlargeStringInfo(&a_response, (int) total);
+            for ( size_t i = 0; i < nthreads; i++ ) {
+                appendBinaryStringInfo(&a_response, outputs[i].data(), (int) outputs[i].size());
+            }
+        }
+        ereport(DEBUG2, (errmsg_internal("jsonapi: %s %zu values serialized by %zu threads", __FUNCTION__, nvalues, nthreads)));
+    }
+    values_.clear();
+    deferred_bytes_ = 0;
+
+    if ( ! rv ) {
+        ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("jsonapi: out of memory while serializing response")));
+    }
+}
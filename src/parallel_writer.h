@@ -0,0 +1,138 @@
+/**
+ * @file parallel_writer.h Declaration of ParallelWriter
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CLD_PG_JSONAPI_PARALLEL_WRITER_H
+#define CLD_PG_JSONAPI_PARALLEL_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json_writer.h"
+
+namespace pg_jsonapi
+{
+
+    /**
+     * @brief Threads kept by the backend to run ParallelWriter ranges.
+     *
+     * Created on first use and grown up to the largest number of threads requested, so a response
+     * only pays for posting its ranges instead of creating and joining threads.
+     * Threads are started with all signals blocked and live until the backend exits.
+     */
+    class WorkerPool
+    {
+    private: // Attributes
+        std::mutex                        mutex_;
+        std::condition_variable           work_cv_;
+        std::condition_variable           done_cv_;
+        std::deque<std::function<void()>> tasks_;
+        std::vector<std::thread>          threads_;
+        size_t                            pending_;   // tasks posted and not yet finished
+
+    private: // Methods
+        WorkerPool ();
+        void Run   ();
+
+    public: // Methods
+        static WorkerPool* GetInstance ();
+
+        size_t Grow   (size_t a_count);
+        bool   Post   (const std::function<void()>& a_task);
+        void   Wait   ();
+    };
+
+    /**
+     * @brief Serialization of large pages using worker threads.
+     *
+     * While active, the main thread serializes the document skeleton as usual but numbers and strings
+     * are not formatted: they are kept as plain values, with their position in the skeleton.
+     * Threads of the WorkerPool then format ranges of the skeleton into private buffers, using only the raw
+     * JsonWriter kernels (no palloc, no ereport nor any other PostgreSQL API), and the main thread
+     * concatenates those buffers in order into the response.
+     */
+    class ParallelWriter
+    {
+    private:
+
+        typedef enum {
+            E_VALUE_INT64,
+            E_VALUE_FLOAT4,
+            E_VALUE_FLOAT8,
+            E_VALUE_TEXT
+        } ValueKind;
+
+        typedef struct {
+            size_t      pos_;     // position of value in skeleton
+            ValueKind   kind_;
+            int64       int_;
+            float8      float_;
+            const char* str_;     // detoasted text, kept alive until End()
+            size_t      len_;
+        } DeferredValue;
+
+        typedef std::vector<DeferredValue> DeferredValueVector;
+
+    private: // Attributes
+        bool                active_;
+        DeferredValueVector values_;
+        size_t              deferred_bytes_;   // approximate size of values not written to skeleton
+
+    private: // Methods
+        void Defer       (StringInfo a_skeleton, ValueKind a_kind, int64 a_int, float8 a_float, const char* a_str, size_t a_len);
+        void RenderRange (const char* a_skeleton, size_t a_from, size_t a_to, size_t a_first, size_t a_last, std::string& o_out) const;
+
+    public: // Methods
+        ParallelWriter ();
+        virtual ~ParallelWriter ();
+
+        void   Begin          ();
+        void   End            (const StringInfoData& a_skeleton, StringInfoData& a_response, uint a_threads);
+        void   Clear          ();
+
+        void   AppendInt64    (StringInfo a_buffer, int64 a_value);
+        void   AppendFloat4   (StringInfo a_buffer, float4 a_value);
+        void   AppendFloat8   (StringInfo a_buffer, float8 a_value);
+        void   AppendText     (StringInfo a_buffer, Datum a_value);
+
+        bool   IsActive       () const;
+        size_t DeferredBytes  () const;
+
+        static bool IsAllowed ();
+    };
+
+    inline bool ParallelWriter::IsActive () const
+    {
+        return active_;
+    }
+
+    inline size_t ParallelWriter::DeferredBytes () const
+    {
+        return deferred_bytes_;
+    }
+
+} // namespace pg_jsonapi
+
+#endif // CLD_PG_JSONAPI_PARALLEL_WRITER_H
@@ -29,13 +29,19 @@ extern "C" {
 #include "access/htup_details.h"
 #include "catalog/pg_type.h"
 #include "funcapi.h"
+#include "miscadmin.h"
+#include "utils/tuplestore.h"
 #pragma GCC diagnostic pop
 } // extern "C"
 #include "query_builder.h"
+#include "response_compressor.h"
 
 extern "C" {
 PG_MODULE_MAGIC;
 Datum   jsonapi(PG_FUNCTION_ARGS);
+Datum   jsonapi_stream(PG_FUNCTION_ARGS);
+Datum   jsonapi_compressed(PG_FUNCTION_ARGS);
+Datum   jsonapi_batch(PG_FUNCTION_ARGS);
 Datum   inside_jsonapi(PG_FUNCTION_ARGS);
 Datum   get_jsonapi_user(PG_FUNCTION_ARGS);
 Datum   get_jsonapi_company(PG_FUNCTION_ARGS);
@@ -43,7 +49,12 @@ Datum   get_jsonapi_company_schema(PG_FUNCTION_ARGS);
 Datum   get_jsonapi_sharded_schema(PG_FUNCTION_ARGS);
 Datum   get_jsonapi_accounting_schema(PG_FUNCTION_ARGS);
 Datum   get_jsonapi_accounting_prefix(PG_FUNCTION_ARGS);
+Datum   get_jsonapi_fragment_cache_stats(PG_FUNCTION_ARGS);
+Datum   get_jsonapi_page_cursor(PG_FUNCTION_ARGS);
 PG_FUNCTION_INFO_V1(jsonapi);
+PG_FUNCTION_INFO_V1(jsonapi_stream);
+PG_FUNCTION_INFO_V1(jsonapi_compressed);
+PG_FUNCTION_INFO_V1(jsonapi_batch);
 PG_FUNCTION_INFO_V1(inside_jsonapi);
 PG_FUNCTION_INFO_V1(get_jsonapi_user);
 PG_FUNCTION_INFO_V1(get_jsonapi_company);
@@ -51,6 +62,8 @@ PG_FUNCTION_INFO_V1(get_jsonapi_company_schema);
 PG_FUNCTION_INFO_V1(get_jsonapi_sharded_schema);
 PG_FUNCTION_INFO_V1(get_jsonapi_accounting_schema);
 PG_FUNCTION_INFO_V1(get_jsonapi_accounting_prefix);
+PG_FUNCTION_INFO_V1(get_jsonapi_fragment_cache_stats);
+PG_FUNCTION_INFO_V1(get_jsonapi_page_cursor);
 PG_FUNCTION_INFO_V1(jsonapi_version);
 PG_FUNCTION_INFO_V1(jsonapi_v2);
 } // extern "C"
@@ -92,6 +105,26 @@ void jsonapi_resetqb()
     }
 }
 
+/**
+ * @brief Enlarge response buffer once, for the expected response size.
+ *
+ * Reservation is capped, a wrong estimate doesn't hold more memory than that, larger responses
+ * keep growing the buffer as needed.
+ */
+static
+void jsonapi_reserve(StringInfoData& a_response)
+{
+    static const size_t k_max_reserve = 64 * 1024 * 1024;
+
+    size_t estimate = g_qb->EstimateResponseSize();
+
+    if ( estimate > (size_t) (a_response.maxlen - a_response.len) ) {
+        estimate = Min(Min(estimate, k_max_reserve), (size_t) (MaxAllocSize - 1 - a_response.len));
+        ereport(DEBUG3, (errmsg_internal("jsonapi: %s enlarging response buffer to %zu bytes", __FUNCTION__, estimate)));
+        enlargeStringInfo(&a_response, (int) estimate);
+    }
+}
+
 static void
 jsonapi_common(text* a_method,
                text* a_url,
@@ -204,6 +237,9 @@ jsonapi(PG_FUNCTION_ARGS)
         jsonapi_common(method, url, body, user_id, company_id, company_schema, sharded_schema, accounting_schema, accounting_prefix);
     }
 
+    /* enlarge response buffer only once, using the size learned from previous requests */
+    jsonapi_reserve(response);
+
     /* serialize the results */
     g_qb->SerializeResponse(response);
 
@@ -220,6 +256,307 @@ jsonapi(PG_FUNCTION_ARGS)
     PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
 }
 
+/**
+ * @brief JSONAPI interface to PostreSQL, returning the response in chunks.
+ *
+ * Same arguments as jsonapi(), the response is written while it's serialized as a set of rows,
+ * each with the http status and a chunk of about stream-chunk-size bytes, in order.
+ * Rows are kept in a tuplestore, spilled to disk above work_mem, so the response isn't limited
+ * to the maximum size of a single value.
+ *
+ * Its scope is bounded memory, not latency: the set is returned in materialize mode, the caller only
+ * receives the first row after the whole response is serialized. Rows can't be returned value per call,
+ * the fetched rows and cursors being serialized belong to the SPI connection of the request, which
+ * can't be kept open between calls of a set returning function.
+ * Each row carries the http status known when its chunk was written, the status of the last row is final.
+ *
+ * @return Set of (http_status, chunk) rows, concatenated chunks are the top-level JSON document.
+ */
+Datum
+jsonapi_stream(PG_FUNCTION_ARGS)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s PG_NARGS:%d", __FUNCTION__, PG_NARGS())));
+
+    ReturnSetInfo*   rsinfo = (ReturnSetInfo*) fcinfo->resultinfo;
+    StringInfoData   response;
+    TupleDesc        tupdesc;
+    Tuplestorestate* tupstore;
+    MemoryContext    old_context;
+
+    if ( NULL == rsinfo || ! IsA(rsinfo, ReturnSetInfo) || 0 == ( rsinfo->allowedModes & SFRM_Materialize ) ) {
+        ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("jsonapi: jsonapi_stream must be called in a context that accepts a set")));
+    }
+
+    /* rows and their descriptor must outlive this call */
+    old_context = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+#if PG_MAJORVERSION_NUM >= 15
+    tupdesc = CreateTemplateTupleDesc(2);
+#else
+    tupdesc = CreateTemplateTupleDesc(2,false);
+#endif
+    TupleDescInitEntry(tupdesc, (AttrNumber) 1, "http_status", INT4OID, -1, 0);
+    TupleDescInitEntry(tupdesc, (AttrNumber) 2, "chunk"      , TEXTOID, -1, 0);
+    tupdesc  = BlessTupleDesc(tupdesc);
+    tupstore = tuplestore_begin_heap(0 != ( rsinfo->allowedModes & SFRM_Materialize_Random ), false, work_mem);
+    MemoryContextSwitchTo(old_context);
+
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult  = tupstore;
+    rsinfo->setDesc    = tupdesc;
+
+    pg_jsonapi::ResponseStream stream(tupstore, tupdesc);
+
+    initStringInfo(&response);
+    jsonapi_resetqb();
+    g_qb->SetResponseStream(&stream);
+
+    if ( PG_NARGS() != 9 || PG_ARGISNULL(0) || PG_ARGISNULL(1) ) {
+        g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA010"), pg_jsonapi::E_HTTP_BAD_REQUEST).SetMessage(NULL, "Expected arguments are: ( method, url, body , user_id, company_id, company_schema, sharded_schema, accounting_schema, accounting_prefix )");
+    }
+
+    if ( ! g_qb->HasErrors() ) {
+        // non-optional parameters
+        text*   method          = PG_GETARG_TEXT_PP(0);
+        text*   url             = PG_GETARG_TEXT_PP(1);
+
+        // optional parameters
+        text*   body                = (PG_NARGS() <= 2 || PG_ARGISNULL(2)) ? NULL : PG_GETARG_TEXT_PP(2);
+        text*   user_id             = (PG_NARGS() <= 3 || PG_ARGISNULL(3)) ? NULL : PG_GETARG_TEXT_PP(3);
+        text*   company_id          = (PG_NARGS() <= 4 || PG_ARGISNULL(4)) ? NULL : PG_GETARG_TEXT_PP(4);
+        text*   company_schema      = (PG_NARGS() <= 5 || PG_ARGISNULL(5)) ? NULL : PG_GETARG_TEXT_PP(5);
+        text*   sharded_schema      = (PG_NARGS() <= 6 || PG_ARGISNULL(6)) ? NULL : PG_GETARG_TEXT_PP(6);
+        text*   accounting_schema   = (PG_NARGS() <= 7 || PG_ARGISNULL(7)) ? NULL : PG_GETARG_TEXT_PP(7);
+        text*   accounting_prefix   = (PG_NARGS() <= 8 || PG_ARGISNULL(8)) ? NULL : PG_GETARG_TEXT_PP(8);
+
+        jsonapi_common(method, url, body, user_id, company_id, company_schema, sharded_schema, accounting_schema, accounting_prefix);
+    }
+
+    /* serialize the results, full chunks are written as they are produced and the remainder here */
+    g_qb->SerializeResponse(response);
+    stream.Flush(response, g_qb->GetHttpStatus());
+
+    ereport(g_qb->HasErrors() ? LOG : DEBUG1, (errmsg_internal("jsonapi: http_status:%d response streamed in %zu chunks with %zu bytes",
+                                                               g_qb->GetHttpStatus(), stream.Chunks(), stream.Bytes())));
+
+    /* disconnect from SPI manager only after serialization because of memory context and HTTP status */
+    g_qb->SPIDisconnect();
+    g_qb->Clear();
+    pfree(response.data);
+
+    return (Datum) 0;
+}
+
+/**
+ * @brief JSONAPI interface to PostreSQL, returning a compressed response.
+ *
+ * Same arguments as jsonapi(), plus the accepted encodings in the format of an HTTP Accept-Encoding header.
+ * The response is compressed while it's serialized, using the accepted encoding with the highest quality value
+ * that PostgreSQL was built with (zstd, lz4 or gzip), or not compressed if none is, see ResponseCompressor::Negotiate().
+ *
+ * @param encoding          Accepted encodings, NULL is the same as '*' (best available).
+ *
+ * @return http_status, the content_encoding used and the response as bytea.
+ */
+Datum
+jsonapi_compressed(PG_FUNCTION_ARGS)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s PG_NARGS:%d", __FUNCTION__, PG_NARGS())));
+
+    StringInfoData response;
+    TupleDesc      tupdesc;
+    Datum          values[3];
+    bool           nulls[3];
+    text*          encoding = (PG_NARGS() <= 9 || PG_ARGISNULL(9)) ? NULL : PG_GETARG_TEXT_PP(9);
+
+    /* Initialise attributes information in the tuple descriptor */
+#if PG_MAJORVERSION_NUM >= 15
+    tupdesc = CreateTemplateTupleDesc(3);
+#else
+    tupdesc = CreateTemplateTupleDesc(3,false);
+#endif
+    TupleDescInitEntry(tupdesc, (AttrNumber) 1, "http_status"     , INT4OID , -1, 0);
+    TupleDescInitEntry(tupdesc, (AttrNumber) 2, "content_encoding", TEXTOID , -1, 0);
+    TupleDescInitEntry(tupdesc, (AttrNumber) 3, "response"        , BYTEAOID, -1, 0);
+    nulls[0] = nulls[1] = nulls[2] = false;
+    BlessTupleDesc(tupdesc);
+
+    pg_jsonapi::ResponseCompressor compressor(( NULL != encoding ) ? pg_jsonapi::ResponseCompressor::Negotiate(VARDATA_ANY(encoding), VARSIZE_ANY_EXHDR(encoding))
+                                                                   : pg_jsonapi::ResponseCompressor::Negotiate("*", 1));
+
+    initStringInfo(&response);
+    jsonapi_resetqb();
+    g_qb->SetResponseStream(&compressor);
+
+    if ( PG_NARGS() != 10 || PG_ARGISNULL(0) || PG_ARGISNULL(1) ) {
+        g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA010"), pg_jsonapi::E_HTTP_BAD_REQUEST).SetMessage(NULL, "Expected arguments are: ( method, url, body , user_id, company_id, company_schema, sharded_schema, accounting_schema, accounting_prefix, encoding )");
+    }
+
+    if ( ! g_qb->HasErrors() ) {
+        // non-optional parameters
+        text*   method          = PG_GETARG_TEXT_PP(0);
+        text*   url             = PG_GETARG_TEXT_PP(1);
+
+        // optional parameters
+        text*   body                = (PG_NARGS() <= 2 || PG_ARGISNULL(2)) ? NULL : PG_GETARG_TEXT_PP(2);
+        text*   user_id             = (PG_NARGS() <= 3 || PG_ARGISNULL(3)) ? NULL : PG_GETARG_TEXT_PP(3);
+        text*   company_id          = (PG_NARGS() <= 4 || PG_ARGISNULL(4)) ? NULL : PG_GETARG_TEXT_PP(4);
+        text*   company_schema      = (PG_NARGS() <= 5 || PG_ARGISNULL(5)) ? NULL : PG_GETARG_TEXT_PP(5);
+        text*   sharded_schema      = (PG_NARGS() <= 6 || PG_ARGISNULL(6)) ? NULL : PG_GETARG_TEXT_PP(6);
+        text*   accounting_schema   = (PG_NARGS() <= 7 || PG_ARGISNULL(7)) ? NULL : PG_GETARG_TEXT_PP(7);
+        text*   accounting_prefix   = (PG_NARGS() <= 8 || PG_ARGISNULL(8)) ? NULL : PG_GETARG_TEXT_PP(8);
+
+        jsonapi_common(method, url, body, user_id, company_id, company_schema, sharded_schema, accounting_schema, accounting_prefix);
+    }
+
+    /* serialize the results, chunks are compressed as they are produced */
+    g_qb->SerializeResponse(response);
+    compressor.Flush(response, g_qb->GetHttpStatus());
+
+    values[0] = Int32GetDatum(g_qb->GetHttpStatus());
+    values[2] = PointerGetDatum(compressor.Finish());
+
+    ereport(g_qb->HasErrors() ? LOG : DEBUG1, (errmsg_internal("jsonapi: http_status:%d response with %zu bytes compressed using %s",
+                                                               g_qb->GetHttpStatus(), compressor.Bytes(), pg_jsonapi::ResponseCompressor::EncodingName(compressor.GetEncoding()))));
+
+    /* disconnect from SPI manager only after serialization because of memory context and HTTP status */
+    g_qb->SPIDisconnect();
+    g_qb->Clear();
+
+    /* allocated after SPI_finish, memory allocated while connected is released by it */
+    values[1] = PointerGetDatum(cstring_to_text(pg_jsonapi::ResponseCompressor::EncodingName(compressor.GetEncoding())));
+    pfree(response.data);
+
+    PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/**
+ * @brief JSONAPI interface to PostreSQL, executing several requests of the same user and company in one call.
+ *
+ * Requests are executed in order on the same SPI connection, with the same arguments, except method,
+ * url and body that are given for each one. Sub-transaction and search_path are only set again after a
+ * request that failed or that may have written. Requests always run in the sub-transaction, even when
+ * read-only-subtransaction is false, so a failing request gets its error document and the batch goes on.
+ *
+ * @param requests          Array of objects with members method, url and body (object or string), optional.
+ * @param user_id           The user identification.
+ * @param company_id        The company identification.
+ * @param company_schema    The schema to be used, if flag request-company-schema is true.
+ * @param sharded_schema    The schema to be used, if flag request-sharded-schema is true.
+ * @param accounting_schema The schema to be used, if flag request-accounting-schema is true (default).
+ * @param accounting_prefix The prefix to be added to define the resource relation.
+ *
+ * @return Set of (index, http_status, response) rows, one for each request by its index in the array.
+ */
+Datum
+jsonapi_batch(PG_FUNCTION_ARGS)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s PG_NARGS:%d", __FUNCTION__, PG_NARGS())));
+
+    ReturnSetInfo*      rsinfo = (ReturnSetInfo*) fcinfo->resultinfo;
+    TupleDesc           tupdesc;
+    Tuplestorestate*    tupstore;
+    MemoryContext       old_context;
+    StringInfoData      response;
+    Datum               values[3];
+    bool                nulls[3];
+    JsonapiJson::Value  requests;
+    JsonapiJson::Reader reader(JsonapiJson::Features::strictMode());
+
+    if ( NULL == rsinfo || ! IsA(rsinfo, ReturnSetInfo) || 0 == ( rsinfo->allowedModes & SFRM_Materialize ) ) {
+        ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("jsonapi: jsonapi_batch must be called in a context that accepts a set")));
+    }
+    if ( PG_NARGS() != 7 || PG_ARGISNULL(0) ) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("jsonapi: expected arguments are: ( requests, user_id, company_id, company_schema, sharded_schema, accounting_schema, accounting_prefix )")));
+    }
+    const char* requests_s = DatumGetCString(DirectFunctionCall1(jsonb_out, PG_GETARG_DATUM(0)));
+    if ( ! reader.parse(requests_s, requests_s + strlen(requests_s), requests, false) || ! requests.isArray() ) {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("jsonapi: requests must be an array of objects with method, url and body")));
+    }
+
+    /* rows and their descriptor must outlive this call */
+    old_context = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+#if PG_MAJORVERSION_NUM >= 15
+    tupdesc = CreateTemplateTupleDesc(3);
+#else
+    tupdesc = CreateTemplateTupleDesc(3,false);
+#endif
+    TupleDescInitEntry(tupdesc, (AttrNumber) 1, "index"      , INT4OID, -1, 0);
+    TupleDescInitEntry(tupdesc, (AttrNumber) 2, "http_status", INT4OID, -1, 0);
+    TupleDescInitEntry(tupdesc, (AttrNumber) 3, "response"   , TEXTOID, -1, 0);
+    tupdesc  = BlessTupleDesc(tupdesc);
+    tupstore = tuplestore_begin_heap(0 != ( rsinfo->allowedModes & SFRM_Materialize_Random ), false, work_mem);
+    /* response buffer is reused by all requests, SPI context is deleted when one of them fails */
+    initStringInfo(&response);
+    MemoryContextSwitchTo(old_context);
+
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult  = tupstore;
+    rsinfo->setDesc    = tupdesc;
+    nulls[0] = nulls[1] = nulls[2] = false;
+
+    // optional parameters, common to all requests
+    text*   user_id             = PG_ARGISNULL(1) ? NULL : PG_GETARG_TEXT_PP(1);
+    text*   company_id          = PG_ARGISNULL(2) ? NULL : PG_GETARG_TEXT_PP(2);
+    text*   company_schema      = PG_ARGISNULL(3) ? NULL : PG_GETARG_TEXT_PP(3);
+    text*   sharded_schema      = PG_ARGISNULL(4) ? NULL : PG_GETARG_TEXT_PP(4);
+    text*   accounting_schema   = PG_ARGISNULL(5) ? NULL : PG_GETARG_TEXT_PP(5);
+    text*   accounting_prefix   = PG_ARGISNULL(6) ? NULL : PG_GETARG_TEXT_PP(6);
+
+    jsonapi_resetqb();
+    g_qb->BeginBatch();
+
+    for ( JsonapiJson::ArrayIndex i = 0; i < requests.size(); i++ ) {
+        const JsonapiJson::Value& request = requests[i];
+
+        if ( i > 0 ) {
+            g_qb->NextBatchRequest();
+        }
+        resetStringInfo(&response);
+        appendStringInfo(&response, "%*.*s", VARHDRSZ, VARHDRSZ, "~~~~~~~~~~");
+
+        if (   ! request.isObject()
+            || ! request.isMember("method") || ! request["method"].isString()
+            || ! request.isMember("url")    || ! request["url"].isString() ) {
+            g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA010"), pg_jsonapi::E_HTTP_BAD_REQUEST).SetMessage(NULL, "Expected request members are: method, url and optionally body");
+        } else {
+            std::string body_s;
+
+            if ( request.isMember("body") && request["body"].isString() ) {
+                body_s = request["body"].asString();
+            } else if ( request.isMember("body") && ! request["body"].isNull() ) {
+                JsonapiJson::FastWriter writer;
+                body_s = writer.write(request["body"]);
+            }
+
+            text* method = cstring_to_text(request["method"].asCString());
+            text* url    = cstring_to_text(request["url"].asCString());
+            text* body   = request.isMember("body") && ! request["body"].isNull() ? cstring_to_text_with_len(body_s.c_str(), body_s.length()) : NULL;
+
+            jsonapi_common(method, url, body, user_id, company_id, company_schema, sharded_schema, accounting_schema, accounting_prefix);
+        }
+
+        /* enlarge response buffer only once, using the size learned from previous requests */
+        jsonapi_reserve(response);
+
+        /* serialize the results */
+        g_qb->SerializeResponse(response);
+
+        ereport(g_qb->HasErrors() ? LOG : DEBUG1, (errmsg_internal("jsonapi: batch index:%u http_status:%d response: %.*s", i, g_qb->GetHttpStatus(), response.len-VARHDRSZ,  response.data+VARHDRSZ)));
+        SET_VARSIZE(response.data, response.len);
+        values[0] = Int32GetDatum((int32) i);
+        values[1] = Int32GetDatum(g_qb->GetHttpStatus());
+        values[2] = PointerGetDatum(response.data);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(response.data);
+
+    /* disconnect from SPI manager only after the last request */
+    g_qb->EndBatch();
+    g_qb->Clear();
+
+    return (Datum) 0;
+}
+
 /**
  * @brief JSONAPI interface to PostreSQL
  *
@@ -271,6 +608,43 @@ get_jsonapi_accounting_prefix(PG_FUNCTION_ARGS)
     }
 }
 
+/**
+ * @brief JSONAPI interface to PostreSQL
+ *
+ * @return json object with fragment cache statistics of this backend.
+ */
+Datum
+get_jsonapi_fragment_cache_stats(PG_FUNCTION_ARGS)
+{
+    jsonapi_initqb();
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    const pg_jsonapi::FragmentCache& cache = g_qb->GetFragmentCache();
+    StringInfoData                   stats;
+
+    initStringInfo(&stats);
+    appendStringInfo(&stats, "{\"hits\":" UINT64_FORMAT ",\"misses\":" UINT64_FORMAT ",\"hit-ratio\":%.3f,\"entries\":%zu,\"bytes\":%zu}",
+                     cache.Hits(), cache.Misses(), cache.HitRatio(), cache.Entries(), cache.Bytes());
+    PG_RETURN_TEXT_P(cstring_to_text_with_len(stats.data, stats.len));
+}
+
+/**
+ * @brief JSONAPI interface to PostreSQL
+ *
+ * @return page[cursor] token to continue the last request of this backend, null if it was not paged by a cursor or all rows were fetched.
+ */
+Datum
+get_jsonapi_page_cursor(PG_FUNCTION_ARGS)
+{
+    jsonapi_initqb();
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s %s", __FUNCTION__, g_qb->GetLastPageCursor().c_str())));
+    if ( g_qb->GetLastPageCursor().length() ) {
+        PG_RETURN_TEXT_P(cstring_to_text(g_qb->GetLastPageCursor().c_str()));
+    } else {
+        PG_RETURN_NULL();
+    }
+}
+
 /**
  * @brief JSONAPI interface to PostreSQL
  *
@@ -438,6 +812,9 @@ jsonapi_v2(PG_FUNCTION_ARGS)
         jsonapi_common(method, url, body, user_id, company_id, company_schema, sharded_schema, accounting_schema, accounting_prefix);
     }
 
+    /* enlarge response buffer only once, using the size learned from previous requests */
+    jsonapi_reserve(response);
+
     /* serialize the results */
     g_qb->SerializeResponse(response);
 
@@ -23,11 +23,19 @@
 #define CLD_PG_JSONAPI_QUERY_BUILDER_H
 
 #include <stdlib.h>
+#include <time.h>
 #include <string>
+#include <list>
+#include <unordered_map>
 #include <regex>
 #include "document_config.h"
 #include "operation_request.h"
 #include "resource_data.h"
+#include "json_writer.h"
+#include "parallel_writer.h"
+#include "fragment_cache.h"
+#include "response_stream.h"
+#include "validator_prefilter.h"
 #include "utils_adt_json.h"
 
 namespace pg_jsonapi
@@ -38,6 +46,12 @@ namespace pg_jsonapi
         E_EXT_JSON_PATCH
     } Extension;
 
+    typedef enum {
+        E_FORMAT_JSONAPI,
+        E_FORMAT_NDJSON,
+        E_FORMAT_CSV
+    } ResponseFormat;
+
     // related with HttpStatusErrorCode
     typedef enum {
         E_HTTP_OK                     = 200,
@@ -64,6 +78,37 @@ namespace pg_jsonapi
      */
     class QueryBuilder
     {
+    private: // Data Types
+
+        typedef struct {
+            std::string signature_;  // top query and request arguments the cursor was declared for
+            time_t      last_used_;
+        } PageCursor;
+        typedef std::map<std::string, PageCursor> PageCursorMap;
+
+        typedef struct {
+            std::string      base_url_;
+            std::string      resource_type_;
+            std::string      resource_id_;
+            std::string      related_;
+            bool             relationship_;
+            StringSet        include_param_;
+            StringPairVector sort_param_;
+            StringSetMap     fields_param_;
+            StringMap        filter_field_param_;
+            std::string      filter_param_;
+            ssize_t          page_size_param_;
+            ssize_t          page_number_param_;
+            std::string      page_cursor_param_;
+            short            links_param_;
+            short            totals_param_;
+            short            null_param_;
+            ResponseFormat   format_param_;
+        } ParsedUrl;
+        typedef std::pair<std::string, ParsedUrl>                          ParsedUrlEntry; // url, request arguments
+        typedef std::list<ParsedUrlEntry>                                  ParsedUrlList;
+        typedef std::unordered_map<std::string, ParsedUrlList::iterator> ParsedUrlIndex;
+
     private: // ErrorCode will be created only once
         ErrorCode       errcodes_;
 
@@ -74,15 +119,29 @@ namespace pg_jsonapi
 
     private: // DB Configuration - initialized once by process
         std::map<DBConfigValidator,std::vector<std::regex>> validators_regex_;
+        std::map<DBConfigValidator,ValidatorPrefilter>      validators_prefilter_; // literals of the rules, to skip rules that can't match
         std::map<DBConfigValidator,std::string> validators_setting_;
 
+    private: // Statistics - kept by process, refined after each request
+        std::map<std::string, size_t> row_size_estimate_; // serialized bytes per row by base_url, type, fieldset and relationship mode
+        FragmentCache                 fragment_cache_;    // serialized type, id and attributes by row version
+        PageCursorMap                 page_cursors_;      // WITH HOLD cursors open by page[cursor], by token
+        std::string                   last_page_cursor_;  // token to continue the last request, empty when exhausted
+        ParsedUrlList                 parsed_urls_;       // request arguments of valid urls, most recently used first
+        ParsedUrlIndex                parsed_urls_index_;
+        size_t                        parsed_urls_capacity_;
+
+    private: // Batch - kept while the requests of a batch are executed in the same SPI connection
+        bool                batch_;
+        std::string         batch_search_path_;     // search_path set by the batch, if any
+        std::string         batch_old_search_path_; // search_path before it was set by the batch
+
     private: // Attributes - request variables filled while parsing request
 
         std::string         rq_method_;
         Extension           rq_extension_;
         std::string         rq_url_encoded_;
         std::string         rq_base_url_;
-        JsonapiJson::Value  rq_body_root_;
         std::string         rq_sharded_schema_;
         std::string         rq_company_schema_;
         std::string         rq_accounting_schema_;
@@ -100,9 +159,11 @@ namespace pg_jsonapi
         std::string         rq_filter_param_;
         ssize_t             rq_page_size_param_;
         ssize_t             rq_page_number_param_;
+        std::string         rq_page_cursor_param_;
         short               rq_links_param_;
         short               rq_totals_param_;
         short               rq_null_param_;
+        ResponseFormat      rq_format_param_;
 
         OperationRequestVector rq_operations_;
 
@@ -110,6 +171,9 @@ namespace pg_jsonapi
 
         bool            spi_connected_;
         bool            spi_read_only_;
+        bool            spi_sub_transaction_;      // internal sub-transaction is open
+        bool            spi_skip_sub_transaction_; // request can't write, it's executed without sub-transaction
+        bool            spi_release_sub_transaction_; // page[cursor] was used, its portal must outlive the sub-transaction
         std::string     q_buffer_;
         size_t          q_required_count_;
         ResourceDataMap q_data_;
@@ -121,14 +185,23 @@ namespace pg_jsonapi
         uint            q_page_number_;
         ErrorVector     q_errors_;
         HttpStatusCode  q_http_status_;
-        const char*     q_json_function_data_;
-        const char*     q_json_function_included_;
+        JsonValue       q_json_function_data_;
+        JsonValue       q_json_function_included_;
         bool            q_needs_search_path_;
         std::string     q_old_search_path_;
+        bool            q_iso_dates_;          // DateStyle is ISO, dates are written by JsonWriter
+        pg_tz*          q_session_timezone_;   // time zone used to write timestamptz
+        ParallelWriter  q_parallel_;           // values formatted by threads, on large responses
+        std::string     q_fragment_key_prefix_; // base url and output settings, common to all fragment keys
+        Portal          q_cursor_;             // open while rows of a query are fetched in batches
+        ResponseStream* q_stream_;             // chunks are flushed to it while serializing, when set
 
     private: // Methods
 
         bool               ParseUrl                    ();
+        bool               RestoreParsedUrl            ();
+        void               KeepParsedUrl               ();
+        void               EvictParsedUrls             (size_t a_capacity);
         bool               ParseRequestBody            (const char* a_body, size_t a_body_len);
 
         void               AddInClause                 (const std::string& a_column, StringSet a_values);
@@ -139,21 +212,56 @@ namespace pg_jsonapi
 
         bool               ProcessCounter              (size_t& a_count);
         bool               ProcessFunctionJsonResult   (const std::string& a_type);
-        bool               ProcessQueryResult          (const std::string& a_type, size_t a_depth);
+        bool               ProcessQueryResult          (const std::string& a_type, size_t a_depth, uint32* o_fetched = NULL);
         bool               ProcessAttributes           (const std::string& a_type, size_t a_depth, StringSet* a_processed_ids);
         bool               ProcessRelationships        (const std::string& a_type, size_t a_depth);
         void               RequestResourceInclusion    (const std::string& a_type, size_t a_depth, const std::string& a_id, const std::string& a_field, const std::string& a_rel_id);
         void               CleanRelationshipInclusion  ();
+        void               ReleaseBatch                (const std::string& a_type);
+
+        void               HandleSPIError              (MemoryContext a_context);
+        void               SPIBeginSubTransaction      ();
+        bool               SPISetSearchPath            (const std::string& a_search_path);
+        std::string        GetSearchPath               () const;
+        bool               SPIExecuteQuery             (const std::string& a_command);
+        bool               SPIFetchCursor              ();
+        void               SPICloseCursor              ();
+        bool               SPIFetchPageCursor          ();
+        void               ClosePageCursor             (const std::string& a_token);
+        void               ExpirePageCursors           ();
+        std::string        GetPageCursorSignature      ();
+        bool               HasPageCursor               () const;
+        bool               FetchesInBatches            () const;
+        bool               IsExport                    () const;
 
         bool               IsRequestedField            (const std::string& a_type, const std::string& a_field) const;
 
         void               SerializeRelationshipData   (StringInfoData& a_response, const std::string& a_type, const std::string& a_field, const ResourceData& a_rd, uint32 a_row) const;
-        void               SerializeResource           (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row) const;
+        void               FlushChunk                  (StringInfoData& a_response);
+        void               AppendJsonFunctionResult    (StringInfoData& a_response, const JsonValue& a_value);
+        bool               MakeFragmentKey             (std::string& o_key, const std::string& a_type, const ResourceData& a_rd) const;
+        void               PrepareSerialization        ();
+        void               SerializeResourceHead       (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row);
+        void               SerializeAttributeValue     (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, int a_col);
+        void               SerializeExportHead         (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row);
+        void               SerializeExportTail         (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row);
+        void               SerializeExportHeader       (StringInfoData& a_response, const std::string& a_type, const ResourceData& a_rd);
+        void               SerializeExport             (StringInfoData& a_response);
+        bool               IsExportedAttribute         (const std::string& a_type, const ResourceData& a_rd, int a_col) const;
+        static void        AppendCsvValue              (StringInfoData& a_response, const char* a_value, size_t a_len);
+        void               SerializeResource           (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row);
         void               SerializeFetchData          (StringInfoData& a_response);
         void               SerializeIncluded           (StringInfoData& a_response);
+        bool               UsesParallelWriter          () const;
         void               SerializeErrors             (StringInfoData& a_response);
+        void               UpdateRowSizeEstimates      ();
+        std::string        GetRowSizeKey               (const std::string& a_type) const;
+
+        void               RestoreBatchSearchPath      ();
 
         void               GetSettingFromPGConfig      (DBConfigValidator a_validator);
+        bool               MatchesValidatorRule        (DBConfigValidator a_validator, const std::string& a_value, size_t& o_rule, std::string& o_match);
+        static bool        SearchValidatorRule         (const std::regex& a_rule, const std::string& a_value, bool a_skip_quoted, std::smatch& o_match);
         void               InitValidatorsFromPGConfig  ();
 
     public: // Methods
@@ -170,6 +278,10 @@ namespace pg_jsonapi
         bool         SPIDisconnect                ();
         bool         SPIExecuteCommand            (const std::string& a_command, const int a_expected_ret);
 
+        bool         BeginBatch                   ();
+        void         NextBatchRequest             ();
+        void         EndBatch                     ();
+
         bool         ParseRequestArguments        (const char* a_method, size_t a_method_len,
                                                    const char* a_url, size_t a_url_len,
                                                    const char* a_body, size_t a_body_len,
@@ -186,6 +298,8 @@ namespace pg_jsonapi
         bool         ExecuteOperations            ();
         void         RequestOperationResponseData (const std::string& a_type, const std::string& a_id);
         void         SerializeResponse            (StringInfoData& a_response);
+        void         SetResponseStream            (ResponseStream* a_stream);
+        size_t       EstimateResponseSize         () const;
 
         bool         AttributeIsValidUsingXssValidators (const std::string& a_attribute, const std::string& a_value);
         bool         FilterIsValidUsingSqlValidators    (DBConfigValidator a_validator, const char* a_field, const std::string& a_value);
@@ -202,6 +316,8 @@ namespace pg_jsonapi
         HttpStatusCode        GetHttpStatus ()              const;
         const DocumentConfig* GetDocumentConfig()           const;
         bool                  NeedsSearchPath()             const;
+        const FragmentCache&  GetFragmentCache()            const;
+        const std::string&    GetLastPageCursor()           const;
 
         const std::string&    GetRequestUrl()                  const;
         const std::string&    GetRequestBaseUrl()              const;
@@ -248,6 +364,29 @@ namespace pg_jsonapi
     {
         return spi_connected_;
     }
+    inline bool QueryBuilder::FetchesInBatches () const
+    {
+        return config_->FetchBatchSize() > 0;
+    }
+    inline const FragmentCache& QueryBuilder::GetFragmentCache () const
+    {
+        return fragment_cache_;
+    }
+
+    inline bool QueryBuilder::HasPageCursor () const
+    {
+        return rq_page_cursor_param_.length();
+    }
+    inline const std::string& QueryBuilder::GetLastPageCursor () const
+    {
+        return last_page_cursor_;
+    }
+
+    inline void QueryBuilder::SetResponseStream (ResponseStream* a_stream)
+    {
+        q_stream_ = a_stream;
+    }
+
     inline bool QueryBuilder::HasErrors () const
     {
         return ( q_errors_.size() );
@@ -343,6 +482,11 @@ namespace pg_jsonapi
         return ! IsIndividual();
     }
 
+    inline bool QueryBuilder::IsExport () const
+    {
+        return E_FORMAT_JSONAPI != rq_format_param_;
+    }
+
     inline bool QueryBuilder::IsRelationship () const
     {
         return rq_relationship_;
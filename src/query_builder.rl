@@ -29,10 +29,13 @@ extern "C" {
 #include "utils/json.h"
 #include "parser/parse_coerce.h"
 #include "pgstat.h"
+#include "miscadmin.h"
+#include "utils/guc.h"
 #pragma GCC diagnostic pop
 } // extern "C"
 #include "query_builder.h"
 #include "utils_adt_json.h"
+#include "json_writer.h"
 #include <tuple>
 #include <regex>
 
@@ -45,17 +48,23 @@ pg_jsonapi::QueryBuilder::QueryBuilder ()
 
     config_ = NULL;
 
+    batch_ = false;
+
     rq_method_ = "GET";
     rq_extension_ = E_EXT_NONE;
     rq_relationship_ = false;
     rq_links_param_ = -1; // undefined
     rq_totals_param_ = -1; // undefined
     rq_null_param_ = -1; // undefined
+    rq_format_param_ = E_FORMAT_JSONAPI;
     rq_page_size_param_ = -1; // undefined
     rq_page_number_param_ = -1; // undefined
 
     spi_connected_ = false;
     spi_read_only_ = true;
+    spi_sub_transaction_ = false;
+    spi_skip_sub_transaction_ = false;
+    spi_release_sub_transaction_ = false;
     q_required_count_ = 0;
     q_top_must_be_included_ = false;
     q_top_total_rows_ = 0;
@@ -63,9 +72,13 @@ pg_jsonapi::QueryBuilder::QueryBuilder ()
     q_page_size_ = 0;
     q_page_number_ = 0;
     q_http_status_ = E_HTTP_OK;
-    q_json_function_data_ = NULL;
-    q_json_function_included_ = NULL;
     q_needs_search_path_ = false;
+    q_cursor_ = NULL;
+    q_stream_ = NULL;
+    q_iso_dates_ = false;
+    q_session_timezone_ = NULL;
+
+    parsed_urls_capacity_ = DocumentConfig::DefaultUrlCacheSize();
 
     validators_setting_[E_DB_CONFIG_XSS] = "xss_validators";
     validators_setting_[E_DB_CONFIG_SQL_WHITELIST] = "sql_validators_with_whitelist";
@@ -96,14 +109,16 @@ void pg_jsonapi::QueryBuilder::Clear ()
     // Resource Specification - initialized only once by base_url
     config_ = NULL;
 
+    // Batch - kept while the requests of a batch are executed in the same SPI connection
+    batch_ = false;
+    batch_search_path_.clear();
+    batch_old_search_path_.clear();
+
     // Attributes - request variables filled while parsing request
     rq_method_ = "GET";
     rq_extension_ = E_EXT_NONE;
     rq_url_encoded_.clear();
     rq_base_url_.clear();
-    if ( rq_body_root_.isArray() || rq_body_root_.isObject() ) {
-        rq_body_root_.clear();
-    }
     rq_accounting_schema_.clear();
     rq_sharded_schema_.clear();
     rq_company_schema_.clear();
@@ -122,13 +137,18 @@ void pg_jsonapi::QueryBuilder::Clear ()
     rq_links_param_ = -1; // undefined
     rq_totals_param_ = -1; // undefined
     rq_null_param_ = -1; // undefined
+    rq_format_param_ = E_FORMAT_JSONAPI;
     rq_page_size_param_ = -1; // undefined
     rq_page_number_param_ = -1; // undefined
+    rq_page_cursor_param_.clear();
     rq_operations_.clear();
 
     // Attributes - used to query postgres and keep results
     spi_connected_ = false;
     spi_read_only_ = true;
+    spi_sub_transaction_ = false;
+    spi_skip_sub_transaction_ = false;
+    spi_release_sub_transaction_ = false;
     q_buffer_.clear();
     q_required_count_ = 0;
     q_data_.clear();
@@ -140,10 +160,16 @@ void pg_jsonapi::QueryBuilder::Clear ()
     q_page_number_ = 0;
     q_errors_.clear();
     q_http_status_ = E_HTTP_OK;
-    q_json_function_data_ = NULL;
-    q_json_function_included_ = NULL;
+    q_json_function_data_.Reset();
+    q_json_function_included_.Reset();
     q_needs_search_path_ = false;
     q_old_search_path_.clear();
+    q_iso_dates_ = false;
+    q_session_timezone_ = NULL;
+    q_parallel_.Clear();
+    q_fragment_key_prefix_.clear();
+    q_cursor_ = NULL;
+    q_stream_ = NULL;
 }
 
 /**
@@ -205,6 +231,7 @@ bool pg_jsonapi::QueryBuilder::ParseRequestArguments (const char* a_method, size
                                      (int)a_accounting_prefix_len, a_accounting_prefix)));
 
     InitValidatorsFromPGConfig();
+    last_page_cursor_.clear();
 
     JsonapiJson::Reader reader(JsonapiJson::Features::strictMode());
 
@@ -214,13 +241,13 @@ bool pg_jsonapi::QueryBuilder::ParseRequestArguments (const char* a_method, size
         return false;
     }
 
-    rq_method_ = std::string(a_method, 0, a_method_len);
+    rq_method_.assign(a_method, a_method_len);
     if ( ! IsValidHttpMethod(rq_method_) ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA012"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "method '%s' is not valid", rq_method_.c_str());
         return false;
     }
 
-    rq_url_encoded_ = std::string(a_url, 0, a_url_len);
+    rq_url_encoded_.assign(a_url, a_url_len);
     if ( ! ParseUrl() ) {
         return false;
     }
@@ -234,27 +261,27 @@ bool pg_jsonapi::QueryBuilder::ParseRequestArguments (const char* a_method, size
     }
 
     if ( a_accounting_schema_len ) {
-        rq_accounting_schema_ = std::string(a_accounting_schema, 0, a_accounting_schema_len);
+        rq_accounting_schema_.assign(a_accounting_schema, a_accounting_schema_len);
     }
 
     if ( a_sharded_schema_len ) {
-        rq_sharded_schema_ = std::string(a_sharded_schema, 0, a_sharded_schema_len);
+        rq_sharded_schema_.assign(a_sharded_schema, a_sharded_schema_len);
     }
 
     if ( a_company_schema_len ) {
-        rq_company_schema_ = std::string(a_company_schema, 0, a_company_schema_len);
+        rq_company_schema_.assign(a_company_schema, a_company_schema_len);
     }
 
     if ( a_accounting_prefix_len ) {
-        rq_accounting_prefix_ = std::string(a_accounting_prefix, 0, a_accounting_prefix_len);
+        rq_accounting_prefix_.assign(a_accounting_prefix, a_accounting_prefix_len);
     }
 
     if ( a_user_id_len ) {
-        rq_user_id_ = std::string(a_user_id, 0, a_user_id_len);
+        rq_user_id_.assign(a_user_id, a_user_id_len);
     }
 
     if ( a_company_id_len ) {
-        rq_company_id_ = std::string(a_company_id, 0, a_company_id_len);
+        rq_company_id_.assign(a_company_id, a_company_id_len);
     }
     return true;
 }
@@ -269,6 +296,10 @@ bool pg_jsonapi::QueryBuilder::ParseUrl ()
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 
+    if ( RestoreParsedUrl() ) {
+        return true;
+    }
+
     int   cs;
     const char* p     = rq_url_encoded_.c_str();
     const char* pe    = p + rq_url_encoded_.length();
@@ -303,12 +334,98 @@ bool pg_jsonapi::QueryBuilder::ParseUrl ()
     }
     (void) JSONAPIUrl_en_main;
     (void) JSONAPIUrl_error;
+
+    KeepParsedUrl();
+    return true;
+}
+
+/**
+ * @brief Set request arguments kept from a previous request with the same URL.
+ *
+ * @return @li true if URL was already parsed
+ *         @li false otherwise
+ */
+bool pg_jsonapi::QueryBuilder::RestoreParsedUrl ()
+{
+    ParsedUrlIndex::iterator it = parsed_urls_index_.find(rq_url_encoded_);
+
+    if ( parsed_urls_index_.end() == it ) {
+        return false;
+    }
+    if ( parsed_urls_.begin() != it->second ) {
+        parsed_urls_.splice(parsed_urls_.begin(), parsed_urls_, it->second);
+    }
+
+    const ParsedUrl& parsed = it->second->second;
+    rq_base_url_           = parsed.base_url_;
+    rq_resource_type_      = parsed.resource_type_;
+    rq_resource_id_        = parsed.resource_id_;
+    rq_related_            = parsed.related_;
+    rq_relationship_       = parsed.relationship_;
+    rq_include_param_      = parsed.include_param_;
+    rq_sort_param_         = parsed.sort_param_;
+    rq_fields_param_       = parsed.fields_param_;
+    rq_filter_field_param_ = parsed.filter_field_param_;
+    rq_filter_param_       = parsed.filter_param_;
+    rq_page_size_param_    = parsed.page_size_param_;
+    rq_page_number_param_  = parsed.page_number_param_;
+    rq_page_cursor_param_  = parsed.page_cursor_param_;
+    rq_links_param_        = parsed.links_param_;
+    rq_totals_param_       = parsed.totals_param_;
+    rq_null_param_         = parsed.null_param_;
+    rq_format_param_       = parsed.format_param_;
+
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s url=%s", __FUNCTION__, rq_url_encoded_.c_str())));
     return true;
 }
 
+/**
+ * @brief Keep request arguments of the URL just parsed, evicting the least recently used.
+ */
+void pg_jsonapi::QueryBuilder::KeepParsedUrl ()
+{
+    /* tokens of page[cursor] are only used once */
+    if ( 0 == parsed_urls_capacity_ || ( rq_page_cursor_param_.length() && "new" != rq_page_cursor_param_ ) ) {
+        return;
+    }
+    EvictParsedUrls(parsed_urls_capacity_ - 1);
+
+    parsed_urls_.push_front(ParsedUrlEntry(rq_url_encoded_, ParsedUrl()));
+    ParsedUrl& parsed = parsed_urls_.front().second;
+    parsed.base_url_           = rq_base_url_;
+    parsed.resource_type_      = rq_resource_type_;
+    parsed.resource_id_        = rq_resource_id_;
+    parsed.related_            = rq_related_;
+    parsed.relationship_       = rq_relationship_;
+    parsed.include_param_      = rq_include_param_;
+    parsed.sort_param_         = rq_sort_param_;
+    parsed.fields_param_       = rq_fields_param_;
+    parsed.filter_field_param_ = rq_filter_field_param_;
+    parsed.filter_param_       = rq_filter_param_;
+    parsed.page_size_param_    = rq_page_size_param_;
+    parsed.page_number_param_  = rq_page_number_param_;
+    parsed.page_cursor_param_  = rq_page_cursor_param_;
+    parsed.links_param_        = rq_links_param_;
+    parsed.totals_param_       = rq_totals_param_;
+    parsed.null_param_         = rq_null_param_;
+    parsed.format_param_       = rq_format_param_;
+    parsed_urls_index_[rq_url_encoded_] = parsed_urls_.begin();
+}
+
+void pg_jsonapi::QueryBuilder::EvictParsedUrls (size_t a_capacity)
+{
+    while ( parsed_urls_.size() > a_capacity ) {
+        parsed_urls_index_.erase(parsed_urls_.back().first);
+        parsed_urls_.pop_back();
+    }
+}
+
 /**
  * @brief Parse the request body.
  *
+ * The body is read in one pass by RequestBodyParser, without building a document tree:
+ * each operation keeps only the values it validates and writes to its commands.
+ *
  * @return @li true if parsing succeeds
  *         @li false if an error occurs
  */
@@ -317,7 +434,8 @@ bool pg_jsonapi::QueryBuilder::ParseRequestBody (const char* a_body, size_t a_bo
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 
     bool rv = true;
-    JsonapiJson::Reader reader(JsonapiJson::Features::strictMode());
+    RequestBodyParser parser;
+    std::string parse_error;
     OperationType op_type = E_OP_UPDATE;
 
     if ( 0 == a_body_len ) {
@@ -326,9 +444,10 @@ bool pg_jsonapi::QueryBuilder::ParseRequestBody (const char* a_body, size_t a_bo
             return false;
         }
         if ( "DELETE" == rq_method_ ) {
+            OperationBody no_body;
             rq_operations_.resize( 1 );
             rq_operations_[0].SetRequestType(0, E_OP_DELETE);
-            if ( ! rq_operations_[0].SetRequest(NULL) ) {
+            if ( ! rq_operations_[0].SetRequest(no_body) ) {
                 return false;
             }
         }
@@ -340,59 +459,62 @@ bool pg_jsonapi::QueryBuilder::ParseRequestBody (const char* a_body, size_t a_bo
         return false;
     }
 
-    if (   ! reader.parse(a_body, a_body + a_body_len, rq_body_root_, false)
-        || ! ( rq_body_root_.isArray() || rq_body_root_.isObject() ) ) {
+    if ( ! parser.Parse(a_body, a_body_len, parse_error) ) {
+        AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid json on request body: %s",
+                    parse_error.c_str());
+        return false;
+    }
+    if ( ! ( E_BODY_ARRAY == parser.root_kind_ || E_BODY_OBJECT == parser.root_kind_ ) ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid json on request body: %s",
-                    reader.getFormatedErrorMessages().c_str());
+                    "value must be an object or an array");
         return false;
     }
 
-    if ( rq_body_root_.isArray() ) {
+    OperationBodyVector& operations = parser.operations_;
+
+    if ( E_BODY_ARRAY == parser.root_kind_ ) {
         rq_extension_ = E_EXT_JSON_PATCH;
 
         if ( "PATCH" != rq_method_ ) {
             AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "array request is invalid for method '%s', array is only allowed as JSON PATCH extension", rq_method_.c_str());
             return false;
         }
-        rq_operations_.resize( rq_body_root_.size() );
+        rq_operations_.resize( operations.size() );
         for ( int i = 0; i < (int)rq_operations_.size(); i++ ) {
-            if ( ! (   rq_body_root_[i].isObject()
-                    && 3 == rq_body_root_[i].size()
-                    && rq_body_root_[i].isMember("op") && rq_body_root_[i]["op"].isString()
-                    && rq_body_root_[i].isMember("path") && rq_body_root_[i]["path"].isString()
+            OperationBody& operation = operations[i];
+            if ( ! (   E_BODY_OBJECT == operation.patch_kind_
+                    && 3 == operation.patch_members_
+                    && E_BODY_STRING == operation.patch_op_kind_
+                    && E_BODY_STRING == operation.patch_path_kind_
                     ) ) {
                 AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "request body MUST contain an array of operations in JSON Patch format");
                 rv = false;
             } else {
-                if ( "add" == rq_body_root_[i]["op"].asString() ) {
+                const char* op = operation.patch_op_.c_str();
+                if ( 0 == strcmp("add", op) ) {
                     op_type = E_OP_CREATE;
-                } else if ( "replace" == rq_body_root_[i]["op"].asString() ) {
+                } else if ( 0 == strcmp("replace", op) ) {
                     op_type = E_OP_UPDATE;
-                } else if ( "remove" == rq_body_root_[i]["op"].asString() ) {
+                } else if ( 0 == strcmp("remove", op) ) {
                     op_type = E_OP_DELETE;
                 } else {
                     op_type = E_OP_UNDEFINED;
-                    AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "operation '%s' is not valid or not implemented", rq_body_root_[i]["op"].asString().c_str() );
+                    AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "operation '%s' is not valid or not implemented", op);
                     rv = false;
                 }
                 rq_operations_[i].SetRequestType(i, op_type);
 
-                if (E_OP_UNDEFINED != op_type ) {
-                    if ( ! (   rq_body_root_[i].isObject()
-                            && 3 == rq_body_root_[i].size()
-                            && rq_body_root_[i].isMember("op")   && rq_body_root_[i]["op"].isString()
-                            && rq_body_root_[i].isMember("path") && rq_body_root_[i]["path"].isString()
-                            ) ) {
-                        AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "request body MUST contain an array of operations in JSON Patch format");
-                        rv = false;
-                    } else if ( ! rq_operations_[i].SetRequest(&rq_body_root_[i]["value"], rq_body_root_[i]["path"].asString()) ) {
-                        rv= false;
-                    }
+                /* a missing "value" is read as null */
+                if ( E_BODY_ABSENT == operation.data_.kind_ ) {
+                    operation.data_.kind_ = E_BODY_NULL;
+                }
+                if ( E_OP_UNDEFINED != op_type && ! rq_operations_[i].SetRequest(operation, operation.patch_path_) ) {
+                    rv= false;
                 }
             }
         }
     } else {
-        if ( 1 != rq_body_root_.size() || ! rq_body_root_.isMember("data") ) {
+        if ( 1 != parser.root_members_ || ! parser.root_has_data_ ) {
             AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "request body MUST contain a data member whose value is %s",
                        ( "DELETE" != rq_method_ ) ?
                        "an array of resource identifier objects" : "an array of resource objects");
@@ -407,18 +529,18 @@ bool pg_jsonapi::QueryBuilder::ParseRequestBody (const char* a_body, size_t a_bo
             op_type = E_OP_DELETE;
         } // else never hapens
 
-        if ( rq_body_root_["data"].isObject() ) {
+        if ( E_BODY_OBJECT == parser.data_kind_ ) {
             rq_operations_.resize( 1 );
             rq_operations_[0].SetRequestType(0, op_type);
-            if ( ! rq_operations_[0].SetRequest(&rq_body_root_["data"]) ) {
+            if ( ! rq_operations_[0].SetRequest(operations[0]) ) {
                 return false;
             }
         } else {
             rq_extension_ = E_EXT_BULK;
-            rq_operations_.resize( rq_body_root_["data"].size() );
+            rq_operations_.resize( operations.size() );
             for ( int i = 0; i < (int)rq_operations_.size(); i++ ) {
                 rq_operations_[i].SetRequestType(i, op_type);
-                if ( ! rq_operations_[i].SetRequest(&rq_body_root_["data"][i]) ) {
+                if ( ! rq_operations_[i].SetRequest(operations[i]) ) {
                     return false;
                 }
             }
@@ -467,6 +589,11 @@ bool pg_jsonapi::QueryBuilder::ValidateRequest()
     }
     config_ = &(it->second);
 
+    if ( parsed_urls_capacity_ != config_->UrlCacheSize() ) {
+        parsed_urls_capacity_ = config_->UrlCacheSize();
+        EvictParsedUrls(parsed_urls_capacity_);
+    }
+
     if ( GetResourceType().length() ) {
         if ( ! config_->ValidateRequest(GetResourceType(), GetRelated()) ) {
             return false;
@@ -489,6 +616,9 @@ bool pg_jsonapi::QueryBuilder::ValidateRequest()
     }
 
     for ( StringSetMap::iterator res = rq_fields_param_.begin(); res != rq_fields_param_.end(); ++res ) {
+        if ( ! config_->CompileResource(res->first) ) {
+            return false;
+        }
         for ( StringSet::iterator field = res->second.begin(); field != res->second.end(); ++field ) {
             if ( ! config_->IsValidField(res->first, *field) ) {
                 ErrorObject& e = AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "resource '%s' does not have a '%s' field for '%s'",
@@ -498,6 +628,21 @@ bool pg_jsonapi::QueryBuilder::ValidateRequest()
         }
     }
 
+    if ( IsExport() ) {
+        if (   "GET" != rq_method_ || GetResourceType().empty() || IsRelationship()
+            || ! ( IsCollection() || ( HasRelated() && config_->GetResource(GetResourceType()).IsToManyRelationship(GetRelated()) ) ) ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "format can only be applied when fetching collections")
+            .SetSourceParam("format");
+        } else if ( rq_include_param_.size() ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "include param cannot be used with format")
+            .SetSourceParam("include");
+        } else if ( IsTopQueryFromJobTube() || TopFunctionReturnsJson() ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "resource '%s' cannot be exported because it's processed by a job or by a function that returns json",
+                                                                                   GetResourceType().c_str())
+            .SetSourceParam("format");
+        }
+    }
+
     if ( ! IsTopQueryFromJobTube() ) {
 
         if ( IsTopQueryFromFunction() ) {
@@ -616,6 +761,19 @@ bool pg_jsonapi::QueryBuilder::ValidateRequest()
             } else {
                 q_page_number_ = rq_page_number_param_;
             }
+
+            if ( HasPageCursor() ) {
+                if ( "GET" != rq_method_ || HasRelated() || IsTopQueryFromFunction() ) {
+                    AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "page[cursor] can only be applied when fetching collections of resources read from a table")
+                    .SetSourceParam("page[cursor]=%s", rq_page_cursor_param_.c_str());
+                } else if ( -1 != rq_page_number_param_ ) {
+                    AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "page[cursor] and page[number] cannot be used together")
+                    .SetSourceParam("page[number]=%zd", rq_page_number_param_);
+                } else if ( 0 == q_page_size_ ) {
+                    AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "page[size] is not specified, cannot apply pagination")
+                    .SetSourceParam("page[cursor]=%s", rq_page_cursor_param_.c_str());
+                }
+            }
         } else {
             if ( -1 != rq_page_size_param_ ) {
                 AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "pagination can only be applied when fetching collections")
@@ -625,42 +783,36 @@ bool pg_jsonapi::QueryBuilder::ValidateRequest()
                 AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "pagination can only be applied when fetching collections")
                 .SetSourceParam("page[number]=%zd", rq_page_number_param_);
             }
+            if ( HasPageCursor() ) {
+                AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "pagination can only be applied when fetching collections")
+                .SetSourceParam("page[cursor]=%s", rq_page_cursor_param_.c_str());
+            }
+        }
+
+        /* reading tables and views can't write, the sub-transaction isn't needed when neither the resource nor those it may include call functions,
+         * except in a batch, where an error would abort the requests that follow */
+        if ( "GET" == rq_method_ && ! batch_ && ! config_->ReadOnlySubtransaction() && ! spi_sub_transaction_ && config_->ReadsOnlyRelations(GetResourceType()) ) {
+            spi_skip_sub_transaction_ = true;
         }
 
         if ( NeedsSearchPath() ) {
-            ereport(DEBUG3, (errmsg_internal("jsonapi: old.search_path=%s<< template_search_path=%s new.search_path=%s<<", q_old_search_path_.c_str(), config_->SearchPathTemplate().c_str(), namespace_search_path)));
-            std::string set_cmd;
-
-            set_cmd = "SET LOCAL search_path to " + config_->SearchPathTemplate();
-            size_t pos = set_cmd.find("request-accounting-schema");
-            if ( std::string::npos != pos ) {
-                if ( GetRequestAccountingSchema().length() ) {
-                    set_cmd.replace(pos, strlen("request-accounting-schema"),GetRequestAccountingSchema());
-                } else {
-                    set_cmd.replace(pos, strlen("request-accounting-schema"),"public");
+            const std::string search_path = GetSearchPath();
+
+            ereport(DEBUG3, (errmsg_internal("jsonapi: old.search_path=%s<< template_search_path=%s new.search_path=%s<<", namespace_search_path, config_->SearchPathTemplate().c_str(), search_path.c_str())));
+            if ( search_path == namespace_search_path ) {
+                /* tenant schemas already in use, e.g. set by a previous request of the batch */
+            } else {
+                if ( batch_ && batch_search_path_.empty() ) {
+                    batch_old_search_path_ = namespace_search_path;
                 }
-            }
-            pos = set_cmd.find("request-sharded-schema");
-            if ( std::string::npos != pos ) {
-                if ( GetRequestShardedSchema().length() ) {
-                    set_cmd.replace(pos, strlen("request-sharded-schema"),GetRequestShardedSchema());
-                } else {
-                    set_cmd.replace(pos, strlen("request-sharded-schema"),"public");
+                q_old_search_path_ = namespace_search_path;
+                if ( ! SPISetSearchPath(search_path) ) {
+                    return false;
                 }
-            }
-            pos = set_cmd.find("request-company-schema");
-            if ( std::string::npos != pos ) {
-                if ( GetRequestCompanySchema().length() ) {
-                    set_cmd.replace(pos, strlen("request-company-schema"),GetRequestCompanySchema());
-                } else {
-                    set_cmd.replace(pos, strlen("request-company-schema"),"public");
+                if ( batch_ ) {
+                    batch_search_path_ = search_path;
                 }
             }
-
-            if ( ! SPIExecuteCommand(set_cmd, SPI_OK_UTILITY) ) {
-                return false;
-            }
-            q_old_search_path_ = namespace_search_path;
             ereport(DEBUG3, (errmsg_internal("jsonapi: search_path=%s",  namespace_search_path)));
         }
     }
@@ -679,6 +831,11 @@ void pg_jsonapi::QueryBuilder::RequestResourceInclusion(const std::string& a_typ
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s a_type:%s", __FUNCTION__, a_type.c_str())));
 
+    /* exported records never include related resources */
+    if ( IsExport() ) {
+        return;
+    }
+
     if (  ( config_->IsCompound() && 0 == rq_include_param_.size() )
         || ( rq_include_param_.count(a_field)
             && (   ( 0 == a_depth && ( ! HasRelated() || IsRelationship() ) )
@@ -787,84 +944,78 @@ bool pg_jsonapi::QueryBuilder::ProcessAttributes(const std::string& a_type, size
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s a_type:%s", __FUNCTION__, a_type.c_str())));
 
     uint32_t              offset = 0;
-    bool                  is_null;
     const ResourceConfig& rc = config_->GetResource(a_type);
+    ResourceData&         rd = q_data_[a_type];
 
-    if ( q_data_[a_type].processed_ ) {
-        offset = q_data_[a_type].processed_;
-        q_data_[a_type].processed_ += SPI_processed;
-        ereport(DEBUG3, (errmsg_internal("query for resource '%s' had already %u processed rows, total resized to %u", a_type.c_str(), offset, q_data_[a_type].processed_)));
+    if ( rd.processed_ ) {
+        offset = rd.processed_;
+        rd.processed_ += SPI_processed;
+        ereport(DEBUG3, (errmsg_internal("query for resource '%s' had already %u processed rows, total resized to %u", a_type.c_str(), offset, rd.processed_)));
 
-        if ( q_data_[a_type].tupdesc_->natts != SPI_tuptable->tupdesc->natts ) {
+        if ( rd.tupdesc_->natts != SPI_tuptable->tupdesc->natts ) {
             /* sanity check: we are trusting that queries always return same columns per resource */
             AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "different number of columns was returned for resource '%s'", a_type.c_str());
             return false;
         }
     } else {
-        q_data_[a_type].processed_ = SPI_processed;
-    }
-    q_data_[a_type].tupdesc_  = SPI_tuptable->tupdesc;
-    q_data_[a_type].items_.resize(q_data_[a_type].processed_);
-    for (uint32 row = offset; row < q_data_[a_type].processed_; row++) {
-        q_data_[a_type].items_[row].res_tuple_ = SPI_tuptable->vals[row-offset];
-        q_data_[a_type].items_[row].serialized_ = false;
-        /* 'id' column should always be the first field returned from query, and we could avoid strcmp loop... */
-        for (int col = 1; NULL == q_data_[a_type].items_[row].id_ && col <= q_data_[a_type].tupdesc_->natts; col++) {
-            const char* attname = NameStr(TupleDescAttr(q_data_[a_type].tupdesc_,col-1)->attname);
-            if ( 0 == strcmp(attname, "id") ) {
-                SPI_getbinval(q_data_[a_type].items_[row].res_tuple_, q_data_[a_type].tupdesc_, col, &is_null);
-                if ( is_null ) {
-                    AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "empty id for '%s'", a_type.c_str());
-                    return false;
-                }
-                q_data_[a_type].items_[row].id_ = SPI_getvalue(q_data_[a_type].items_[row].res_tuple_, q_data_[a_type].tupdesc_, col);
-                if ( q_data_[a_type].processed_ids_.count(q_data_[a_type].items_[row].id_) ) {
-                    AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "possible duplicate, id '%s' for '%s' was already returned",
-                               q_data_[a_type].items_[row].id_, a_type.c_str());
-                    return false;
-                }
-                q_data_[a_type].id_index_[q_data_[a_type].items_[row].id_] = row;
-                a_processed_ids->insert( q_data_[a_type].items_[row].id_ );
-                q_data_[a_type].processed_ids_.insert( q_data_[a_type].items_[row].id_ );
-
+        rd.processed_ = SPI_processed;
+    }
+    rd.SetTupleDesc(SPI_tuptable->tupdesc, rc);
+    rd.items_.resize(rd.processed_);
+    for (uint32 row = offset; row < rd.processed_; row++) {
+        rd.items_[row].res_tuple_ = SPI_tuptable->vals[row-offset];
+        rd.items_[row].serialized_ = false;
+        /* tuple is deformed only once, 'id' and relationships are read from deformed values */
+        rd.DeformRow(row);
+        if ( -1 != rd.id_col_ && NULL == rd.items_[row].id_ ) {
+            if ( rd.nulls_[rd.id_col_] ) {
+                AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "empty id for '%s'", a_type.c_str());
+                return false;
+            }
+            rd.items_[row].id_ = rd.GetValue(rd.id_col_);
+            if ( rd.processed_ids_.count(rd.items_[row].id_) ) {
+                AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "possible duplicate, id '%s' for '%s' was already returned",
+                           rd.items_[row].id_, a_type.c_str());
+                return false;
             }
+            rd.id_index_[rd.items_[row].id_] = row;
+            a_processed_ids->insert( rd.items_[row].id_ );
+            rd.processed_ids_.insert( rd.items_[row].id_ );
         }
-        if ( NULL == q_data_[a_type].items_[row].id_ || 0 ==strlen(q_data_[a_type].items_[row].id_) ) {
+        if ( NULL == rd.items_[row].id_ || '\0' == rd.items_[row].id_[0] ) {
             if ( rc.IdFromRowset() ) {
-                q_data_[a_type].items_[row].internal_id_ = std::to_string(row);
-                q_data_[a_type].items_[row].id_ = q_data_[a_type].items_[row].internal_id_.c_str();
-                if ( q_data_[a_type].processed_ids_.count(q_data_[a_type].items_[row].id_) ) {
+                rd.items_[row].internal_id_ = std::to_string(row);
+                rd.items_[row].id_ = rd.items_[row].internal_id_.c_str();
+                if ( rd.processed_ids_.count(rd.items_[row].id_) ) {
                     AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "possible duplicate, id '%s' for '%s' was already returned",
-                               q_data_[a_type].items_[row].id_, a_type.c_str());
+                               rd.items_[row].id_, a_type.c_str());
                     return false;
                 }
-                q_data_[a_type].id_index_[q_data_[a_type].items_[row].id_] = row;
-                a_processed_ids->insert( q_data_[a_type].items_[row].id_ );
-                q_data_[a_type].processed_ids_.insert( q_data_[a_type].items_[row].id_ );
+                rd.id_index_[rd.items_[row].id_] = row;
+                a_processed_ids->insert( rd.items_[row].id_ );
+                rd.processed_ids_.insert( rd.items_[row].id_ );
             } else {
                 AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "empty id for '%s'", a_type.c_str());
                 return false;
             }
         }
-        for (int col = 1; col <= q_data_[a_type].tupdesc_->natts; col++) {
-            const char* attname = NameStr(TupleDescAttr(q_data_[a_type].tupdesc_,col-1)->attname);
-            if ( rc.IsRelationship(attname) ) {
-                const char* rel_id = SPI_getvalue(q_data_[a_type].items_[row].res_tuple_, q_data_[a_type].tupdesc_, col);
-                if ( NULL != rel_id ) {
-                    if ( 0 == strlen(rel_id) ) {
-                        if ( ! config_->EmptyIsNull() ) {
-                            AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "empty value of relationship '%s.%s' for parent id='%s'",
-                                       a_type.c_str(), attname, q_data_[a_type].items_[row].id_);
-                            return false;
-                        }
+        for ( ColumnVector::const_iterator col = rd.rel_cols_.begin(); col != rd.rel_cols_.end(); ++col ) {
+            const char* attname = NameStr(TupleDescAttr(rd.tupdesc_,*col)->attname);
+            const char* rel_id  = rd.GetValue(*col);
+            if ( NULL != rel_id ) {
+                if ( '\0' == rel_id[0] ) {
+                    if ( ! config_->EmptyIsNull() ) {
+                        AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "empty value of relationship '%s.%s' for parent id='%s'",
+                                   a_type.c_str(), attname, rd.items_[row].id_);
+                        return false;
+                    }
+                } else {
+                    rd.items_[row].relationships_[attname].push_back(rel_id);
+                    if ( 0 == a_depth && HasRelated() && !IsRelationship() && attname == GetRelated() ) {
+                        RequestOperationResponseData(GetRelatedType(), rel_id);
+                        q_data_[GetRelatedType()].top_processed_ = 1;
                     } else {
-                        q_data_[a_type].items_[row].relationships_[attname].push_back(rel_id);
-                        if ( 0 == a_depth && HasRelated() && !IsRelationship() && attname == GetRelated() ) {
-                            RequestOperationResponseData(GetRelatedType(), rel_id);
-                            q_data_[GetRelatedType()].top_processed_ = 1;
-                        } else {
-                            RequestResourceInclusion(a_type, a_depth, q_data_[a_type].items_[row].id_, attname, rel_id);
-                        }
+                        RequestResourceInclusion(a_type, a_depth, rd.items_[row].id_, attname, rel_id);
                     }
                 }
             }
@@ -943,7 +1094,7 @@ bool pg_jsonapi::QueryBuilder::ProcessRelationships(const std::string& a_type, s
 }
 
 /**
- * @brief Connect to SPI and start a sub-transaction.
+ * @brief Connect to SPI, the sub-transaction is only started before the first command.
  *
  * @return @li true if connection succeeds
  *         @li false if an error occurs
@@ -951,20 +1102,39 @@ bool pg_jsonapi::QueryBuilder::ProcessRelationships(const std::string& a_type, s
 bool pg_jsonapi::QueryBuilder::SPIConnect() {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 
+    /* requests of a batch share the connection */
+    if ( spi_connected_ ) {
+        return true;
+    }
+
     int ret = SPI_connect();
     if ( SPI_OK_CONNECT != ret ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA005"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "SPI_connect error: %s.", SPI_result_code_string(ret));
         return false;
     } else {
         spi_connected_ = true;
-        BeginInternalSubTransaction(NULL);
         return true;
     }
 }
 
+/**
+ * @brief Start the sub-transaction commands of this request are executed in, unless it can't write.
+ *
+ * Without it an error can't be recovered, HandleSPIError() raises it again.
+ */
+void pg_jsonapi::QueryBuilder::SPIBeginSubTransaction ()
+{
+    if ( spi_connected_ && ! spi_sub_transaction_ && ! spi_skip_sub_transaction_ ) {
+        BeginInternalSubTransaction(NULL);
+        spi_sub_transaction_ = true;
+    }
+}
+
 /**
  * @brief Disconnect from SPI and release the sub-transaction, doing a rollback in case any error occurred.
  *
+ * A read only request is also rolled back, unless it used a page[cursor] that must be kept for the next pages.
+ *
  * @return @li true if disconnection succeeds
  *         @li false if an error occurs
  */
@@ -973,13 +1143,16 @@ bool pg_jsonapi::QueryBuilder::SPIDisconnect() {
 
     if ( spi_connected_ ) {
 
-        if ( ! spi_read_only_ && ! HasErrors() ) {
+        if ( ! spi_sub_transaction_ ) {
+            ereport(DEBUG3, (errmsg_internal("jsonapi: executed without subtransaction")));
+        } else if ( ( ! spi_read_only_ || spi_release_sub_transaction_ ) && ! HasErrors() ) {
             ReleaseCurrentSubTransaction();
             ereport(DEBUG3, (errmsg_internal("jsonapi: released current subtransaction")));
         } else {
             RollbackAndReleaseCurrentSubTransaction();
             ereport(DEBUG3, (errmsg_internal("jsonapi: rolled back and released current subtransaction")));
         }
+        spi_sub_transaction_ = false;
 
         int ret = SPI_finish();
         spi_connected_ = false;
@@ -991,6 +1164,88 @@ bool pg_jsonapi::QueryBuilder::SPIDisconnect() {
     return true;
 }
 
+/**
+ * @brief Connect to SPI for a batch of requests, each one is executed after NextBatchRequest().
+ *
+ * @return @li true if connection succeeds
+ *         @li false if an error occurs
+ */
+bool pg_jsonapi::QueryBuilder::BeginBatch ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    batch_ = true;
+    batch_search_path_.clear();
+    batch_old_search_path_.clear();
+
+    return SPIConnect();
+}
+
+/**
+ * @brief Reset this node for the next request of a batch, keeping the SPI connection.
+ *
+ * The sub-transaction is only restarted after a request that failed or that may have written,
+ * as it's done when requests are executed alone, otherwise it's kept with the search_path already set.
+ */
+void pg_jsonapi::QueryBuilder::NextBatchRequest ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    if ( ! spi_connected_ ) {
+        /* an error rolled back and disconnected, search_path may have been reverted with it */
+        RestoreBatchSearchPath();
+    } else if ( spi_sub_transaction_ && ( HasErrors() || ! spi_read_only_ || spi_release_sub_transaction_ ) ) {
+        /* memory is then allocated in the new sub-transaction context, the previous one is gone */
+        if ( ! HasErrors() ) {
+            ReleaseCurrentSubTransaction();
+        } else {
+            RollbackAndReleaseCurrentSubTransaction();
+        }
+        RestoreBatchSearchPath();
+        BeginInternalSubTransaction(NULL);
+    }
+
+    bool        connected       = spi_connected_;
+    bool        sub_transaction = spi_sub_transaction_;
+    std::string search_path     = batch_search_path_;
+    std::string old_search_path = batch_old_search_path_;
+
+    Clear();
+    spi_connected_         = connected;
+    spi_sub_transaction_   = sub_transaction;
+    batch_                 = true;
+    batch_search_path_     = search_path;
+    batch_old_search_path_ = old_search_path;
+}
+
+/**
+ * @brief Disconnect from SPI after the last request of a batch.
+ */
+void pg_jsonapi::QueryBuilder::EndBatch ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    SPIDisconnect();
+    RestoreBatchSearchPath();
+
+    batch_ = false;
+    batch_search_path_.clear();
+    batch_old_search_path_.clear();
+}
+
+/**
+ * @brief Reset search_path set by requests of a batch, after their sub-transaction is closed.
+ *
+ * Set as SET LOCAL does, at the caller's transaction level, so it's not undone by a rollback.
+ */
+void pg_jsonapi::QueryBuilder::RestoreBatchSearchPath ()
+{
+    if ( batch_search_path_.size() ) {
+        (void) set_config_option("search_path", batch_old_search_path_.c_str(), PGC_USERSET, PGC_S_SESSION, GUC_ACTION_LOCAL, true, 0, false);
+        batch_search_path_.clear();
+    }
+}
+
 /**
  * @brief Execute a command in postgresql using SPI.
  *
@@ -1004,6 +1259,8 @@ bool pg_jsonapi::QueryBuilder::SPIExecuteCommand (const std::string& a_command,
 {
     ereport(DEBUG2, (errmsg_internal("jsonapi: %s command: %s", __FUNCTION__, a_command.c_str() )));
 
+    SPIBeginSubTransaction();
+
     bool rv = true;
     MemoryContext  curContext = CurrentMemoryContext;
     int ret = 0;
@@ -1023,23 +1280,42 @@ bool pg_jsonapi::QueryBuilder::SPIExecuteCommand (const std::string& a_command,
     }
     PG_CATCH();
     {
-        MemoryContextSwitchTo( curContext );
-        ErrorData *errdata = CopyErrorData();
-        if ( JSONAPI_ERRCODE_CATEGORY == ERRCODE_TO_CATEGORY(errdata->sqlerrcode) )
-        {
-            // if JSONAPI error code category is being used, we can trust that message must be sent to user
-            AddError(errdata->sqlerrcode, errcodes_.GetStatus(errdata->sqlerrcode)).SetMessage(errdata->message, NULL);
-        } else {
-            // if another error category is being used, then use default status and message for the error code and send postgres message in internal meta
-            ErrorCode::ErrorCodeDetail ecd = errcodes_.GetDetail(errdata->sqlerrcode);
-            AddError(errdata->sqlerrcode, ecd.status_).SetMessage(ecd.message_, "ERROR:[ %s ] DETAIL:[ %s ] HINT:[ %s ] CONTEXT:[ %s ]", errdata->message,  errdata->detail,  errdata->hint,  errdata->context);
-        }
-        FreeErrorData(errdata);
+        HandleSPIError(curContext);
+        rv = false;
+    }
+    PG_END_TRY();
+
+    return rv;
+}
+
+/**
+ * @brief Set search_path for the current sub-transaction, without parsing and executing a SET command.
+ *
+ * @param a_search_path The new value of search_path.
+ *
+ * @return @li true if search_path was set
+ *         @li false if an error occurs
+ */
+bool pg_jsonapi::QueryBuilder::SPISetSearchPath (const std::string& a_search_path)
+{
+    ereport(DEBUG2, (errmsg_internal("jsonapi: %s search_path: %s", __FUNCTION__, a_search_path.c_str() )));
+
+    SPIBeginSubTransaction();
+
+    bool rv = true;
+    MemoryContext  curContext = CurrentMemoryContext;
 
-        FlushErrorState();
-        SPIDisconnect();
-        SPI_restore_connection();
+    if ( HasErrors() ) {
+        return false;
+    }
 
+    PG_TRY();
+    {
+        (void) set_config_option("search_path", a_search_path.c_str(), PGC_USERSET, PGC_S_SESSION, GUC_ACTION_LOCAL, true, 0, false);
+    }
+    PG_CATCH();
+    {
+        HandleSPIError(curContext);
         rv = false;
     }
     PG_END_TRY();
@@ -1047,93 +1323,372 @@ bool pg_jsonapi::QueryBuilder::SPIExecuteCommand (const std::string& a_command,
     return rv;
 }
 
-void pg_jsonapi::QueryBuilder::AddInClause (const std::string& a_column, StringSet a_values)
+/**
+ * @brief Replace request schema keywords of the search_path template, in a single pass.
+ *
+ * @return The search_path for the current request, keywords without schema are replaced by public.
+ */
+std::string pg_jsonapi::QueryBuilder::GetSearchPath () const
 {
-    if ( a_values.size() ) {
-        const char* comma = "";
-        q_buffer_ += a_column + " IN (";
-        for ( StringSet::const_iterator val = a_values.begin(); val != a_values.end(); ++val ) {
-            q_buffer_ += comma;
-            OperationRequest::AddQuotedStringToBuffer(q_buffer_, (*val).c_str(), /*quote*/ true);
-            comma = ",";
+    static const char* const k_keywords[] = { "request-accounting-schema", "request-sharded-schema", "request-company-schema" };
+    static const size_t      k_lengths[]  = { strlen(k_keywords[0]), strlen(k_keywords[1]), strlen(k_keywords[2]) };
+    const std::string*       values[]     = { &GetRequestAccountingSchema(), &GetRequestShardedSchema(), &GetRequestCompanySchema() };
+    const std::string&       search_path  = config_->SearchPathTemplate();
+    std::string              rv;
+
+    rv.reserve(search_path.length() + 64);
+    for ( size_t pos = 0; pos < search_path.length(); ) {
+        size_t k = 0;
+        if ( 'r' == search_path[pos] ) {
+            for ( ; k < 3; k++ ) {
+                if ( 0 == search_path.compare(pos, k_lengths[k], k_keywords[k]) ) {
+                    break;
+                }
+            }
+        } else {
+            k = 3;
+        }
+        if ( k < 3 ) {
+            rv += values[k]->length() ? *values[k] : "public";
+            pos += k_lengths[k];
+        } else {
+            rv += search_path[pos++];
         }
-        q_buffer_ += ")";
     }
+    return rv;
 }
 
 /**
- * @brief GetTopQuery
+ * @brief Keep error raised while executing a command, after recovering from it.
+ *
+ * Without sub-transaction there's nothing to recover to: search_path is reset and the error is
+ * raised again, aborting the caller's transaction instead of being returned in an error document.
  */
-const std::string& pg_jsonapi::QueryBuilder::GetTopQuery (bool a_count_rows, bool a_apply_filters)
+void pg_jsonapi::QueryBuilder::HandleSPIError (MemoryContext a_context)
 {
-    const ResourceConfig& rc = config_->GetResource(GetResourceType());
-    std::string condition_start = "";
-    std::string condition_separator = "";
-    std::string condition_operator = "";
-
-    q_buffer_.clear();
-    q_buffer_ = "SELECT ";
+    MemoryContextSwitchTo( a_context );
+    ErrorData *errdata = CopyErrorData();
+    FlushErrorState();
 
-    if ( a_count_rows ) {
-        if ( rc.FunctionSupportsCountColumn() ) {
-            q_buffer_ += rc.GetPGFunctionCountColumn();
-        } else {
-            q_buffer_ += " COUNT( ";
-            q_buffer_ += rc.GetPGQueryColId();
-            q_buffer_ += " ) ";
+    if ( ! spi_sub_transaction_ ) {
+        /* batches always use a sub-transaction */
+        if ( q_old_search_path_.size() ) {
+            (void) set_config_option("search_path", q_old_search_path_.c_str(), PGC_USERSET, PGC_S_SESSION, GUC_ACTION_LOCAL, true, 0, false);
         }
-    } else {
-        q_buffer_ += rc.GetPGQueryColumns();
+        spi_connected_ = false;
+        ReThrowError(errdata);
     }
 
-    q_buffer_ += " FROM ";
-
-    rc.AddPGQueryFromItem(q_buffer_);
-    if ( rc.IsQueryFromAttributesFunction() ) {
-        q_buffer_ += ", " + rc.GetPGQueryAttributesFunction() + "(";
-        rc.AddPGQueryFromItem(q_buffer_);
-        q_buffer_ += ".*) pgf ";
-    }
-    if ( rc.IsQueryFromFunction() )
+    if ( JSONAPI_ERRCODE_CATEGORY == ERRCODE_TO_CATEGORY(errdata->sqlerrcode) )
     {
-        q_buffer_ +=  "(";
-        condition_separator = ",";
-        condition_operator = " := ";
+        // if JSONAPI error code category is being used, we can trust that message must be sent to user
+        AddError(errdata->sqlerrcode, errcodes_.GetStatus(errdata->sqlerrcode)).SetMessage(errdata->message, NULL);
     } else {
-        condition_start = " WHERE ";
-        condition_separator = " AND ";
-        condition_operator = " = ";
-        /* company column */
-        if ( rc.GetPGQueryCompanyColumn().size() ) {
-            q_buffer_ += condition_start + "\"" + rc.GetPGQueryCompanyColumn() + "\" = " + GetRequestCompany();
-            condition_start = condition_separator;
-        }
+        // if another error category is being used, then use default status and message for the error code and send postgres message in internal meta
+        ErrorCode::ErrorCodeDetail ecd = errcodes_.GetDetail(errdata->sqlerrcode);
+        AddError(errdata->sqlerrcode, ecd.status_).SetMessage(ecd.message_, "ERROR:[ %s ] DETAIL:[ %s ] HINT:[ %s ] CONTEXT:[ %s ]", errdata->message,  errdata->detail,  errdata->hint,  errdata->context);
     }
+    /* open cursor, if any, was dropped along with the failed command */
+    q_cursor_ = NULL;
 
-    /* query condition */
-    if ( rc.GetPGQueryCondition().size() ) {
-        q_buffer_ += condition_start + rc.GetPGQueryCondition();
-        condition_start = condition_separator;
+    FreeErrorData(errdata);
+    SPIDisconnect();
+    SPI_restore_connection();
+}
+
+/**
+ * @brief Execute a SELECT command, when fetching in batches a cursor is opened and only the first batch is fetched.
+ *
+ * @return @li true if command was successfully executed
+ *         @li false if an error occurs
+ */
+bool pg_jsonapi::QueryBuilder::SPIExecuteQuery (const std::string& a_command)
+{
+    if ( ! FetchesInBatches() ) {
+        return SPIExecuteCommand(a_command, SPI_OK_SELECT);
     }
 
-    if ( a_apply_filters ) {
-        if ( ! rq_filter_param_.empty() ) {
+    ereport(DEBUG2, (errmsg_internal("jsonapi: %s command: %s", __FUNCTION__, a_command.c_str() )));
 
-            if ( '=' == rq_filter_param_[rq_filter_param_.length()-1] ) {
-                q_buffer_ += condition_start + rq_filter_param_.substr(0,rq_filter_param_.length()-1) + " IS NULL";
-            } else {
-                if ( rc.IsQueryFromFunction() ) {
-                    q_buffer_ += condition_start + rc.GetPGFunctionArgFilter() + condition_operator;
-                    OperationRequest::AddQuotedStringToBuffer(q_buffer_, rq_filter_param_.c_str(), /*quote*/ true);
-                } else {
-                    q_buffer_ += condition_start + "(" + rq_filter_param_ + ")";
-                }
-            }
-            condition_start = condition_separator;
-        }
+    SPIBeginSubTransaction();
+
+    bool rv = true;
+    MemoryContext  curContext = CurrentMemoryContext;
+
+    if ( HasErrors() ) {
+        return false;
     }
 
-    for ( StringMap::iterator res = rq_filter_field_param_.begin(); res != rq_filter_field_param_.end(); ++res ) {
+    /* type, id and attributes are serialized while rows are fetched */
+    PrepareSerialization();
+
+    PG_TRY();
+    {
+        q_cursor_ = SPI_cursor_open_with_args(NULL, a_command.c_str(), 0, NULL, NULL, NULL, spi_read_only_, 0);
+        SPI_cursor_fetch(q_cursor_, true, config_->FetchBatchSize());
+        ereport(DEBUG3, (errmsg_internal("jsonapi: %s SPI_processed=%d", __FUNCTION__, (int)SPI_processed)));
+    }
+    PG_CATCH();
+    {
+        HandleSPIError(curContext);
+        rv = false;
+    }
+    PG_END_TRY();
+
+    return rv;
+}
+
+/**
+ * @brief Fetch next batch of rows from open cursor.
+ *
+ * @return @li true if rows were fetched, SPI_processed is zero at the end
+ *         @li false if an error occurs
+ */
+bool pg_jsonapi::QueryBuilder::SPIFetchCursor ()
+{
+    bool rv = true;
+    MemoryContext  curContext = CurrentMemoryContext;
+
+    PG_TRY();
+    {
+        SPI_cursor_fetch(q_cursor_, true, config_->FetchBatchSize());
+        ereport(DEBUG3, (errmsg_internal("jsonapi: %s SPI_processed=%d", __FUNCTION__, (int)SPI_processed)));
+    }
+    PG_CATCH();
+    {
+        HandleSPIError(curContext);
+        rv = false;
+    }
+    PG_END_TRY();
+
+    return rv;
+}
+
+void pg_jsonapi::QueryBuilder::SPICloseCursor ()
+{
+    if ( NULL != q_cursor_ ) {
+        SPI_cursor_close(q_cursor_);
+        q_cursor_ = NULL;
+    }
+}
+
+/**
+ * @brief Fetch the next page of the top query from the cursor of page[cursor], declaring it when 'new'.
+ *
+ * The cursor is declared WITH HOLD, when the transaction commits postgres keeps the rows not yet
+ * fetched, so the following requests continue on the same data without executing the query again.
+ *
+ * @return @li true if the page was fetched
+ *         @li false if an error occurs
+ */
+bool pg_jsonapi::QueryBuilder::SPIFetchPageCursor ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s page[cursor]=%s", __FUNCTION__, rq_page_cursor_param_.c_str())));
+
+    SPIBeginSubTransaction();
+
+    bool          rv         = true;
+    MemoryContext curContext = CurrentMemoryContext;
+    std::string   signature  = GetPageCursorSignature();
+    std::string   token      = rq_page_cursor_param_;
+    Portal        portal     = NULL;
+
+    if ( "new" == token ) {
+        uint8 random[16];
+        char  hex[sizeof(random) * 2 + 1];
+
+        if ( ! pg_strong_random(random, sizeof(random)) ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA005"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "could not generate a token for page[cursor]");
+            return false;
+        }
+        for ( size_t i = 0; i < sizeof(random); i++ ) {
+            snprintf(hex + i * 2, 3, "%02x", random[i]);
+        }
+        token = hex;
+
+        if ( ! SPIExecuteCommand("DECLARE jsonapi_" + token + " NO SCROLL CURSOR WITH HOLD FOR " + GetTopQuery(), SPI_OK_UTILITY) ) {
+            return false;
+        }
+        page_cursors_[token].signature_ = signature;
+        page_cursors_[token].last_used_ = time(NULL);
+    } else {
+        PageCursorMap::const_iterator it = page_cursors_.find(token);
+        if ( page_cursors_.end() == it ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_NOT_FOUND).SetMessage(NULL, "page[cursor] does not exist or has expired")
+            .SetSourceParam("page[cursor]=%s", token.c_str());
+            return false;
+        }
+        if ( it->second.signature_ != signature ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "page[cursor] was opened by a request with different resource, filters or sort")
+            .SetSourceParam("page[cursor]=%s", token.c_str());
+            return false;
+        }
+    }
+
+    /* cursor is gone if the transaction that declared it was rolled back */
+    portal = SPI_cursor_find(("jsonapi_" + token).c_str());
+    if ( NULL == portal ) {
+        page_cursors_.erase(token);
+        AddError(JSONAPI_MAKE_SQLSTATE("JA011"), E_HTTP_NOT_FOUND).SetMessage(NULL, "page[cursor] does not exist or has expired")
+        .SetSourceParam("page[cursor]=%s", token.c_str());
+        return false;
+    }
+
+    PG_TRY();
+    {
+        SPI_cursor_fetch(portal, true, q_page_size_);
+        ereport(DEBUG3, (errmsg_internal("jsonapi: %s SPI_processed=%d", __FUNCTION__, (int)SPI_processed)));
+    }
+    PG_CATCH();
+    {
+        HandleSPIError(curContext);
+        rv = false;
+    }
+    PG_END_TRY();
+
+    if ( rv ) {
+        /* a rollback of the sub-transaction would drop the cursor it declared or fetched from */
+        spi_release_sub_transaction_ = true;
+        if ( SPI_processed < q_page_size_ ) {
+            ClosePageCursor(token);
+        } else {
+            page_cursors_[token].last_used_ = time(NULL);
+            last_page_cursor_ = token;
+        }
+    }
+
+    return rv;
+}
+
+/**
+ * @brief Close the cursor of a page[cursor] token and forget it.
+ */
+void pg_jsonapi::QueryBuilder::ClosePageCursor (const std::string& a_token)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s a_token:%s", __FUNCTION__, a_token.c_str())));
+
+    Portal portal = SPI_cursor_find(("jsonapi_" + a_token).c_str());
+    if ( NULL != portal ) {
+        SPI_cursor_close(portal);
+    }
+    page_cursors_.erase(a_token);
+}
+
+/**
+ * @brief Close cursors of page[cursor] tokens not used for longer than page-cursor-ttl.
+ */
+void pg_jsonapi::QueryBuilder::ExpirePageCursors ()
+{
+    time_t now = time(NULL);
+
+    PageCursorMap::iterator it = page_cursors_.begin();
+    while ( page_cursors_.end() != it ) {
+        const std::string token = it->first;
+        const bool        expired = ( difftime(now, it->second.last_used_) > config_->PageCursorTtl() );
+        ++it;
+        if ( expired ) {
+            ClosePageCursor(token);
+        }
+    }
+}
+
+/**
+ * @brief Identify the rows of a page[cursor], a token can only be used by requests with the same signature.
+ */
+std::string pg_jsonapi::QueryBuilder::GetPageCursorSignature ()
+{
+    return rq_base_url_ + '\n' + rq_user_id_ + '\n' + rq_company_id_ + '\n'
+         + rq_accounting_schema_ + '\n' + rq_sharded_schema_ + '\n' + rq_company_schema_ + '\n' + rq_accounting_prefix_ + '\n'
+         + GetTopQuery();
+}
+
+void pg_jsonapi::QueryBuilder::AddInClause (const std::string& a_column, StringSet a_values)
+{
+    if ( a_values.size() ) {
+        const char* comma = "";
+        q_buffer_ += a_column + " IN (";
+        for ( StringSet::const_iterator val = a_values.begin(); val != a_values.end(); ++val ) {
+            q_buffer_ += comma;
+            OperationRequest::AddQuotedStringToBuffer(q_buffer_, (*val).c_str(), /*quote*/ true);
+            comma = ",";
+        }
+        q_buffer_ += ")";
+    }
+}
+
+/**
+ * @brief GetTopQuery
+ */
+const std::string& pg_jsonapi::QueryBuilder::GetTopQuery (bool a_count_rows, bool a_apply_filters)
+{
+    const ResourceConfig& rc = config_->GetResource(GetResourceType());
+    std::string condition_start = "";
+    std::string condition_separator = "";
+    std::string condition_operator = "";
+
+    q_buffer_.clear();
+    q_buffer_ = "SELECT ";
+
+    if ( a_count_rows ) {
+        if ( rc.FunctionSupportsCountColumn() ) {
+            q_buffer_ += rc.GetPGFunctionCountColumn();
+        } else {
+            q_buffer_ += " COUNT( ";
+            q_buffer_ += rc.GetPGQueryColId();
+            q_buffer_ += " ) ";
+        }
+    } else {
+        q_buffer_ += rc.GetPGQueryColumns();
+    }
+
+    q_buffer_ += " FROM ";
+
+    rc.AddPGQueryFromItem(q_buffer_);
+    if ( rc.IsQueryFromAttributesFunction() ) {
+        q_buffer_ += ", " + rc.GetPGQueryAttributesFunction() + "(";
+        rc.AddPGQueryFromItem(q_buffer_);
+        q_buffer_ += ".*) pgf ";
+    }
+    if ( rc.IsQueryFromFunction() )
+    {
+        q_buffer_ +=  "(";
+        condition_separator = ",";
+        condition_operator = " := ";
+    } else {
+        condition_start = " WHERE ";
+        condition_separator = " AND ";
+        condition_operator = " = ";
+        /* company column */
+        if ( rc.GetPGQueryCompanyColumn().size() ) {
+            q_buffer_ += condition_start + "\"" + rc.GetPGQueryCompanyColumn() + "\" = " + GetRequestCompany();
+            condition_start = condition_separator;
+        }
+    }
+
+    /* query condition */
+    if ( rc.GetPGQueryCondition().size() ) {
+        q_buffer_ += condition_start + rc.GetPGQueryCondition();
+        condition_start = condition_separator;
+    }
+
+    if ( a_apply_filters ) {
+        if ( ! rq_filter_param_.empty() ) {
+
+            if ( '=' == rq_filter_param_[rq_filter_param_.length()-1] ) {
+                q_buffer_ += condition_start + rq_filter_param_.substr(0,rq_filter_param_.length()-1) + " IS NULL";
+            } else {
+                if ( rc.IsQueryFromFunction() ) {
+                    q_buffer_ += condition_start + rc.GetPGFunctionArgFilter() + condition_operator;
+                    OperationRequest::AddQuotedStringToBuffer(q_buffer_, rq_filter_param_.c_str(), /*quote*/ true);
+                } else {
+                    q_buffer_ += condition_start + "(" + rq_filter_param_ + ")";
+                }
+            }
+            condition_start = condition_separator;
+        }
+    }
+
+    for ( StringMap::iterator res = rq_filter_field_param_.begin(); res != rq_filter_field_param_.end(); ++res ) {
         if ( a_apply_filters || (    rc.IsQueryFromFunction()
                                  && (   rc.GetPGFunctionArgAccountingSchema() == res->first
                                      || rc.GetPGFunctionArgAccountingPrefix() == res->first
@@ -1192,7 +1747,8 @@ const std::string& pg_jsonapi::QueryBuilder::GetTopQuery (bool a_count_rows, boo
             }
         }
 
-        if ( q_page_size_ || ( GetResourceType().length() && IsCollection() ) ) {
+        /* rows of a page[cursor] are limited when fetched from the cursor */
+        if ( ( q_page_size_ || ( GetResourceType().length() && IsCollection() ) ) && ! HasPageCursor() ) {
             char offset_buffer[32];
             char limit_buffer[32];
 
@@ -1338,47 +1894,72 @@ const std::string& pg_jsonapi::QueryBuilder::GetInclusionQuery (const std::strin
  * @return @li true if data is valid
  *         @li false if an error occurs
  */
-bool pg_jsonapi::QueryBuilder::ProcessQueryResult(const std::string& a_type, size_t a_depth)
+bool pg_jsonapi::QueryBuilder::ProcessQueryResult(const std::string& a_type, size_t a_depth, uint32* o_fetched)
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s a_type:%s a_depth:%zd", __FUNCTION__, a_type.c_str(), a_depth)));
 
     StringSet new_ids;
+    uint32    fetched = 0;
+    bool      done    = false;
+
+    /* rows fetched from a cursor are processed batch by batch, otherwise there's a single batch */
+    while ( ! done ) {
+        fetched += SPI_processed;
+        done     = ( NULL == q_cursor_ || SPI_processed < config_->FetchBatchSize() );
+
+        if ( fetched > config_->GetResource(a_type).PageLimit() ) {
+            SPICloseCursor();
+            if ( 0 == a_depth ) {
+                AddError(JSONAPI_MAKE_SQLSTATE("JA019"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "too many values returned for resource '%s', specify a page size that will not exceed %u results", a_type.c_str(), config_->GetResource(a_type).PageLimit());
+            } else {
+                AddError(JSONAPI_MAKE_SQLSTATE("JA020"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "too many values returned for resource '%s', specify a page size that will not exceed %u results", a_type.c_str(), config_->GetResource(a_type).PageLimit());
+            }
+            return false;
+        }
 
-    if ( SPI_processed > config_->GetResource(a_type).PageLimit() ) {
-        if ( 0 == a_depth ) {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA019"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "too many values returned for resource '%s', specify a page size that will not exceed %u results", a_type.c_str(), config_->GetResource(a_type).PageLimit());
-        } else {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA020"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "too many values returned for resource '%s', specify a page size that will not exceed %u results", a_type.c_str(), config_->GetResource(a_type).PageLimit());
+        if ( done && q_required_count_ && q_required_count_ != fetched ) {
+            SPICloseCursor();
+            if( 0 == fetched ) {
+                AddError(JSONAPI_MAKE_SQLSTATE("JA015"), E_HTTP_NOT_FOUND)
+                .SetMessage(NULL,
+                                    "expected %zu item%s of resource '%s', statement: %s",
+                                    q_required_count_, q_required_count_>1? "s":"", a_type.c_str(), q_buffer_.c_str());
+            } else {
+                AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR)
+                .SetMessage(NULL,
+                                    "expected %zu item%s of resource '%s', statement: %s",
+                                    q_required_count_, q_required_count_>1? "s":"", a_type.c_str(), q_buffer_.c_str());
+            }
+
+            return false;
         }
-        return false;
-    }
 
-    if ( q_required_count_ && q_required_count_ != SPI_processed ) {
-        if( 0 == SPI_processed ) {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA015"), E_HTTP_NOT_FOUND)
-            .SetMessage(NULL,
-                                "expected %zu item%s of resource '%s', statement: %s",
-                                q_required_count_, q_required_count_>1? "s":"", a_type.c_str(), q_buffer_.c_str());
-        } else {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR)
-            .SetMessage(NULL,
-                                "expected %zu item%s of resource '%s', statement: %s",
-                                q_required_count_, q_required_count_>1? "s":"", a_type.c_str(), q_buffer_.c_str());
+        if ( SPI_processed ) {
+            if ( ! ProcessAttributes(a_type, a_depth, &new_ids) ) {
+                SPICloseCursor();
+                return false;
+            }
+            if ( NULL != q_cursor_ ) {
+                ReleaseBatch(a_type);
+            }
         }
 
-        return false;
+        if ( ! done && ! SPIFetchCursor() ) {
+            return false;
+        }
     }
+    SPICloseCursor();
 
-    if ( HasRelated() && !IsRelationship() && a_type == config_->GetResource(GetResourceType()).GetFieldResourceType(GetRelated()) ) {
-        q_data_[a_type].top_processed_ = SPI_processed;
+    if ( NULL != o_fetched ) {
+        *o_fetched = fetched;
     }
 
-    if ( 0 == SPI_processed ) {
-        return true;
+    if ( HasRelated() && !IsRelationship() && a_type == config_->GetResource(GetResourceType()).GetFieldResourceType(GetRelated()) ) {
+        q_data_[a_type].top_processed_ = fetched;
     }
 
-    if ( ! ProcessAttributes(a_type, a_depth, &new_ids) ) {
-        return false;
+    if ( 0 == fetched ) {
+        return true;
     }
 
     if ( 0 == a_depth || config_->IsCompound() || rq_include_param_.size() ) {
@@ -1402,7 +1983,7 @@ bool pg_jsonapi::QueryBuilder::ProcessQueryResult(const std::string& a_type, siz
     StringSetMapIterator it = q_to_be_included_.begin();
     while ( q_to_be_included_.end() != it ) {
         std::string type = it->first;
-        if ( ! SPIExecuteCommand(GetInclusionQuery(type).c_str(), SPI_OK_SELECT) ) {
+        if ( ! config_->ValidateIncluded(type) || ! SPIExecuteQuery(GetInclusionQuery(type)) ) {
             return false;
         }
         q_data_[type].requested_ids_.insert(it->second.begin(),it->second.end());
@@ -1416,6 +1997,35 @@ bool pg_jsonapi::QueryBuilder::ProcessQueryResult(const std::string& a_type, siz
     return true;
 }
 
+/**
+ * @brief Serialize type, id and attributes of rows fetched in the last batch and free their tuples.
+ *
+ * Each batch keeps its own buffer, freed by SerializeResource once all of its rows were written,
+ * so serialized heads and the response don't both hold the whole page.
+ */
+void pg_jsonapi::QueryBuilder::ReleaseBatch (const std::string& a_type)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s a_type:%s SPI_processed:%d", __FUNCTION__, a_type.c_str(), (int)SPI_processed)));
+
+    ResourceData& rd    = q_data_[a_type];
+    uint32        from  = rd.processed_ - SPI_processed;
+    int           batch = (int) rd.heads_.size();
+
+    rd.heads_.push_back(StringInfoData());
+    rd.heads_pending_.push_back(rd.processed_ - from);
+
+    StringInfoData& heads = rd.heads_.back();
+    initStringInfo(&heads);
+    for ( uint32 row = from; row < rd.processed_; row++ ) {
+        rd.items_[row].head_batch_  = batch;
+        rd.items_[row].head_offset_ = heads.len;
+        SerializeResourceHead(heads, a_type, rd, row);
+        rd.items_[row].head_len_    = heads.len - rd.items_[row].head_offset_;
+    }
+    rd.ReleaseTuples(from, rd.processed_);
+    SPI_freetuptable(SPI_tuptable);
+}
+
 /**
  * @brief Obtain data to respond to a GET request.
  *
@@ -1426,6 +2036,10 @@ bool pg_jsonapi::QueryBuilder::FetchData()
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 
+    if ( page_cursors_.size() ) {
+        ExpirePageCursors();
+    }
+
     if ( 1 == rq_totals_param_ && ( !IsTopQueryFromFunction() || TopFunctionSupportsCounts() ) ) {
         /* count items to be returned from main query using filters */
         if ( ! SPIExecuteCommand(GetTopQuery(true, true).c_str(), SPI_OK_SELECT) ) {
@@ -1453,22 +2067,30 @@ bool pg_jsonapi::QueryBuilder::FetchData()
     }
 
     /* execute the main query as read-only */
-    if ( ! SPIExecuteCommand(GetTopQuery().c_str(), SPI_OK_SELECT) ) {
-        return false;
-    }
+    if ( TopFunctionReturnsJson() ) {
+        if ( ! SPIExecuteCommand(GetTopQuery().c_str(), SPI_OK_SELECT) ) {
+            return false;
+        }
 
-    q_data_[GetResourceType()].top_processed_ = SPI_processed;
+        q_data_[GetResourceType()].top_processed_ = SPI_processed;
 
-    if ( TopFunctionReturnsJson() ) {
         if ( ! ProcessFunctionJsonResult(GetResourceType()) ) {
             return false;
         }
     } else {
+        if ( HasPageCursor() ) {
+            if ( ! SPIFetchPageCursor() ) {
+                return false;
+            }
+        } else if ( ! SPIExecuteQuery(GetTopQuery()) ) {
+            return false;
+        }
+
         if ( IsIndividual() ) {
             q_required_count_ = 1;
         }
 
-        if ( ! ProcessQueryResult(GetResourceType(), 0) ) {
+        if ( ! ProcessQueryResult(GetResourceType(), 0, &q_data_[GetResourceType()].top_processed_) ) {
             return false;
         }
     }
@@ -1526,7 +2148,7 @@ bool pg_jsonapi::QueryBuilder::ExecuteOperations()
     StringSetMapIterator it = q_to_be_included_.begin();
     while ( q_to_be_included_.end() != it ) {
         std::string type = it->first;
-        if ( ! SPIExecuteCommand(GetInclusionQuery(type).c_str(), SPI_OK_SELECT) ) {
+        if ( ! config_->ValidateIncluded(type) || ! SPIExecuteQuery(GetInclusionQuery(type)) ) {
             return false;
         }
         q_data_[type].requested_ids_.insert(it->second.begin(),it->second.end());
@@ -1574,17 +2196,60 @@ void pg_jsonapi::QueryBuilder::SerializeRelationshipData (StringInfoData& a_resp
 }
 
 /**
- * @brief Serialize one resource data into jsonapi format.
+ * @brief Build fragment cache key of the deformed row: session output settings, type, id,
+ *        row version (relation oid, xmin and ctid), columns and requested fields.
+ *
+ * The relation is identified by its oid, as its name is unqualified when the tenant schema comes from search_path.
+ *
+ * @return @li true if resource has a row version and fragment may be cached
+ *         @li false otherwise
  */
-void pg_jsonapi::QueryBuilder::SerializeResource (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row) const
+bool pg_jsonapi::QueryBuilder::MakeFragmentKey (std::string& o_key, const std::string& a_type, const ResourceData& a_rd) const
 {
-    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+    o_key.clear();
+    if ( -1 == a_rd.version_col_ || a_rd.nulls_[a_rd.version_col_] ) {
+        return false;
+    }
+
+    const ResourceConfig& rc      = config_->GetResource(a_type);
+    text*                 version = DatumGetTextPP(a_rd.values_[a_rd.version_col_]);
+
+    o_key  = q_fragment_key_prefix_;
+    o_key += '\x1f' + a_type + '\x1f' + a_rd.items_[a_rd.deformed_row_].id_ + '\x1f';
+    o_key.append(VARDATA_ANY(version), VARSIZE_ANY_EXHDR(version));
+    o_key += '\x1f' + a_rd.columns_signature_ + '\x1f';
+    if ( rq_fields_param_.count(a_type) ) {
+        for ( StringSet::const_iterator field = rq_fields_param_.at(a_type).begin(); field != rq_fields_param_.at(a_type).end(); ++field ) {
+            o_key += *field + ',';
+        }
+    }
+    o_key += ( 1 == rq_null_param_ || (-1 == rq_null_param_ && rc.ShowNull()) ) ? "\x1fnull" : "\x1f";
+
+    return true;
+}
+
+/**
+ * @brief Serialize type, id and attributes of one resource, the part depending only on its row.
+ */
+void pg_jsonapi::QueryBuilder::SerializeResourceHead (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row)
+{
+    TupleDesc   res_tupdesc = a_rd.tupdesc_;
+    const char* res_id      = a_rd.items_[a_row].id_;
+    int         start_len   = a_response.len;
+    std::string fragment_key;
+
+    if ( IsExport() ) {
+        SerializeExportHead(a_response, a_type, a_rd, a_row);
+        return;
+    }
 
-    TupleDesc   res_tupdesc = a_rd.tupdesc_;
-    const char* res_id      = a_rd.items_[a_row].id_;
-    HeapTuple   res_tuple   = a_rd.items_[a_row].res_tuple_;
+    a_rd.DeformRow(a_row);
 
-    a_rd.items_[a_row].serialized_ = true;
+    /* nothing else to do if this row version is cached */
+    if ( fragment_cache_.IsEnabled() && MakeFragmentKey(fragment_key, a_type, a_rd) && fragment_cache_.Append(fragment_key, &a_response) ) {
+        ereport(DEBUG4, (errmsg_internal("jsonapi: %s resource:%s id:%s fragment from cache", __FUNCTION__, a_type.c_str(), res_id)));
+        return;
+    }
 
     /* serialize resource with type and id */
     appendStringInfo(&a_response, "{\"type\":\"%s\",\"id\":\"%s\"", a_type.c_str(), res_id);
@@ -1594,14 +2259,13 @@ void pg_jsonapi::QueryBuilder::SerializeResource (StringInfoData& a_response, co
 
     for (int col = 1; col <= res_tupdesc->natts; col++) {
         const char* attname = NameStr(TupleDescAttr(res_tupdesc,col-1)->attname);
-        bool  is_null;
-        Datum datum;
-        TYPCATEGORY attcat = TYPCATEGORY_UNKNOWN;
 
+        if ( col - 1 == a_rd.version_col_ ) {
+            continue;
+        }
         ereport(DEBUG4, (errmsg_internal("jsonapi: %s resource:%s attname:%s type:%s oid:%d category:%c", __FUNCTION__, a_type.c_str(), attname, SPI_gettype(res_tupdesc,col), TupleDescAttr(res_tupdesc,col-1)->atttypid, TypeCategory(TupleDescAttr(res_tupdesc,col-1)->atttypid) )));
         if ( config_->GetResource(a_type).IsValidAttribute(attname) && IsRequestedField(a_type, attname) ) {
-            datum = SPI_getbinval(res_tuple, res_tupdesc, col, &is_null);
-            if ( is_null ) {
+            if ( a_rd.nulls_[col-1] ) {
                 if ( 1 == rq_null_param_ || (-1 == rq_null_param_ && config_->GetResource(a_type).ShowNull()) ) {
                     appendStringInfo(&a_response, "%s\"%s\":null", field_start, attname);
                     field_start = ",";
@@ -1609,66 +2273,7 @@ void pg_jsonapi::QueryBuilder::SerializeResource (StringInfoData& a_response, co
             } else {
                 appendStringInfo(&a_response, "%s\"%s\":", field_start, attname);
                 field_start = ",";
-                switch (TupleDescAttr(res_tupdesc,col-1)->atttypid) {
-
-                    case CHAROID:
-                        appendStringInfo(&a_response, "%c", DatumGetChar(datum));
-                        break;
-
-                    case VARCHAROID:
-                    case TEXTOID:
-                    case DATEOID:
-                    case TIMESTAMPOID:
-                    case TIMESTAMPTZOID:
-                    case XMLOID:
-                        escape_json(&a_response, SPI_getvalue(res_tuple, res_tupdesc, col));
-                        break;
-
-                    case INT2OID:
-                        appendStringInfo(&a_response, "%hd", DatumGetInt16(datum));
-                        break;
-
-                    case INT4OID:
-                        appendStringInfo(&a_response, "%d", DatumGetInt32(datum));
-                        break;
-
-                    case INT8OID:
-                        appendStringInfo(&a_response, "%ld", DatumGetInt64(datum));
-                        break;
-
-                    case FLOAT4OID:
-                        appendStringInfo(&a_response, "%f", DatumGetFloat4(datum));
-                        break;
-
-                    case FLOAT8OID:
-                        appendStringInfo(&a_response, "%lf", DatumGetFloat8(datum));
-                        break;
-
-                    case BOOLOID:
-                        appendStringInfo(&a_response, "%s", DatumGetFloat8(datum) ? "true" : "false");
-                        break;
-
-                    case JSONOID:
-                    case JSONBOID:
-                            ereport(DEBUG2, (errmsg_internal("jsonapi: %s *** JSON *** resource:%s attname:%s type:%s oid:%d category:%c", __FUNCTION__, a_type.c_str(), attname, SPI_gettype(res_tupdesc,col), TupleDescAttr(res_tupdesc,col-1)->atttypid, TypeCategory(TupleDescAttr(res_tupdesc,col-1)->atttypid) )));
-                    case NUMERICOID:
-                        appendStringInfo(&a_response, "%s", SPI_getvalue(res_tuple, res_tupdesc, col));
-                        break;
-
-                    default:
-                        attcat = TypeCategory(TupleDescAttr(res_tupdesc,col-1)->atttypid);
-                        if ( TYPCATEGORY_ARRAY == attcat ) {
-                            /* convert arrays using to_json */
-                            pg_jsonapi::array_to_json_internal(datum, &a_response, false);
-                        } else if ( TYPCATEGORY_ENUM == attcat ) {
-                            /* convert enumerations as text */
-                            escape_json(&a_response, SPI_getvalue(res_tuple, res_tupdesc, col));
-                        } else {
-                            ereport(WARNING, (errmsg_internal("jsonapi: %s resource:%s attname:%s type:%s oid:%d category:%c", __FUNCTION__, a_type.c_str(), attname, SPI_gettype(res_tupdesc,col), TupleDescAttr(res_tupdesc,col-1)->atttypid, TypeCategory(TupleDescAttr(res_tupdesc,col-1)->atttypid) )));
-                            escape_json(&a_response, SPI_getvalue(res_tuple, res_tupdesc, col));
-                        }
-                        break;
-                }
+                SerializeAttributeValue(a_response, a_type, a_rd, col);
             }
         }
     }
@@ -1676,8 +2281,152 @@ void pg_jsonapi::QueryBuilder::SerializeResource (StringInfoData& a_response, co
         appendStringInfoChar(&a_response, '}'); // attributes end
     }
 
+    if ( ! fragment_key.empty() && ! q_parallel_.IsActive() ) {
+        fragment_cache_.Put(fragment_key, a_response.data + start_len, a_response.len - start_len);
+    }
+}
+
+/**
+ * @brief Serialize value of a not null attribute of the deformed row, a_col is 1-based.
+ */
+void pg_jsonapi::QueryBuilder::SerializeAttributeValue (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, int a_col)
+{
+    TupleDesc   res_tupdesc = a_rd.tupdesc_;
+    Datum       datum       = a_rd.values_[a_col-1];
+    TYPCATEGORY attcat      = TYPCATEGORY_UNKNOWN;
+    const char* attname     = NameStr(TupleDescAttr(res_tupdesc,a_col-1)->attname);
+
+    switch (TupleDescAttr(res_tupdesc,a_col-1)->atttypid) {
+
+        case CHAROID:
+            appendStringInfo(&a_response, "%c", DatumGetChar(datum));
+            break;
+
+        case DATEOID:
+            if ( ! q_iso_dates_ || ! JsonWriter::AppendDate(&a_response, DatumGetDateADT(datum)) ) {
+                JsonWriter::AppendEscaped(&a_response, a_rd.GetValue(a_col-1));
+            }
+            break;
+
+        case TIMESTAMPOID:
+            if ( ! q_iso_dates_ || ! JsonWriter::AppendTimestamp(&a_response, DatumGetTimestamp(datum)) ) {
+                JsonWriter::AppendEscaped(&a_response, a_rd.GetValue(a_col-1));
+            }
+            break;
+
+        case TIMESTAMPTZOID:
+            if ( ! q_iso_dates_ || ! JsonWriter::AppendTimestampTz(&a_response, DatumGetTimestampTz(datum), q_session_timezone_) ) {
+                JsonWriter::AppendEscaped(&a_response, a_rd.GetValue(a_col-1));
+            }
+            break;
+
+        case VARCHAROID:
+        case TEXTOID:
+            q_parallel_.AppendText(&a_response, datum);
+            break;
+
+        case XMLOID:
+            JsonWriter::AppendEscaped(&a_response, a_rd.GetValue(a_col-1));
+            break;
+
+        case BYTEAOID:
+            if ( config_->GetResource(a_type).ByteaAsBase64() ) {
+                JsonWriter::AppendBase64(&a_response, datum);
+            } else {
+                JsonWriter::AppendEscaped(&a_response, a_rd.GetValue(a_col-1));
+            }
+            break;
+
+        case INT2OID:
+            q_parallel_.AppendInt64(&a_response, DatumGetInt16(datum));
+            break;
+
+        case INT4OID:
+            q_parallel_.AppendInt64(&a_response, DatumGetInt32(datum));
+            break;
+
+        case INT8OID:
+            q_parallel_.AppendInt64(&a_response, DatumGetInt64(datum));
+            break;
+
+        case FLOAT4OID:
+            q_parallel_.AppendFloat4(&a_response, DatumGetFloat4(datum));
+            break;
+
+        case FLOAT8OID:
+            q_parallel_.AppendFloat8(&a_response, DatumGetFloat8(datum));
+            break;
+
+        case BOOLOID:
+            JsonWriter::AppendBool(&a_response, DatumGetBool(datum));
+            break;
+
+        case JSONOID:
+            JsonWriter::AppendJson(&a_response, datum);
+            break;
+
+        case JSONBOID:
+            JsonWriter::AppendJsonb(&a_response, datum);
+            break;
+
+        case NUMERICOID:
+            JsonWriter::AppendNumeric(&a_response, datum);
+            break;
+
+        default:
+            attcat = TypeCategory(TupleDescAttr(res_tupdesc,a_col-1)->atttypid);
+            if ( TYPCATEGORY_ARRAY == attcat ) {
+                /* convert arrays of common types in place, others using to_json */
+                if ( ! JsonWriter::AppendArray(&a_response, datum) ) {
+                    pg_jsonapi::array_to_json_internal(datum, &a_response, false);
+                }
+            } else if ( TYPCATEGORY_ENUM == attcat ) {
+                /* convert enumerations as text */
+                JsonWriter::AppendEscaped(&a_response, a_rd.GetValue(a_col-1));
+            } else {
+                ereport(WARNING, (errmsg_internal("jsonapi: %s resource:%s attname:%s type:%s oid:%d category:%c", __FUNCTION__, a_type.c_str(), attname, SPI_gettype(res_tupdesc,a_col), TupleDescAttr(res_tupdesc,a_col-1)->atttypid, TypeCategory(TupleDescAttr(res_tupdesc,a_col-1)->atttypid) )));
+                JsonWriter::AppendEscaped(&a_response, a_rd.GetValue(a_col-1));
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Serialize one resource data into jsonapi format.
+ */
+void pg_jsonapi::QueryBuilder::SerializeResource (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    const char* res_id      = a_rd.items_[a_row].id_;
+
+    int         start_len   = a_response.len;
+    size_t      start_deferred = q_parallel_.DeferredBytes();
+
+    a_rd.items_[a_row].serialized_ = true;
+
+    /* serialize resource with type, id and attributes, unless it was done while fetching rows */
+    if ( -1 != a_rd.items_[a_row].head_batch_ ) {
+        StringInfoData& heads = a_rd.heads_[a_rd.items_[a_row].head_batch_];
+
+        appendBinaryStringInfo(&a_response, heads.data + a_rd.items_[a_row].head_offset_, a_rd.items_[a_row].head_len_);
+        if ( 0 == --a_rd.heads_pending_[a_rd.items_[a_row].head_batch_] ) {
+            pfree(heads.data);
+            heads.data = NULL;
+        }
+    } else {
+        SerializeResourceHead(a_response, a_type, a_rd, a_row);
+    }
+
+    if ( IsExport() ) {
+        SerializeExportTail(a_response, a_type, a_rd, a_row);
+        a_rd.serialized_bytes_ += a_response.len - start_len;
+        a_rd.serialized_rows_++;
+        return;
+    }
+
     /* serialize relationships */
-    field_start = ",\"relationships\":{";
+    const char* field_start = ",\"relationships\":{";
     for ( ResourceConfig::RelationshipMap::const_iterator rel = config_->GetResource(a_type).GetRelationships().begin(); rel != config_->GetResource(a_type).GetRelationships().end(); ++rel ) {
         ereport(DEBUG3, (errmsg_internal("jsonapi: %s res=%s rel=%s", __FUNCTION__, a_type.c_str(), rel->first.c_str())));
 
@@ -1703,6 +2452,9 @@ void pg_jsonapi::QueryBuilder::SerializeResource (StringInfoData& a_response, co
 
     /* resource end */
     appendStringInfoChar(&a_response, '}');
+
+    a_rd.serialized_bytes_ += a_response.len - start_len + q_parallel_.DeferredBytes() - start_deferred;
+    a_rd.serialized_rows_++;
 }
 
 /**
@@ -1736,6 +2488,62 @@ void pg_jsonapi::QueryBuilder::SerializeErrors (StringInfoData& a_response)
     appendStringInfoChar(&a_response, ']');
 }
 
+/**
+ * @brief Resolve settings used while serializing, they can't change during the request.
+ */
+void pg_jsonapi::QueryBuilder::PrepareSerialization ()
+{
+    q_iso_dates_        = ( USE_ISO_DATES == DateStyle );
+    q_session_timezone_ = session_timezone;
+
+    /* cached fragments depend on the settings used by type output functions */
+    q_fragment_key_prefix_.clear();
+    if ( config_ ) {
+        if ( q_stream_ ) {
+            q_stream_->SetChunkSize(config_->StreamChunkSize());
+        }
+        fragment_cache_.SetBudget(config_->FragmentCacheSize());
+        if ( fragment_cache_.IsEnabled() ) {
+            const char* settings[] = { "DateStyle", "IntervalStyle", "TimeZone", "extra_float_digits", "bytea_output" };
+            q_fragment_key_prefix_ = rq_base_url_;
+            for ( size_t i = 0; i < sizeof(settings)/sizeof(settings[0]); ++i ) {
+                const char* value = GetConfigOption(settings[i], true, false);
+                q_fragment_key_prefix_ += '\x1f';
+                q_fragment_key_prefix_ += ( NULL != value ? value : "" );
+            }
+            q_fragment_key_prefix_ += '\x1f';
+        }
+    }
+}
+
+/**
+ * @brief Hand response written so far to the stream, if any, once it reaches the chunk size.
+ *
+ * Skeleton written while values are deferred to threads is never flushed.
+ */
+void pg_jsonapi::QueryBuilder::FlushChunk (StringInfoData& a_response)
+{
+    if ( NULL != q_stream_ && ! q_parallel_.IsActive() && q_stream_->IsFull(a_response) ) {
+        q_stream_->Flush(a_response, q_http_status_);
+    }
+}
+
+/**
+ * @brief Append the json result of a function, in chunks when streaming so it's never copied whole to the buffer.
+ */
+void pg_jsonapi::QueryBuilder::AppendJsonFunctionResult (StringInfoData& a_response, const JsonValue& a_value)
+{
+    if ( NULL == q_stream_ || NULL != a_value.jsonb_ || 0 == q_stream_->ChunkSize() ) {
+        a_value.AppendTo(&a_response);
+    } else {
+        for ( size_t offset = 0; offset < a_value.len_; offset += q_stream_->ChunkSize() ) {
+            appendBinaryStringInfo(&a_response, a_value.data_ + offset, (int) Min(q_stream_->ChunkSize(), a_value.len_ - offset));
+            FlushChunk(a_response);
+        }
+    }
+    FlushChunk(a_response);
+}
+
 /**
  * @brief Serialize top-level response.
  */
@@ -1743,14 +2551,21 @@ void pg_jsonapi::QueryBuilder::SerializeResponse (StringInfoData& a_response)
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 
-    if ( NeedsSearchPath() && q_old_search_path_.size() ) {
-        std::string set_cmd;
-        set_cmd += "SET LOCAL search_path to ";
-        set_cmd += q_old_search_path_;
-        SPIExecuteCommand(set_cmd.c_str(), SPI_OK_UTILITY);
+    /* a batch keeps search_path until its last request */
+    if ( NeedsSearchPath() && q_old_search_path_.size() && ! batch_ ) {
+        if ( spi_sub_transaction_ ) {
+            SPISetSearchPath(q_old_search_path_);
+        } else if ( spi_connected_ ) {
+            /* set without sub-transaction, there's no rollback to reset it */
+            (void) set_config_option("search_path", q_old_search_path_.c_str(), PGC_USERSET, PGC_S_SESSION, GUC_ACTION_LOCAL, true, 0, false);
+        }
     }
 
-    if ( "GET" == rq_method_ || E_EXT_NONE == rq_extension_ || E_EXT_BULK == rq_extension_ ) {
+    PrepareSerialization();
+
+    if ( IsExport() && 0 == q_errors_.size() ) {
+        SerializeExport(a_response);
+    } else if ( "GET" == rq_method_ || E_EXT_NONE == rq_extension_ || E_EXT_BULK == rq_extension_ ) {
         appendStringInfoChar(&a_response, '{');
         if ( q_errors_.size() ) {
             SerializeErrors(a_response);
@@ -1774,9 +2589,14 @@ void pg_jsonapi::QueryBuilder::SerializeResponse (StringInfoData& a_response)
 
             if ( "GET" == rq_method_ || E_EXT_BULK == rq_extension_ ) {
                 if ( TopFunctionReturnsJson() ) {
-                    appendStringInfoString(&a_response, q_json_function_data_);
-                    if ( NULL != q_json_function_included_ ) {
-                        appendStringInfo(&a_response, ",\"included\":%s",q_json_function_included_);
+                    /* function results can be huge, buffer is enlarged once and each value copied only once */
+                    if ( NULL == q_stream_ ) {
+                        enlargeStringInfo(&a_response, (int) ( q_json_function_data_.Size() + q_json_function_included_.Size() + 16 ));
+                    }
+                    AppendJsonFunctionResult(a_response, q_json_function_data_);
+                    if ( q_json_function_included_.IsSet() ) {
+                        appendStringInfoString(&a_response, ",\"included\":");
+                        AppendJsonFunctionResult(a_response, q_json_function_included_);
                     }
                 }
                 else if ( IsRelationship() ) {
@@ -1785,12 +2605,24 @@ void pg_jsonapi::QueryBuilder::SerializeResponse (StringInfoData& a_response)
                 } else {
                     SerializeFetchData(a_response);
                 }
-                if ( 1 == rq_totals_param_ ) {
+                if ( 1 == rq_totals_param_ || HasPageCursor() ) {
+                    const char* separator = "";
                     appendStringInfo(&a_response, ",\"meta\":{");
                     if ( rq_operations_.size() && rq_operations_[0].SerializeObservedInMeta(a_response) ) {
-                        appendStringInfoChar(&a_response, ',');
+                        separator = ",";
+                    }
+                    if ( 1 == rq_totals_param_ ) {
+                        appendStringInfo(&a_response, "%s\"total\":\"%zd\",\"grand-total\":\"%zd\"", separator, q_top_total_rows_, q_top_grand_total_rows_);
+                        separator = ",";
+                    }
+                    if ( HasPageCursor() ) {
+                        if ( last_page_cursor_.empty() ) {
+                            appendStringInfo(&a_response, "%s\"cursor\":null", separator);
+                        } else {
+                            appendStringInfo(&a_response, "%s\"cursor\":\"%s\"", separator, last_page_cursor_.c_str());
+                        }
                     }
-                    appendStringInfo(&a_response, "\"total\":\"%zd\",\"grand-total\":\"%zd\"}", q_top_total_rows_, q_top_grand_total_rows_);
+                    appendStringInfoChar(&a_response, '}');
                 }
                 if ( ( 1 == rq_links_param_ || (-1 == rq_links_param_ && config_ && config_->ShowLinks()) ) && ( !IsRelationship() || q_errors_.size() ) ) {
                     appendStringInfo(&a_response, ",\"links\":{\"self\":\"%s\"}", rq_url_encoded_.c_str());
@@ -1841,6 +2673,7 @@ void pg_jsonapi::QueryBuilder::SerializeResponse (StringInfoData& a_response)
                 rq_operations_[i].SerializeErrors(a_response);
             }
             appendStringInfoChar(&a_response, '}');
+            FlushChunk(a_response);
         }
         appendStringInfoChar(&a_response, ']');
     } else {
@@ -1850,9 +2683,95 @@ void pg_jsonapi::QueryBuilder::SerializeResponse (StringInfoData& a_response)
         appendStringInfoChar(&a_response, '}');
     }
 
+    /* flat records would make estimates too low for jsonapi responses */
+    if ( ! IsExport() ) {
+        UpdateRowSizeEstimates();
+    }
+
+    if ( fragment_cache_.IsEnabled() ) {
+        ereport(DEBUG1, (errmsg_internal("jsonapi: fragment cache hits:" UINT64_FORMAT " misses:" UINT64_FORMAT " hit-ratio:%.3f entries:%zu bytes:%zu",
+                                         fragment_cache_.Hits(), fragment_cache_.Misses(), fragment_cache_.HitRatio(), fragment_cache_.Entries(), fragment_cache_.Bytes())));
+    }
+
     return;
 }
 
+/**
+ * @brief Expected response size, from the rows to be serialized and the bytes per row learned in previous requests.
+ *
+ * @return estimated size in bytes, zero if unknown
+ */
+size_t pg_jsonapi::QueryBuilder::EstimateResponseSize () const
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    size_t estimate = 0;
+
+    if ( HasErrors() ) {
+        return 0;
+    }
+    for ( ResourceDataMap::const_iterator rd = q_data_.begin(); rd != q_data_.end(); ++rd ) {
+        std::map<std::string, size_t>::const_iterator row_size = row_size_estimate_.find(GetRowSizeKey(rd->first));
+        if ( row_size_estimate_.end() != row_size ) {
+            estimate += rd->second.processed_ * row_size->second;
+        }
+    }
+    ereport(DEBUG2, (errmsg_internal("jsonapi: %s estimated response size %zu", __FUNCTION__, estimate)));
+
+    return estimate;
+}
+
+/**
+ * @brief Key of bytes per row estimates, rows of a type are only comparable when serialized with
+ *        the same sparse fieldset and as resources or relationship identifiers.
+ */
+std::string pg_jsonapi::QueryBuilder::GetRowSizeKey (const std::string& a_type) const
+{
+    std::string key = rq_base_url_ + "/" + a_type;
+
+    if ( IsRelationship() ) {
+        key += "/relationships";
+    }
+    StringSetMap::const_iterator fields = rq_fields_param_.find(a_type);
+    if ( rq_fields_param_.end() != fields ) {
+        const char* separator = "?fields=";
+        for ( StringSet::const_iterator field = fields->second.begin(); field != fields->second.end(); ++field ) {
+            key += separator + *field;
+            separator = ",";
+        }
+    }
+    return key;
+}
+
+/**
+ * @brief Refine bytes per row estimates with the rows serialized in this request.
+ *
+ * Running average giving 1/4 of the weight to the last request.
+ */
+void pg_jsonapi::QueryBuilder::UpdateRowSizeEstimates ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    static const size_t k_max_estimates = 4096;
+
+    /* fieldsets are chosen by clients, estimates are learned again rather than growing without limit */
+    if ( row_size_estimate_.size() > k_max_estimates ) {
+        row_size_estimate_.clear();
+    }
+    for ( ResourceDataMap::const_iterator rd = q_data_.begin(); rd != q_data_.end(); ++rd ) {
+        if ( 0 == rd->second.serialized_rows_ ) {
+            continue;
+        }
+        size_t  observed = rd->second.serialized_bytes_ / rd->second.serialized_rows_;
+        size_t& estimate = row_size_estimate_[GetRowSizeKey(rd->first)];
+        if ( 0 == estimate ) {
+            estimate = observed;
+        } else {
+            estimate = ( 3 * estimate + observed ) / 4;
+        }
+    }
+}
+
 /**
  * @brief Serialize response for fetch request.
  */
@@ -1863,6 +2782,17 @@ void pg_jsonapi::QueryBuilder::SerializeFetchData (StringInfoData& a_response)
     const std::string&  top_type     = ( HasRelated() && !IsRelationship() ) ? config_->GetResource(GetResourceType()).GetFieldResourceType(GetRelated()) : GetResourceType();
     bool                top_is_array = ( HasRelated() && !IsRelationship() &&  config_->GetResource(GetResourceType()).IsToManyRelationship(GetRelated()) ) ? true : ! IsIndividual();
 
+    if ( UsesParallelWriter() ) {
+        StringInfoData skeleton;
+
+        /* values are kept apart from the skeleton and then formatted by threads into the response */
+        initStringInfo(&skeleton);
+        q_parallel_.Begin();
+        SerializeFetchData(skeleton);
+        q_parallel_.End(skeleton, a_response, config_->SerializationThreads());
+        pfree(skeleton.data);
+        return;
+    }
 
     if ( 0 == q_data_[top_type].processed_ ) {
         if ( top_is_array ) {
@@ -1878,6 +2808,7 @@ void pg_jsonapi::QueryBuilder::SerializeFetchData (StringInfoData& a_response)
                 appendStringInfoChar(&a_response, ',');
             }
             SerializeResource(a_response, top_type, q_data_[top_type], row);
+            FlushChunk(a_response);
         }
         if ( top_is_array ) {
             appendStringInfoChar(&a_response, ']' );
@@ -1889,13 +2820,46 @@ void pg_jsonapi::QueryBuilder::SerializeFetchData (StringInfoData& a_response)
     return;
 }
 
+/**
+ * @brief Check if values of the fetched rows should be formatted by threads.
+ *
+ * @return @li true if serialization-threads is set, enough rows were fetched and the response is not streamed
+ *         @li false otherwise, or if values are already being deferred
+ */
+bool pg_jsonapi::QueryBuilder::UsesParallelWriter () const
+{
+    if ( q_parallel_.IsActive() || NULL != q_stream_ || config_->SerializationThreads() <= 1 || ! ParallelWriter::IsAllowed() ) {
+        return false;
+    }
+
+    size_t rows = 0;
+
+    for ( ResourceDataMap::const_iterator res_type = q_data_.begin(); res_type != q_data_.end(); ++res_type ) {
+        rows += res_type->second.processed_;
+    }
+    return rows >= config_->SerializationThreadsMinRows();
+}
+
 /**
  * @brief Serialize top-level included object.
+ *
+ * When called for a relationship request values are formatted by threads as in SerializeFetchData.
  */
 void pg_jsonapi::QueryBuilder::SerializeIncluded (StringInfoData& a_response)
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 
+    if ( ( config_->IsCompound() || rq_include_param_.size() ) && UsesParallelWriter() ) {
+        StringInfoData skeleton;
+
+        initStringInfo(&skeleton);
+        q_parallel_.Begin();
+        SerializeIncluded(skeleton);
+        q_parallel_.End(skeleton, a_response, config_->SerializationThreads());
+        pfree(skeleton.data);
+        return;
+    }
+
     if ( config_->IsCompound() || rq_include_param_.size() ) {
         const char* res_start = ",\"included\":[";
 
@@ -1907,12 +2871,14 @@ void pg_jsonapi::QueryBuilder::SerializeIncluded (StringInfoData& a_response)
                 if ( top_row < rrd.top_processed_ && false == rrd.items_[top_row].serialized_ ) {
                     appendStringInfoString(&a_response, res_start);
                     SerializeResource(a_response, res_type->first, rrd, top_row);
+                    FlushChunk(a_response);
                     res_start = ",";
                 }
             }
             for (uint32 row = rrd.top_processed_; row < rrd.processed_; row++) {
                 appendStringInfoString(&a_response, res_start);
                 SerializeResource(a_response, res_type->first, rrd, row);
+                FlushChunk(a_response);
                 res_start = ",";
             }
         }
@@ -1924,6 +2890,195 @@ void pg_jsonapi::QueryBuilder::SerializeIncluded (StringInfoData& a_response)
     return;
 }
 
+/**
+ * @brief Export top resources as flat records, one per line, without jsonapi document members.
+ */
+void pg_jsonapi::QueryBuilder::SerializeExport (StringInfoData& a_response)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    const std::string& top_type = HasRelated() ? GetRelatedType() : GetResourceType();
+    ResourceData&      rd       = q_data_[top_type];
+
+    if ( E_FORMAT_CSV == rq_format_param_ ) {
+        SerializeExportHeader(a_response, top_type, rd);
+    }
+    for ( uint32 row = 0; row < rd.top_processed_; row++ ) {
+        SerializeResource(a_response, top_type, rd, row);
+        FlushChunk(a_response);
+    }
+}
+
+/**
+ * @brief Serialize CSV header line: id, attributes and relationships, in the order of the records.
+ */
+void pg_jsonapi::QueryBuilder::SerializeExportHeader (StringInfoData& a_response, const std::string& a_type, const ResourceData& a_rd)
+{
+    const ResourceConfig& rc = config_->GetResource(a_type);
+
+    appendStringInfoString(&a_response, "id");
+    if ( NULL != a_rd.tupdesc_ ) {
+        for ( int col = 1; col <= a_rd.tupdesc_->natts; col++ ) {
+            if ( IsExportedAttribute(a_type, a_rd, col) ) {
+                const char* attname = NameStr(TupleDescAttr(a_rd.tupdesc_,col-1)->attname);
+                appendStringInfoChar(&a_response, ',');
+                AppendCsvValue(a_response, attname, strlen(attname));
+            }
+        }
+    }
+    for ( ResourceConfig::RelationshipMap::const_iterator rel = rc.GetRelationships().begin(); rel != rc.GetRelationships().end(); ++rel ) {
+        if ( IsRequestedField(a_type, rel->first) ) {
+            appendStringInfoChar(&a_response, ',');
+            AppendCsvValue(a_response, rel->first.c_str(), rel->first.length());
+        }
+    }
+    appendStringInfoChar(&a_response, '\n');
+}
+
+/**
+ * @brief Serialize id and attributes of one exported record, the part depending only on its row.
+ */
+void pg_jsonapi::QueryBuilder::SerializeExportHead (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row)
+{
+    TupleDesc   res_tupdesc = a_rd.tupdesc_;
+    const char* res_id      = a_rd.items_[a_row].id_;
+    bool        show_null   = ( 1 == rq_null_param_ || (-1 == rq_null_param_ && config_->GetResource(a_type).ShowNull()) );
+
+    a_rd.DeformRow(a_row);
+
+    if ( E_FORMAT_CSV == rq_format_param_ ) {
+        AppendCsvValue(a_response, res_id, strlen(res_id));
+    } else {
+        appendStringInfoString(&a_response, "{\"id\":");
+        JsonWriter::AppendEscaped(&a_response, res_id);
+    }
+
+    for ( int col = 1; col <= res_tupdesc->natts; col++ ) {
+        if ( ! IsExportedAttribute(a_type, a_rd, col) ) {
+            continue;
+        }
+        if ( E_FORMAT_CSV == rq_format_param_ ) {
+            /* null is an empty field, as in COPY */
+            appendStringInfoChar(&a_response, ',');
+            if ( ! a_rd.nulls_[col-1] ) {
+                const char* value = a_rd.GetValue(col-1);
+                AppendCsvValue(a_response, value, strlen(value));
+            }
+        } else if ( a_rd.nulls_[col-1] ) {
+            if ( show_null ) {
+                appendStringInfoChar(&a_response, ',');
+                JsonWriter::AppendEscaped(&a_response, NameStr(TupleDescAttr(res_tupdesc,col-1)->attname));
+                appendStringInfoString(&a_response, ":null");
+            }
+        } else {
+            appendStringInfoChar(&a_response, ',');
+            JsonWriter::AppendEscaped(&a_response, NameStr(TupleDescAttr(res_tupdesc,col-1)->attname));
+            appendStringInfoChar(&a_response, ':');
+            SerializeAttributeValue(a_response, a_type, a_rd, col);
+        }
+    }
+}
+
+/**
+ * @brief Serialize relationship ids of one exported record and end it.
+ *
+ * To-one relationships are written as the related id, to-many as an array of ids (ndjson)
+ * or as ids separated by commas (csv).
+ */
+void pg_jsonapi::QueryBuilder::SerializeExportTail (StringInfoData& a_response, const std::string& a_type, ResourceData& a_rd, uint32 a_row)
+{
+    const ResourceConfig&  rc        = config_->GetResource(a_type);
+    const StringVectorMap& rels      = a_rd.items_[a_row].relationships_;
+    bool                   show_null = ( 1 == rq_null_param_ || (-1 == rq_null_param_ && rc.ShowNull()) );
+
+    for ( ResourceConfig::RelationshipMap::const_iterator rel = rc.GetRelationships().begin(); rel != rc.GetRelationships().end(); ++rel ) {
+        if ( ! IsRequestedField(a_type, rel->first) ) {
+            continue;
+        }
+        StringVectorMap::const_iterator ids = rels.find(rel->first);
+
+        if ( E_FORMAT_CSV == rq_format_param_ ) {
+            appendStringInfoChar(&a_response, ',');
+            if ( rels.end() != ids ) {
+                std::string value;
+                for ( StringVector::const_iterator id = ids->second.begin(); id != ids->second.end(); ++id ) {
+                    if ( id != ids->second.begin() ) {
+                        value += ',';
+                    }
+                    value += *id;
+                }
+                AppendCsvValue(a_response, value.c_str(), value.length());
+            }
+        } else if ( rc.IsToManyRelationship(rel->first) ) {
+            appendStringInfoChar(&a_response, ',');
+            JsonWriter::AppendEscaped(&a_response, rel->first.c_str(), (int) rel->first.length());
+            appendStringInfoString(&a_response, ":[");
+            if ( rels.end() != ids ) {
+                for ( StringVector::const_iterator id = ids->second.begin(); id != ids->second.end(); ++id ) {
+                    if ( id != ids->second.begin() ) {
+                        appendStringInfoChar(&a_response, ',');
+                    }
+                    JsonWriter::AppendEscaped(&a_response, id->c_str(), (int) id->length());
+                }
+            }
+            appendStringInfoChar(&a_response, ']');
+        } else if ( rels.end() != ids && ids->second.size() ) {
+            appendStringInfoChar(&a_response, ',');
+            JsonWriter::AppendEscaped(&a_response, rel->first.c_str(), (int) rel->first.length());
+            appendStringInfoChar(&a_response, ':');
+            JsonWriter::AppendEscaped(&a_response, ids->second.front().c_str(), (int) ids->second.front().length());
+        } else if ( show_null ) {
+            appendStringInfoChar(&a_response, ',');
+            JsonWriter::AppendEscaped(&a_response, rel->first.c_str(), (int) rel->first.length());
+            appendStringInfoString(&a_response, ":null");
+        }
+    }
+
+    if ( E_FORMAT_CSV == rq_format_param_ ) {
+        appendStringInfoChar(&a_response, '\n');
+    } else {
+        appendStringInfoString(&a_response, "}\n");
+    }
+}
+
+/**
+ * @return @li true if attribute a_col (1-based) is exported, the same attributes written in jsonapi format
+ *         @li false otherwise
+ */
+bool pg_jsonapi::QueryBuilder::IsExportedAttribute (const std::string& a_type, const ResourceData& a_rd, int a_col) const
+{
+    const char* attname = NameStr(TupleDescAttr(a_rd.tupdesc_,a_col-1)->attname);
+
+    return a_col - 1 != a_rd.version_col_ && config_->GetResource(a_type).IsValidAttribute(attname) && IsRequestedField(a_type, attname);
+}
+
+/**
+ * @brief Append CSV field, quoted only when needed so that an empty value is told apart from null.
+ */
+void pg_jsonapi::QueryBuilder::AppendCsvValue (StringInfoData& a_response, const char* a_value, size_t a_len)
+{
+    bool quote = ( 0 == a_len );
+
+    for ( size_t i = 0; i < a_len && ! quote; i++ ) {
+        quote = ( ',' == a_value[i] || '"' == a_value[i] || '\n' == a_value[i] || '\r' == a_value[i] );
+    }
+    if ( ! quote ) {
+        appendBinaryStringInfo(&a_response, a_value, (int) a_len);
+        return;
+    }
+
+    appendStringInfoChar(&a_response, '"');
+    for ( const char* quote_char = (const char*) memchr(a_value, '"', a_len); NULL != quote_char; quote_char = (const char*) memchr(a_value, '"', a_len) ) {
+        /* double quotes are doubled */
+        appendBinaryStringInfo(&a_response, a_value, (int) ( quote_char - a_value + 1 ));
+        appendStringInfoChar(&a_response, '"');
+        a_len  -= quote_char - a_value + 1;
+        a_value = quote_char + 1;
+    }
+    appendBinaryStringInfo(&a_response, a_value, (int) a_len);
+    appendStringInfoChar(&a_response, '"');
+}
+
 /**
  * @brief Process postgresql result for executed command when expecting specific json result.
  *
@@ -1937,6 +3092,7 @@ bool pg_jsonapi::QueryBuilder::ProcessFunctionJsonResult(const std::string& a_ty
     bool        rv      = true;
     const char* attname = NULL;
     bool        is_null;
+    Datum       value;
 
     if (  1 != SPI_processed ) {
         if( 0 == SPI_processed ) {
@@ -1964,7 +3120,7 @@ bool pg_jsonapi::QueryBuilder::ProcessFunctionJsonResult(const std::string& a_ty
         AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid query column '%s' returned for resource '%s'", attname, a_type.c_str());
         rv = false;
     }
-    if ( JSONOID != TupleDescAttr(SPI_tuptable->tupdesc,0)->atttypid ) {
+    if ( JSONOID != TupleDescAttr(SPI_tuptable->tupdesc,0)->atttypid && JSONBOID != TupleDescAttr(SPI_tuptable->tupdesc,0)->atttypid ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "column '%s' returned unexpected type(%d) for resource '%s'", attname, TupleDescAttr(SPI_tuptable->tupdesc,0)->atttypid, a_type.c_str());
         rv = false;
     }
@@ -1974,7 +3130,7 @@ bool pg_jsonapi::QueryBuilder::ProcessFunctionJsonResult(const std::string& a_ty
         AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid query column '%s' returned for resource '%s'", attname, a_type.c_str());
         rv = false;
     }
-    if ( JSONOID != TupleDescAttr(SPI_tuptable->tupdesc,1)->atttypid ) {
+    if ( JSONOID != TupleDescAttr(SPI_tuptable->tupdesc,1)->atttypid && JSONBOID != TupleDescAttr(SPI_tuptable->tupdesc,1)->atttypid ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "column '%s' returned unexpected type(%d) for resource '%s'", attname, TupleDescAttr(SPI_tuptable->tupdesc,1)->atttypid, a_type.c_str());
         rv = false;
     }
@@ -1987,27 +3143,27 @@ bool pg_jsonapi::QueryBuilder::ProcessFunctionJsonResult(const std::string& a_ty
         return rv;
     }
 
-    SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &is_null);
+    value = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &is_null);
     if ( is_null ) {
         AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid column '%s' returned for resource '%s', null is invalid", attname, a_type.c_str());
         return false;
     } else {
-        q_json_function_data_ = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
-        if ( IsIndividual() && ('{'!=q_json_function_data_[0] || '}'!=q_json_function_data_[strlen(q_json_function_data_)-1]) ) {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid column '%s' returned for resource '%s', object was expected len=%zd", attname, a_type.c_str(),strlen(q_json_function_data_));
+        q_json_function_data_.Set(value, TupleDescAttr(SPI_tuptable->tupdesc,0)->atttypid);
+        if ( IsIndividual() && ! q_json_function_data_.IsRoot('{') ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid column '%s' returned for resource '%s', object was expected", attname, a_type.c_str());
             return false;
         }
-        if ( IsCollection() && ('['!=q_json_function_data_[0] || ']'!=q_json_function_data_[strlen(q_json_function_data_)-1]) ) {
+        if ( IsCollection() && ! q_json_function_data_.IsRoot('[') ) {
             AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid column '%s' returned for resource '%s', array was expected", attname, a_type.c_str());
             return false;
         }
     }
 
-    SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2, &is_null);
+    value = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2, &is_null);
     if ( !is_null ) {
-        q_json_function_included_ = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2);
-        if ( '['!=q_json_function_included_[0] || ']'!=q_json_function_included_[strlen(q_json_function_included_)-1] ) {
-            AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid column '%s' returned for resource '%s', array was expected len=%zd", attname, a_type.c_str(),strlen(q_json_function_included_));
+        q_json_function_included_.Set(value, TupleDescAttr(SPI_tuptable->tupdesc,1)->atttypid);
+        if ( ! q_json_function_included_.IsRoot('[') ) {
+            AddError(JSONAPI_MAKE_SQLSTATE("JA016"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid column '%s' returned for resource '%s', array was expected", attname, a_type.c_str());
             return false;
         }
     }
@@ -2114,11 +3270,67 @@ void pg_jsonapi::QueryBuilder::GetSettingFromPGConfig (DBConfigValidator a_valid
             } else {
                 validators_regex_[a_validator].push_back(std::regex(validators_root[i].asString(), std::regex_constants::ECMAScript|std::regex_constants::icase));
             }
+            validators_prefilter_[a_validator].Add(validators_root[i].asString());
+            ereport(DEBUG1, (errmsg_internal("jsonapi [libversion %s]: %s[%d] literal: '%s'", LIB_VERSION, validators_setting_[a_validator].c_str(), i,
+                                             validators_prefilter_[a_validator].Literal(validators_regex_[a_validator].size() - 1).c_str())));
         }
     }
+    validators_prefilter_[a_validator].Build();
     return;
 }
 
+/**
+ * @brief Search a value for the first rule of a validator it matches.
+ *
+ * The value is scanned once by the prefilter, then rules are searched in configuration order,
+ * skipping those whose required literal is not in the value, so the first matching rule is reported.
+ *
+ * @param a_validator The validator with the rules.
+ * @param a_value The value to search.
+ * @param o_rule Index of the rule that matched.
+ * @param o_match Text that matched.
+ *
+ * @return @li true if a rule matches
+ *         @li false if no rule matches
+ */
+bool pg_jsonapi::QueryBuilder::MatchesValidatorRule (DBConfigValidator a_validator, const std::string& a_value, size_t& o_rule, std::string& o_match)
+{
+    const std::vector<std::regex>& rules        = validators_regex_[a_validator];
+    const bool                     skip_quoted  = ( E_DB_CONFIG_SQL_WHITELIST == a_validator || E_DB_CONFIG_SQL_BLACKLIST == a_validator );
+    std::vector<bool>              candidates;
+    std::smatch                    m;
+
+    validators_prefilter_[a_validator].Candidates(a_value.data(), a_value.length(), candidates);
+    for ( size_t i = 0; i < rules.size(); i++ ) {
+        if ( ! candidates[i] ) {
+            continue;
+        }
+        ereport(DEBUG3, (errmsg_internal("checking [%s] against rule on %s[%zu]", a_value.c_str(), validators_setting_[a_validator].c_str(), i)));
+        if ( SearchValidatorRule(rules[i], a_value, skip_quoted, m) ) {
+            o_rule  = i;
+            o_match = m[0].str();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Search a value with a rule, when @a a_skip_quoted is set matched quoted literals are skipped.
+ */
+bool pg_jsonapi::QueryBuilder::SearchValidatorRule (const std::regex& a_rule, const std::string& a_value, bool a_skip_quoted, std::smatch& o_match)
+{
+    std::string::const_iterator begin = a_value.begin();
+
+    while ( std::regex_search(begin, a_value.end(), o_match, a_rule) ) {
+        if ( ! a_skip_quoted || 0 == o_match[0].length() || '\'' != *o_match[0].first ) {
+            return true;
+        }
+        begin = o_match[0].second;
+    }
+    return false;
+}
+
 void pg_jsonapi::QueryBuilder::InitValidatorsFromPGConfig ()
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
@@ -2131,6 +3343,10 @@ void pg_jsonapi::QueryBuilder::InitValidatorsFromPGConfig ()
     for ( std::map<DBConfigValidator,std::string>::const_iterator it = validators_setting_.begin(); it != validators_setting_.end(); ++it ) {
         GetSettingFromPGConfig(it->first);
     }
+    if ( ! validators_regex_.empty() ) {
+        /* filters of urls already parsed were not checked by these validators */
+        EvictParsedUrls(0);
+    }
     return;
 }
 
@@ -2138,16 +3354,18 @@ bool pg_jsonapi::QueryBuilder::AttributeIsValidUsingXssValidators (const std::st
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s attribute:%s a_value:%s", __FUNCTION__, a_attribute.c_str(), a_value.c_str())));
     if ( validators_regex_.count(E_DB_CONFIG_XSS) && validators_regex_[E_DB_CONFIG_XSS].size() > 0 ) {
-        std::string decoded_filter_ = pg_jsonapi::Utils::urlDecode(a_value.c_str(), a_value.length());
-        std::smatch m;
-        for ( size_t i = 0; i < validators_regex_[E_DB_CONFIG_XSS].size(); i++ ) {
-            const std::string value = std::string(decoded_filter_);
-            ereport(DEBUG3, (errmsg_internal("checking decoded attribute \"%s\" [%s] against rule on %s[%zu]", a_attribute.c_str(), value.c_str(), validators_setting_[E_DB_CONFIG_XSS].c_str(), i)));
-            while (std::regex_search(value, m, validators_regex_[E_DB_CONFIG_XSS][i]) ) {
-                ereport(DEBUG1, (errmsg_internal("match: %s",  m[0].str().c_str())));
-                AddError(JSONAPI_MAKE_SQLSTATE("JA101"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "attribute \"%s\" has invalid value (matched %s[%zu]): %s", a_attribute.c_str(), validators_setting_[E_DB_CONFIG_XSS].c_str(), i, a_value.c_str());
-                return false;
-            }
+        size_t      rule;
+        std::string match;
+        std::string decoded_value;
+        /* values without escapes are checked in place */
+        const bool  escaped = ( NULL != memchr(a_value.data(), '%', a_value.length()) );
+        if ( escaped ) {
+            pg_jsonapi::Utils::urlDecode(decoded_value, a_value.data(), a_value.length());
+        }
+        if ( MatchesValidatorRule(E_DB_CONFIG_XSS, escaped ? decoded_value : a_value, rule, match) ) {
+            ereport(DEBUG1, (errmsg_internal("match: %s",  match.c_str())));
+            AddError(JSONAPI_MAKE_SQLSTATE("JA101"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "attribute \"%s\" has invalid value (matched %s[%zu]): %s", a_attribute.c_str(), validators_setting_[E_DB_CONFIG_XSS].c_str(), rule, a_value.c_str());
+            return false;
         }
     }
 
@@ -2159,23 +3377,17 @@ bool pg_jsonapi::QueryBuilder::FilterIsValidUsingSqlValidators (DBConfigValidato
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s field:%s a_value:%s", __FUNCTION__, a_field, a_value.c_str())));
     if ( validators_regex_.count(a_validator) && validators_regex_[a_validator].size() > 0 ) {
         // URL decode was already made while parsing
-        std::smatch m;
-        for ( size_t i = 0; i < validators_regex_[a_validator].size(); i++ ) {
-            std::string value = std::string(a_value);
-            ereport(DEBUG3, (errmsg_internal("checking filter [%s] against rule on %s[%zu]", value.c_str(), validators_setting_[a_validator].c_str(), i)));
-            while (std::regex_search(value, m, validators_regex_[a_validator][i]) ) {
-                if ('\'' != m[0].str()[0] ) {
-                    ereport(DEBUG1, (errmsg_internal("match: %s",  m[0].str().c_str())));
-                    ErrorObject& e = AddError(JSONAPI_MAKE_SQLSTATE("JA102"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid filter (matched %s[%zu]): %s", validators_setting_[a_validator].c_str(), i, a_value.c_str());
-                    if ( nullptr == a_field ) {
-                        e.SetSourceParam("filter");
-                    } else {
-                        e.SetSourceParam("filter[%s]", a_field);
-                    }
-                    return false;
-                }
-                value = m.suffix().str();
+        size_t      rule;
+        std::string match;
+        if ( MatchesValidatorRule(a_validator, a_value, rule, match) ) {
+            ereport(DEBUG1, (errmsg_internal("match: %s",  match.c_str())));
+            ErrorObject& e = AddError(JSONAPI_MAKE_SQLSTATE("JA102"), E_HTTP_BAD_REQUEST).SetMessage(NULL, "invalid filter (matched %s[%zu]): %s", validators_setting_[a_validator].c_str(), rule, a_value.c_str());
+            if ( nullptr == a_field ) {
+                e.SetSourceParam("filter");
+            } else {
+                e.SetSourceParam("filter[%s]", a_field);
             }
+            return false;
         }
     }
 
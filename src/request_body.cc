@@ -0,0 +1,551 @@
+/**
+ * @file request_body.cc Implementation of RequestBodyParser and the operation data it extracts
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "request_body.h"
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "mb/pg_wchar.h"
+#pragma GCC diagnostic pop
+} // extern "C"
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::BodyIdentifier::BodyIdentifier ()
+{
+    kind_      = E_BODY_ABSENT;
+    members_   = 0;
+    type_kind_ = E_BODY_ABSENT;
+    id_kind_   = E_BODY_ABSENT;
+}
+
+/**
+ * @brief Check if this is null or an object with exactly non-empty string members type and id.
+ */
+bool pg_jsonapi::BodyIdentifier::IsValid () const
+{
+    if ( E_BODY_NULL == kind_ ) {
+        return true;
+    }
+    return    E_BODY_OBJECT == kind_
+           && 2 == members_
+           && E_BODY_STRING == type_kind_ && ! type_.empty()
+           && E_BODY_STRING == id_kind_   && ! id_.empty();
+}
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::BodyAttribute::BodyAttribute ()
+{
+    kind_    = E_BODY_ABSENT;
+    is_json_ = false;
+}
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::BodyRelationship::BodyRelationship ()
+{
+    kind_      = E_BODY_ABSENT;
+    members_   = 0;
+    data_kind_ = E_BODY_ABSENT;
+}
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::OperationBody::OperationBody ()
+{
+    patch_kind_         = E_BODY_ABSENT;
+    patch_members_      = 0;
+    patch_op_kind_      = E_BODY_ABSENT;
+    patch_path_kind_    = E_BODY_ABSENT;
+    attributes_kind_    = E_BODY_ABSENT;
+    relationships_kind_ = E_BODY_ABSENT;
+}
+
+/**
+ * @brief Check if data is a scalar: string, number, boolean or null.
+ */
+bool pg_jsonapi::OperationBody::IsConvertibleToString () const
+{
+    return    E_BODY_STRING == data_.kind_ || E_BODY_NUMBER == data_.kind_
+           || E_BODY_BOOL   == data_.kind_ || E_BODY_NULL   == data_.kind_;
+}
+
+/**
+ * @return The attribute with given name, NULL if not in body.
+ */
+const pg_jsonapi::BodyAttribute* pg_jsonapi::OperationBody::FindAttribute (const char* a_name) const
+{
+    for ( BodyAttributeVector::const_iterator attr = attributes_.begin(); attr != attributes_.end(); ++attr ) {
+        if ( attr->name_ == a_name ) {
+            return &(*attr);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::RequestBodyParser::RequestBodyParser ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    lex_           = NULL;
+    slot_          = E_SLOT_ROOT;
+    attribute_     = NULL;
+    relationship_  = NULL;
+    value_start_   = NULL;
+    root_kind_     = E_BODY_ABSENT;
+    root_members_  = 0;
+    root_has_data_ = false;
+    data_kind_     = E_BODY_ABSENT;
+}
+
+/**
+ * @brief Destructor
+ */
+pg_jsonapi::RequestBodyParser::~RequestBodyParser ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+}
+
+/**
+ * @brief Parse the request body in one pass, filling one OperationBody per operation.
+ *
+ * Before PostgreSQL 13 invalid json is reported by pg_parse_json itself, as an error of the statement.
+ *
+ * @return @li true if body is valid json
+ *         @li false otherwise, o_error has the reason
+ */
+bool pg_jsonapi::RequestBodyParser::Parse (const char* a_body, size_t a_body_len, std::string& o_error)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    JsonSemAction sem;
+
+    memset(&sem, 0, sizeof(sem));
+    sem.semstate            = (void*) this;
+    sem.object_start        = ObjectStart;
+    sem.object_end          = ObjectEnd;
+    sem.array_start         = ArrayStart;
+    sem.array_end           = ArrayEnd;
+    sem.object_field_start  = ObjectFieldStart;
+    sem.object_field_end    = ObjectFieldEnd;
+    sem.array_element_start = ArrayElementStart;
+    sem.scalar              = Scalar;
+
+    frames_.clear();
+    operations_.clear();
+    slot_ = E_SLOT_ROOT;
+
+#if PG_MAJORVERSION_NUM >= 16
+    lex_ = makeJsonLexContextCstringLen(NULL, const_cast<char*>(a_body), (int) a_body_len, GetDatabaseEncoding(), true);
+#elif PG_MAJORVERSION_NUM >= 13
+    lex_ = makeJsonLexContextCstringLen(const_cast<char*>(a_body), (int) a_body_len, GetDatabaseEncoding(), true);
+#else
+    lex_ = makeJsonLexContextCstringLen(const_cast<char*>(a_body), (int) a_body_len, true);
+#endif
+
+#if PG_MAJORVERSION_NUM >= 13
+    JsonParseErrorType result = pg_parse_json(lex_, &sem);
+    if ( JSON_SUCCESS != result ) {
+        o_error = json_errdetail(result, lex_);
+    }
+#else
+    pg_parse_json(lex_, &sem);
+#endif
+
+#if PG_MAJORVERSION_NUM >= 16
+    freeJsonLexContext(lex_);
+#endif
+    lex_ = NULL;
+    frames_.clear();
+
+    return o_error.empty();
+}
+
+void pg_jsonapi::RequestBodyParser::PushFrame (FrameKind a_kind, BodyIdentifier* a_identifier, BodyIdentifierVector* a_identifiers)
+{
+    Frame frame;
+
+    frame.kind_        = a_kind;
+    frame.identifier_  = a_identifier;
+    frame.identifiers_ = a_identifiers;
+    frames_.push_back(frame);
+}
+
+pg_jsonapi::BodyValueKind pg_jsonapi::RequestBodyParser::TokenKind (JsonTokenType a_type)
+{
+    switch ( a_type ) {
+        case JSON_TOKEN_STRING:
+            return E_BODY_STRING;
+        case JSON_TOKEN_NUMBER:
+            return E_BODY_NUMBER;
+        case JSON_TOKEN_TRUE:
+        case JSON_TOKEN_FALSE:
+            return E_BODY_BOOL;
+        default:
+            return E_BODY_NULL;
+    }
+}
+
+/**
+ * @brief Keep the kind, and the text of scalars, of the value starting in current slot,
+ *        and push the frame that reads its members or elements.
+ *
+ * @param a_kind  Kind of value.
+ * @param a_token Decoded scalar, NULL for objects and arrays.
+ */
+void pg_jsonapi::RequestBodyParser::BeginValue (BodyValueKind a_kind, const char* a_token)
+{
+    bool           is_container = ( E_BODY_OBJECT == a_kind || E_BODY_ARRAY == a_kind );
+    const char*    text         = ( NULL != a_token && E_BODY_NULL != a_kind ) ? a_token : "";
+    OperationBody* operation    = operations_.empty() ? NULL : &operations_.back();
+
+    if ( ! frames_.empty() && E_FRAME_SKIP == frames_.back().kind_ ) {
+        slot_ = E_SLOT_IGNORED;
+    }
+
+    switch ( slot_ ) {
+        case E_SLOT_ROOT:
+            root_kind_ = a_kind;
+            if ( E_BODY_OBJECT == a_kind ) {
+                PushFrame(E_FRAME_ROOT_OBJECT);
+                return;
+            } else if ( E_BODY_ARRAY == a_kind ) {
+                PushFrame(E_FRAME_ROOT_ARRAY);
+                return;
+            }
+            break;
+
+        case E_SLOT_DATA:
+            data_kind_ = a_kind;
+            if ( E_BODY_OBJECT == a_kind ) {
+                operations_.push_back(OperationBody());
+                operations_.back().data_.kind_ = a_kind;
+                PushFrame(E_FRAME_RESOURCE, &operations_.back().data_);
+                return;
+            } else if ( E_BODY_ARRAY == a_kind ) {
+                PushFrame(E_FRAME_BULK);
+                return;
+            }
+            break;
+
+        case E_SLOT_OPERATION:
+            operation->data_.kind_ = a_kind;
+            if ( E_BODY_OBJECT == a_kind ) {
+                PushFrame(E_FRAME_RESOURCE, &operation->data_);
+                return;
+            } else if ( E_BODY_ARRAY == a_kind ) {
+                PushFrame(E_FRAME_IDENTIFIERS, NULL, &operation->elements_);
+                return;
+            }
+            operation->value_ = text;
+            break;
+
+        case E_SLOT_PATCH:
+            operation->patch_kind_ = a_kind;
+            if ( E_BODY_OBJECT == a_kind ) {
+                PushFrame(E_FRAME_PATCH);
+                return;
+            }
+            break;
+
+        case E_SLOT_PATCH_OP:
+            operation->patch_op_kind_ = a_kind;
+            operation->patch_op_      = text;
+            break;
+
+        case E_SLOT_PATCH_PATH:
+            operation->patch_path_kind_ = a_kind;
+            operation->patch_path_      = text;
+            break;
+
+        case E_SLOT_TYPE:
+            frames_.back().identifier_->type_kind_ = a_kind;
+            frames_.back().identifier_->type_      = text;
+            break;
+
+        case E_SLOT_ID:
+            frames_.back().identifier_->id_kind_ = a_kind;
+            frames_.back().identifier_->id_      = text;
+            break;
+
+        case E_SLOT_ATTRIBUTES:
+            operation->attributes_kind_ = a_kind;
+            if ( E_BODY_OBJECT == a_kind ) {
+                PushFrame(E_FRAME_ATTRIBUTES);
+                return;
+            }
+            break;
+
+        case E_SLOT_ATTRIBUTE:
+            attribute_->kind_    = a_kind;
+            attribute_->is_json_ = ( E_BODY_OBJECT == a_kind );
+            attribute_->value_   = text;
+            attribute_->elements_.clear();
+            if ( E_BODY_ARRAY == a_kind ) {
+                PushFrame(E_FRAME_ATTRIBUTE_ARRAY);
+                return;
+            }
+            break;
+
+        case E_SLOT_ATTRIBUTE_ELEMENT:
+            if ( is_container ) {
+                attribute_->is_json_ = true;
+            } else {
+                attribute_->elements_.push_back(text);
+            }
+            break;
+
+        case E_SLOT_RELATIONSHIPS:
+            operation->relationships_kind_ = a_kind;
+            if ( E_BODY_OBJECT == a_kind ) {
+                PushFrame(E_FRAME_RELATIONSHIPS);
+                return;
+            }
+            break;
+
+        case E_SLOT_RELATIONSHIP:
+            relationship_->kind_ = a_kind;
+            if ( E_BODY_OBJECT == a_kind ) {
+                PushFrame(E_FRAME_RELATIONSHIP);
+                return;
+            }
+            break;
+
+        case E_SLOT_RELATIONSHIP_DATA:
+            relationship_->data_kind_ = a_kind;
+            relationship_->data_.clear();
+            if ( E_BODY_OBJECT == a_kind ) {
+                relationship_->data_.push_back(BodyIdentifier());
+                relationship_->data_.back().kind_ = a_kind;
+                PushFrame(E_FRAME_IDENTIFIER, &relationship_->data_.back());
+                return;
+            } else if ( E_BODY_ARRAY == a_kind ) {
+                PushFrame(E_FRAME_IDENTIFIERS, NULL, &relationship_->data_);
+                return;
+            }
+            break;
+
+        case E_SLOT_IDENTIFIER:
+        {
+            BodyIdentifier& identifier = frames_.back().identifiers_->back();
+            identifier.kind_ = a_kind;
+            if ( E_BODY_OBJECT == a_kind ) {
+                PushFrame(E_FRAME_IDENTIFIER, &identifier);
+                return;
+            }
+            break;
+        }
+
+        case E_SLOT_IGNORED:
+            break;
+    }
+
+    if ( is_container ) {
+        PushFrame(E_FRAME_SKIP);
+    }
+}
+
+JSONAPI_SEM_ACTION_RESULT pg_jsonapi::RequestBodyParser::ObjectStart (void* a_state)
+{
+    static_cast<RequestBodyParser*>(a_state)->BeginValue(E_BODY_OBJECT, NULL);
+    return JSONAPI_SEM_ACTION_OK;
+}
+
+JSONAPI_SEM_ACTION_RESULT pg_jsonapi::RequestBodyParser::ArrayStart (void* a_state)
+{
+    static_cast<RequestBodyParser*>(a_state)->BeginValue(E_BODY_ARRAY, NULL);
+    return JSONAPI_SEM_ACTION_OK;
+}
+
+JSONAPI_SEM_ACTION_RESULT pg_jsonapi::RequestBodyParser::ObjectEnd (void* a_state)
+{
+    static_cast<RequestBodyParser*>(a_state)->frames_.pop_back();
+    return JSONAPI_SEM_ACTION_OK;
+}
+
+/**
+ * @brief An array of attribute values without elements is kept as json, like arrays of objects.
+ */
+JSONAPI_SEM_ACTION_RESULT pg_jsonapi::RequestBodyParser::ArrayEnd (void* a_state)
+{
+    RequestBodyParser* parser = static_cast<RequestBodyParser*>(a_state);
+
+    if ( E_FRAME_ATTRIBUTE_ARRAY == parser->frames_.back().kind_ && parser->attribute_->elements_.empty() ) {
+        parser->attribute_->is_json_ = true;
+    }
+    parser->frames_.pop_back();
+    return JSONAPI_SEM_ACTION_OK;
+}
+
+/**
+ * @brief Find out what the member value is from the object being read and the member name.
+ */
+JSONAPI_SEM_ACTION_RESULT pg_jsonapi::RequestBodyParser::ObjectFieldStart (void* a_state, char* a_fname, bool /* a_isnull */)
+{
+    RequestBodyParser* parser    = static_cast<RequestBodyParser*>(a_state);
+    Frame&             frame     = parser->frames_.back();
+    OperationBody*     operation = parser->operations_.empty() ? NULL : &parser->operations_.back();
+
+    parser->slot_ = E_SLOT_IGNORED;
+    switch ( frame.kind_ ) {
+        case E_FRAME_ROOT_OBJECT:
+            parser->root_members_++;
+            if ( 0 == strcmp("data", a_fname) ) {
+                parser->root_has_data_ = true;
+                parser->slot_          = E_SLOT_DATA;
+            }
+            break;
+
+        case E_FRAME_PATCH:
+            operation->patch_members_++;
+            if ( 0 == strcmp("op", a_fname) ) {
+                parser->slot_ = E_SLOT_PATCH_OP;
+            } else if ( 0 == strcmp("path", a_fname) ) {
+                parser->slot_ = E_SLOT_PATCH_PATH;
+            } else if ( 0 == strcmp("value", a_fname) ) {
+                parser->slot_ = E_SLOT_OPERATION;
+            }
+            break;
+
+        case E_FRAME_RESOURCE:
+            frame.identifier_->members_++;
+            if ( 0 == strcmp("type", a_fname) ) {
+                parser->slot_ = E_SLOT_TYPE;
+            } else if ( 0 == strcmp("id", a_fname) ) {
+                parser->slot_ = E_SLOT_ID;
+            } else if ( 0 == strcmp("attributes", a_fname) ) {
+                parser->slot_ = E_SLOT_ATTRIBUTES;
+            } else if ( 0 == strcmp("relationships", a_fname) ) {
+                parser->slot_ = E_SLOT_RELATIONSHIPS;
+            } else if ( operation->unknown_member_.empty() ) {
+                operation->unknown_member_ = a_fname;
+            }
+            break;
+
+        case E_FRAME_IDENTIFIER:
+            frame.identifier_->members_++;
+            if ( 0 == strcmp("type", a_fname) ) {
+                parser->slot_ = E_SLOT_TYPE;
+            } else if ( 0 == strcmp("id", a_fname) ) {
+                parser->slot_ = E_SLOT_ID;
+            }
+            break;
+
+        case E_FRAME_ATTRIBUTES:
+            /* as with any json object the last member with a repeated name wins */
+            parser->attribute_ = const_cast<BodyAttribute*>(operation->FindAttribute(a_fname));
+            if ( NULL == parser->attribute_ ) {
+                operation->attributes_.push_back(BodyAttribute());
+                parser->attribute_ = &operation->attributes_.back();
+                parser->attribute_->name_ = a_fname;
+            }
+            parser->value_start_ = parser->lex_->token_start;
+            parser->slot_        = E_SLOT_ATTRIBUTE;
+            break;
+
+        case E_FRAME_RELATIONSHIPS:
+            operation->relationships_.push_back(BodyRelationship());
+            parser->relationship_        = &operation->relationships_.back();
+            parser->relationship_->name_ = a_fname;
+            parser->slot_                = E_SLOT_RELATIONSHIP;
+            break;
+
+        case E_FRAME_RELATIONSHIP:
+            parser->relationship_->members_++;
+            if ( 0 == strcmp("data", a_fname) ) {
+                parser->slot_ = E_SLOT_RELATIONSHIP_DATA;
+            }
+            break;
+
+        default:
+            break;
+    }
+    return JSONAPI_SEM_ACTION_OK;
+}
+
+/**
+ * @brief Keep json text of attribute values that are not scalars nor arrays of scalars.
+ */
+JSONAPI_SEM_ACTION_RESULT pg_jsonapi::RequestBodyParser::ObjectFieldEnd (void* a_state, char* a_fname, bool /* a_isnull */)
+{
+    RequestBodyParser* parser = static_cast<RequestBodyParser*>(a_state);
+
+    if ( E_FRAME_ATTRIBUTES == parser->frames_.back().kind_ && parser->attribute_->is_json_ ) {
+        parser->attribute_->value_.assign(parser->value_start_, parser->lex_->prev_token_terminator - parser->value_start_);
+        parser->attribute_->elements_.clear();
+    }
+    /* names are copied by the parser for each member and not used after this */
+    if ( NULL != a_fname ) {
+        pfree(a_fname);
+    }
+    return JSONAPI_SEM_ACTION_OK;
+}
+
+JSONAPI_SEM_ACTION_RESULT pg_jsonapi::RequestBodyParser::ArrayElementStart (void* a_state, bool /* a_isnull */)
+{
+    RequestBodyParser* parser = static_cast<RequestBodyParser*>(a_state);
+    Frame&             frame  = parser->frames_.back();
+
+    parser->slot_ = E_SLOT_IGNORED;
+    switch ( frame.kind_ ) {
+        case E_FRAME_ROOT_ARRAY:
+            parser->operations_.push_back(OperationBody());
+            parser->slot_ = E_SLOT_PATCH;
+            break;
+
+        case E_FRAME_BULK:
+            parser->operations_.push_back(OperationBody());
+            parser->slot_ = E_SLOT_OPERATION;
+            break;
+
+        case E_FRAME_IDENTIFIERS:
+            frame.identifiers_->push_back(BodyIdentifier());
+            parser->slot_ = E_SLOT_IDENTIFIER;
+            break;
+
+        case E_FRAME_ATTRIBUTE_ARRAY:
+            parser->slot_ = E_SLOT_ATTRIBUTE_ELEMENT;
+            break;
+
+        default:
+            break;
+    }
+    return JSONAPI_SEM_ACTION_OK;
+}
+
+JSONAPI_SEM_ACTION_RESULT pg_jsonapi::RequestBodyParser::Scalar (void* a_state, char* a_token, JsonTokenType a_type)
+{
+    static_cast<RequestBodyParser*>(a_state)->BeginValue(TokenKind(a_type), a_token);
+    /* token is a copy made by the parser for this call only */
+    if ( NULL != a_token ) {
+        pfree(a_token);
+    }
+    return JSONAPI_SEM_ACTION_OK;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file request_body.h Declaration of RequestBodyParser and the operation data it extracts
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CLD_PG_JSONAPI_REQUEST_BODY_H
+#define CLD_PG_JSONAPI_REQUEST_BODY_H
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "postgres.h"
+#if PG_MAJORVERSION_NUM >= 13
+#include "common/jsonapi.h"
+#else
+#include "utils/jsonapi.h"
+#endif
+#pragma GCC diagnostic pop
+} // extern "C"
+
+#include "resource_config.h"
+
+/* semantic actions return a parse result since PostgreSQL 16 */
+#if PG_MAJORVERSION_NUM >= 16
+#define JSONAPI_SEM_ACTION_RESULT JsonParseErrorType
+#define JSONAPI_SEM_ACTION_OK     JSON_SUCCESS
+#else
+#define JSONAPI_SEM_ACTION_RESULT void
+#define JSONAPI_SEM_ACTION_OK
+#endif
+
+namespace pg_jsonapi
+{
+    typedef enum {
+        E_BODY_ABSENT,
+        E_BODY_NULL,
+        E_BODY_STRING,
+        E_BODY_NUMBER,
+        E_BODY_BOOL,
+        E_BODY_OBJECT,
+        E_BODY_ARRAY
+    } BodyValueKind;
+
+    /**
+     * @brief Operation data seen as a resource identifier object, also keeps type and id of a resource object.
+     */
+    class BodyIdentifier
+    {
+    public: // Attributes
+        BodyValueKind kind_;
+        size_t        members_;
+        BodyValueKind type_kind_;
+        std::string   type_;
+        BodyValueKind id_kind_;
+        std::string   id_;
+
+    public: // Methods
+        BodyIdentifier ();
+
+        bool IsValid () const;
+    };
+
+    typedef std::vector<BodyIdentifier> BodyIdentifierVector;
+
+    /**
+     * @brief Member of "attributes": strings are kept decoded, other values as json text,
+     *        arrays without objects or arrays as their decoded elements.
+     */
+    class BodyAttribute
+    {
+    public: // Attributes
+        std::string   name_;
+        BodyValueKind kind_;
+        bool          is_json_;    // object, empty array or array of objects, value_ is its json text
+        std::string   value_;
+        StringVector  elements_;
+
+    public: // Methods
+        BodyAttribute ();
+    };
+
+    typedef std::vector<BodyAttribute> BodyAttributeVector;
+
+    /**
+     * @brief Member of "relationships", with the identifiers of its "data".
+     */
+    class BodyRelationship
+    {
+    public: // Attributes
+        std::string          name_;
+        BodyValueKind        kind_;
+        size_t               members_;
+        BodyValueKind        data_kind_;
+        BodyIdentifierVector data_;    // one identifier for object data
+
+    public: // Methods
+        BodyRelationship ();
+    };
+
+    typedef std::vector<BodyRelationship> BodyRelationshipVector;
+
+    /**
+     * @brief Everything an operation uses from the request body: the data of a request,
+     *        of an element of a BULK request or of a JSON Patch operation, and the members of that operation.
+     */
+    class OperationBody
+    {
+    public: // Attributes - JSON Patch operation
+        BodyValueKind          patch_kind_;
+        size_t                 patch_members_;
+        BodyValueKind          patch_op_kind_;
+        std::string            patch_op_;
+        BodyValueKind          patch_path_kind_;
+        std::string            patch_path_;
+
+    public: // Attributes - operation data
+        BodyIdentifier         data_;                 // kind, type and id of data
+        std::string            value_;                // scalar data, decoded
+        std::string            unknown_member_;       // first member of resource object other than type, id, attributes or relationships
+        BodyValueKind          attributes_kind_;
+        BodyAttributeVector    attributes_;
+        BodyValueKind          relationships_kind_;
+        BodyRelationshipVector relationships_;
+        BodyIdentifierVector   elements_;             // array data
+
+    public: // Methods
+        OperationBody ();
+
+        bool                   IsConvertibleToString () const;
+        const BodyAttribute*   FindAttribute         (const char* a_name) const;
+    };
+
+    typedef std::vector<OperationBody> OperationBodyVector;
+
+    /**
+     * @brief Request body parser driven by the events of PostgreSQL's pg_parse_json.
+     *
+     * No document tree is built: each event fills the OperationBody of the operation being read,
+     * keeping only the values later used to validate the operation and to write its commands.
+     */
+    class RequestBodyParser
+    {
+    private:
+
+        typedef enum {
+            E_FRAME_ROOT_OBJECT,
+            E_FRAME_ROOT_ARRAY,       // JSON Patch operations
+            E_FRAME_BULK,             // "data" array
+            E_FRAME_PATCH,            // JSON Patch operation object
+            E_FRAME_RESOURCE,
+            E_FRAME_ATTRIBUTES,
+            E_FRAME_ATTRIBUTE_ARRAY,
+            E_FRAME_RELATIONSHIPS,
+            E_FRAME_RELATIONSHIP,
+            E_FRAME_IDENTIFIERS,
+            E_FRAME_IDENTIFIER,
+            E_FRAME_SKIP              // value not used, only its end matters
+        } FrameKind;
+
+        typedef enum {
+            E_SLOT_ROOT,
+            E_SLOT_DATA,
+            E_SLOT_OPERATION,
+            E_SLOT_PATCH,
+            E_SLOT_PATCH_OP,
+            E_SLOT_PATCH_PATH,
+            E_SLOT_TYPE,
+            E_SLOT_ID,
+            E_SLOT_ATTRIBUTES,
+            E_SLOT_ATTRIBUTE,
+            E_SLOT_ATTRIBUTE_ELEMENT,
+            E_SLOT_RELATIONSHIPS,
+            E_SLOT_RELATIONSHIP,
+            E_SLOT_RELATIONSHIP_DATA,
+            E_SLOT_IDENTIFIER,
+            E_SLOT_IGNORED
+        } SlotKind;
+
+        typedef struct {
+            FrameKind             kind_;
+            BodyIdentifier*       identifier_;    // resource object or identifier being read
+            BodyIdentifierVector* identifiers_;   // array of identifiers being read
+        } Frame;
+
+        typedef std::vector<Frame> FrameVector;
+
+    private: // Attributes
+        JsonLexContext*     lex_;
+        FrameVector         frames_;
+        SlotKind            slot_;            // what the next value is
+        BodyAttribute*      attribute_;       // attribute being read
+        BodyRelationship*   relationship_;    // relationship being read
+        const char*         value_start_;     // start of attribute value in body
+
+    public: // Attributes - results
+        BodyValueKind       root_kind_;
+        size_t              root_members_;
+        bool                root_has_data_;
+        BodyValueKind       data_kind_;
+        OperationBodyVector operations_;
+
+    private: // Methods
+        void PushFrame  (FrameKind a_kind, BodyIdentifier* a_identifier = NULL, BodyIdentifierVector* a_identifiers = NULL);
+        void BeginValue (BodyValueKind a_kind, const char* a_token);
+
+        static BodyValueKind TokenKind (JsonTokenType a_type);
+
+        static JSONAPI_SEM_ACTION_RESULT ObjectStart       (void* a_state);
+        static JSONAPI_SEM_ACTION_RESULT ObjectEnd         (void* a_state);
+        static JSONAPI_SEM_ACTION_RESULT ArrayStart        (void* a_state);
+        static JSONAPI_SEM_ACTION_RESULT ArrayEnd          (void* a_state);
+        static JSONAPI_SEM_ACTION_RESULT ObjectFieldStart  (void* a_state, char* a_fname, bool a_isnull);
+        static JSONAPI_SEM_ACTION_RESULT ObjectFieldEnd    (void* a_state, char* a_fname, bool a_isnull);
+        static JSONAPI_SEM_ACTION_RESULT ArrayElementStart (void* a_state, bool a_isnull);
+        static JSONAPI_SEM_ACTION_RESULT Scalar            (void* a_state, char* a_token, JsonTokenType a_type);
+
+    public: // Methods
+        RequestBodyParser ();
+        virtual ~RequestBodyParser ();
+
+        bool Parse (const char* a_body, size_t a_body_len, std::string& o_error);
+    };
+
+} // namespace pg_jsonapi
+
+#endif // CLD_PG_JSONAPI_REQUEST_BODY_H
@@ -31,6 +31,9 @@ pg_jsonapi::ResourceConfig::ResourceConfig (const DocumentConfig* a_parent_doc,
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s %s", __FUNCTION__, type_.c_str())));
 
+    compiled_     = true;
+    pg_validated_ = false;
+
     q_main_.schema_.clear();
     q_main_.use_rq_accounting_schema_ = parent_doc_->UseRequestAccountingSchema();
     q_main_.use_rq_sharded_schema_    = parent_doc_->UseRequestShardedSchema();
@@ -40,6 +43,8 @@ pg_jsonapi::ResourceConfig::ResourceConfig (const DocumentConfig* a_parent_doc,
     q_main_.returns_json_             = false;
     q_main_.needs_search_path_        = false;
     q_main_.id_from_rowset_           = false;
+    q_main_.bytea_base64_             = false;
+    q_main_.cache_fragments_          = false;
     q_main_.col_id_                   = "id";
     q_main_.company_column_.clear();
     q_main_.condition_.clear();
@@ -369,6 +374,86 @@ bool pg_jsonapi::ResourceConfig::SetRelationship(FieldType a_type, const Jsonapi
     return true;
 }
 
+/**
+ * @brief Keep the parsed json object of the resource configuration, to be compiled by Compile() on first use.
+ */
+void pg_jsonapi::ResourceConfig::SetConfig (const JsonapiJson::Value& a_res_config)
+{
+    config_   = a_res_config;
+    compiled_ = false;
+}
+
+/**
+ * @brief Compile the configuration kept by SetConfig(), only once.
+ *
+ * Values are set on a new resource, so when the configuration is invalid it's left uncompiled
+ * and errors are reported again by each request that uses it.
+ *
+ * @return @li true if operation succeeds
+ *         @li false if an error occurs
+ */
+bool pg_jsonapi::ResourceConfig::Compile ()
+{
+    if ( compiled_ ) {
+        return true;
+    }
+
+    ResourceConfig compiled(parent_doc_, type_);
+    if ( ! compiled.SetValues(config_) ) {
+        return false;
+    }
+    *this = compiled;
+
+    return true;
+}
+
+/**
+ * @return @li true if rows and attributes are read from a table or view, even before the resource is compiled
+ *         @li false if pg-function or pg-attributes-function is configured
+ */
+bool pg_jsonapi::ResourceConfig::ReadsOnlyRelation () const
+{
+    if ( compiled_ ) {
+        return ! ( IsQueryFromFunction() || IsQueryFromAttributesFunction() );
+    }
+    return ! ( config_.isMember("pg-function") || config_.isMember("pg-attributes-function") );
+}
+
+/**
+ * @brief Get the types of the resources this one is related to, even before the resource is compiled.
+ *
+ * Malformed relationships of a configuration not yet compiled are skipped, compiling reports them.
+ */
+void pg_jsonapi::ResourceConfig::GetRelatedTypes (StringSet& o_types) const
+{
+    if ( compiled_ ) {
+        for ( RelationshipMap::const_iterator rel = relationships_.begin(); rel != relationships_.end(); ++rel ) {
+            o_types.insert(rel->second.resource_type_);
+        }
+        return;
+    }
+
+    const char* members[] = {"to-one", "to-many"};
+    for ( size_t m = 0; m < sizeof(members)/sizeof(members[0]); ++m ) {
+        if ( ! config_.isMember(members[m]) || ! config_[members[m]].isArray() ) {
+            continue;
+        }
+        const JsonapiJson::Value& relations = config_[members[m]];
+        for ( unsigned int index = 0; index < relations.size(); index++ ) {
+            if ( relations[index].isString() ) {
+                o_types.insert(relations[index].asString());
+            } else if ( relations[index].isObject() && 1 == relations[index].size() ) {
+                const std::string key = relations[index].getMemberNames()[0];
+                if ( relations[index][key].isObject() && relations[index][key].isMember("resource") && relations[index][key]["resource"].isString() ) {
+                    o_types.insert(relations[index][key]["resource"].asString());
+                } else {
+                    o_types.insert(key);
+                }
+            }
+        }
+    }
+}
+
 /**
  * @brief Set the resource configuration from parsed json object.
  *
@@ -394,6 +479,8 @@ bool pg_jsonapi::ResourceConfig::SetValues(const JsonapiJson::Value& a_config)
     q_main_.page_size_ = parent_doc_->PageSize();
     q_main_.show_links_ = parent_doc_->ShowLinks();
     q_main_.show_null_ = parent_doc_->ShowNull();
+    q_main_.bytea_base64_ = false;
+    q_main_.cache_fragments_ = false;
     q_main_.col_id_ = "id";
     q_main_.company_column_.clear();
     q_main_.condition_.clear();
@@ -410,7 +497,9 @@ bool pg_jsonapi::ResourceConfig::SetValues(const JsonapiJson::Value& a_config)
         {"pg-set-search_path",          &q_main_.needs_search_path_},
         {"id-from-rowset",              &q_main_.id_from_rowset_},
         {"show-links",                  &q_main_.show_links_},
-        {"show-null",                   &q_main_.show_null_}
+        {"show-null",                   &q_main_.show_null_},
+        {"bytea-as-base64",             &q_main_.bytea_base64_},
+        {"cache-fragments",             &q_main_.cache_fragments_}
     };
     UIntOption uint_options[] = {
         {"job-ttr",                     &q_main_.job_ttr_},
@@ -618,6 +707,17 @@ bool pg_jsonapi::ResourceConfig::SetValues(const JsonapiJson::Value& a_config)
         }
     }
 
+    if ( q_main_.cache_fragments_ ) {
+        if ( IsQueryFromFunction() || IsQueryFromAttributesFunction() ) {
+            g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA017"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "conflicting keys 'resources[\"%s\"][\"cache-fragments\"]' and 'resources[\"%s\"][\"%s\"]'",
+                        type_.c_str(), type_.c_str(), IsQueryFromFunction() ? "pg-function" : "pg-attributes-function");
+            rv = false;
+        } else {
+            /* row version identifies cached fragments, it's never serialized; tableoid tells tenant schemas apart */
+            q_main_.select_columns_ += std::string(",(tableoid::text || '/' || xmin::text || ctid::text) AS \"") + RowVersionColumn() + "\"";
+        }
+    }
+
     if ( a_config.isMember("observed") ) {
         if ( ! a_config["observed"].isArray() ) {
             g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA017"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid value for 'resources[\"%s\"][\"observed\"]', array is expected", type_.c_str());
@@ -661,6 +761,24 @@ Oid pg_jsonapi::ResourceConfig::GetRelid(std::string a_type, std::string a_relna
     return relid;
 }
 
+/**
+ * @brief Check that the row version of cache-fragments can be read from the relation of the resource.
+ *
+ * Only rows of a table have xmin and ctid, views and foreign tables don't.
+ *
+ * @return @li true if cache-fragments is not used or the relation is a table
+ *         @li false if an error occurs
+ */
+bool pg_jsonapi::ResourceConfig::ValidateRowVersion (Oid a_relid) const
+{
+    if ( q_main_.cache_fragments_ && RELKIND_RELATION != get_rel_relkind(a_relid) ) {
+        g_qb->AddError(JSONAPI_MAKE_SQLSTATE("JA017"), E_HTTP_INTERNAL_SERVER_ERROR).SetMessage(NULL, "invalid key 'resources[\"%s\"][\"cache-fragments\"]', relation %s is not a table",
+                    type_.c_str(), q_main_.table_.c_str());
+        return false;
+    }
+    return true;
+}
+
 /**
  * @brief Validate the resource configuration against the database if possible.
  *        If resource depends on schema or table preffix, return with success.
@@ -672,6 +790,10 @@ bool pg_jsonapi::ResourceConfig::ValidatePG(bool a_specific_request)
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s %s - %s", __FUNCTION__, type_.c_str(), a_specific_request ? "true" : "false")));
 
+    if ( ! a_specific_request && pg_validated_ ) {
+        return true;
+    }
+
     if ( a_specific_request && q_main_.needs_search_path_ ) {
         g_qb->RequireSearchPath();
     }
@@ -719,13 +841,15 @@ bool pg_jsonapi::ResourceConfig::ValidatePG(bool a_specific_request)
                     table_name = g_qb->GetRequestAccountingPrefix();
                 }
                 table_name += q_main_.table_;
-                if ( ! OidIsValid( GetRelid(GetType(), GetPGQuerySchema(), table_name) ) ) {
+                Oid relid = GetRelid(GetType(), GetPGQuerySchema(), table_name);
+                if ( ! OidIsValid(relid) || ! ValidateRowVersion(relid) ) {
                     return false;
                 }
             }
         }
     } else {
-        if ( ! OidIsValid( GetRelid(GetType(), q_main_.schema_, q_main_.table_) ) ) {
+        Oid relid = GetRelid(GetType(), q_main_.schema_, q_main_.table_);
+        if ( ! OidIsValid(relid) || ! ValidateRowVersion(relid) ) {
             return false;
         }
     }
@@ -766,6 +890,8 @@ bool pg_jsonapi::ResourceConfig::ValidatePG(bool a_specific_request)
                 }
             }
         }
+    } else {
+        pg_validated_ = true;
     }
 
     return true;
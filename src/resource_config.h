@@ -27,6 +27,7 @@ extern "C" {
 #pragma GCC diagnostic ignored "-Wcast-qual"
 #include "postgres.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_class.h"
 #include "utils/lsyscache.h"
 #pragma GCC diagnostic pop
 } // extern "C"
@@ -118,6 +119,8 @@ namespace pg_jsonapi
             uint             page_limit_;
             bool             show_links_;
             bool             show_null_;
+            bool             bytea_base64_;
+            bool             cache_fragments_;
             std::string      col_id_;
             std::string      company_column_;
             std::string      condition_;
@@ -163,6 +166,10 @@ namespace pg_jsonapi
 
         const DocumentConfig* parent_doc_;
 
+        JsonapiJson::Value config_;       // configuration not yet compiled by SetValues
+        bool               compiled_;
+        bool               pg_validated_; // relations not depending on the request were found on catalog
+
         std::string       type_;
         StringSet         attributes_;
         RelationshipMap   relationships_;
@@ -180,14 +187,21 @@ namespace pg_jsonapi
         bool    SetObserved          (const JsonapiJson::Value& a_observed_config);
 
         static Oid GetRelid(std::string a_type, std::string a_relnamespace, std::string a_relname);
+        bool       ValidateRowVersion(Oid a_relid) const;
 
     public: // Methods
         ResourceConfig (const DocumentConfig* a_parent_doc, std::string a_type);
         virtual ~ResourceConfig ();
 
+        void SetConfig  (const JsonapiJson::Value& a_res_config);
+        bool Compile    ();
         bool SetValues  (const JsonapiJson::Value& a_res_config);
         bool ValidatePG (bool a_specific_request);
 
+        bool                     IsCompiled                       () const;
+        bool                     ReadsOnlyRelation                () const;
+        void                     GetRelatedTypes                  (StringSet& o_types) const;
+
         Oid                      GetOid                           () const;
         const std::string&       GetType                          () const;
         const std::string&       GetPGQuerySchema                 () const;
@@ -207,6 +221,9 @@ namespace pg_jsonapi
         uint                     PageLimit                        () const;
         bool                     ShowLinks                        () const;
         bool                     ShowNull                         () const;
+        bool                     ByteaAsBase64                    () const;
+        bool                     CacheFragments                   () const;
+        static const char*       RowVersionColumn                 ();
         bool                     IsQueryFromFunction              () const;
         bool                     IsQueryFromAttributesFunction    () const;
         bool                     FunctionReturnsJson              () const;
@@ -262,6 +279,11 @@ namespace pg_jsonapi
 
     };
 
+    inline bool ResourceConfig::IsCompiled () const
+    {
+        return compiled_;
+    }
+
     inline const std::string& ResourceConfig::GetType () const
     {
         return type_;
@@ -345,6 +367,21 @@ namespace pg_jsonapi
         return q_main_.show_null_;
     }
 
+    inline bool ResourceConfig::ByteaAsBase64 () const
+    {
+        return q_main_.bytea_base64_;
+    }
+
+    inline bool ResourceConfig::CacheFragments () const
+    {
+        return q_main_.cache_fragments_;
+    }
+
+    inline const char* ResourceConfig::RowVersionColumn ()
+    {
+        return "jsonapi:row-version";
+    }
+
     inline bool ResourceConfig::IsQueryFromFunction () const
     {
         return ( ! q_main_.function_.empty() );
@@ -31,8 +31,11 @@ pg_jsonapi::ResourceItem::ResourceItem ()
     /*
      * Attribute defaults
      */
-    id_        = NULL;
-    res_tuple_ = NULL;
+    id_          = NULL;
+    res_tuple_   = NULL;
+    head_batch_  = -1;
+    head_offset_ = 0;
+    head_len_    = 0;
 }
 
 /**
@@ -57,6 +60,14 @@ pg_jsonapi::ResourceData::ResourceData ()
     processed_ = 0;   // SPI_processed
     tupdesc_  = NULL; // SPI_tuptable->tupdesc
     top_processed_ = 0;
+    serialized_bytes_ = 0;
+    serialized_rows_  = 0;
+    id_col_        = -1;
+    version_col_   = -1;
+    values_        = NULL;
+    nulls_         = NULL;
+    out_funcs_     = NULL;
+    deformed_row_  = -1;
 }
 
 /**
@@ -66,3 +77,92 @@ pg_jsonapi::ResourceData::~ResourceData ()
 {
     ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
 }
+
+/**
+ * @brief Keep tuple descriptor of returned rows and resolve column positions.
+ *
+ * Positions of 'id', row version and relationship columns, output functions and deform
+ * arrays are only (re)computed when the descriptor changes, never per row.
+ */
+void pg_jsonapi::ResourceData::SetTupleDesc (TupleDesc a_tupdesc, const ResourceConfig& a_rc)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    deformed_row_ = -1;
+    if ( a_tupdesc == tupdesc_ ) {
+        return;
+    }
+    if ( NULL == tupdesc_ || tupdesc_->natts != a_tupdesc->natts ) {
+        values_    = (Datum*)    palloc(a_tupdesc->natts * sizeof(Datum));
+        nulls_     = (bool*)     palloc(a_tupdesc->natts * sizeof(bool));
+        out_funcs_ = (FmgrInfo*) palloc0(a_tupdesc->natts * sizeof(FmgrInfo));
+    }
+    tupdesc_ = a_tupdesc;
+
+    id_col_ = -1;
+    version_col_ = -1;
+    rel_cols_.clear();
+    columns_signature_.clear();
+    for ( int col = 0; col < tupdesc_->natts; col++ ) {
+        Form_pg_attribute attr    = TupleDescAttr(tupdesc_, col);
+        const char*       attname = NameStr(attr->attname);
+        Oid               typoutput;
+        bool              typisvarlena;
+
+        if ( -1 == id_col_ && 0 == strcmp(attname, "id") ) {
+            id_col_ = col;
+        }
+        if ( a_rc.IsRelationship(attname) ) {
+            rel_cols_.push_back(col);
+        }
+        if ( a_rc.CacheFragments() ) {
+            if ( -1 == version_col_ && 0 == strcmp(attname, ResourceConfig::RowVersionColumn()) ) {
+                version_col_ = col;
+            }
+            columns_signature_ += attname;
+            columns_signature_ += ':' + std::to_string(attr->atttypid) + ',';
+        }
+        getTypeOutputInfo(attr->atttypid, &typoutput, &typisvarlena);
+        fmgr_info(typoutput, &out_funcs_[col]);
+    }
+}
+
+/**
+ * @brief Deform tuple of given row into values and nulls arrays, unless it's already there.
+ */
+void pg_jsonapi::ResourceData::DeformRow (uint32 a_row)
+{
+    if ( (int) a_row != deformed_row_ ) {
+        heap_deform_tuple(items_[a_row].res_tuple_, tupdesc_, values_, nulls_);
+        deformed_row_ = (int) a_row;
+    }
+}
+
+/**
+ * @brief Forget tuples of rows [a_from, a_to) before their tuple table is freed.
+ *
+ * Tuple descriptor is copied, since it's also freed along with the tuple table.
+ */
+void pg_jsonapi::ResourceData::ReleaseTuples (uint32 a_from, uint32 a_to)
+{
+    for ( uint32 row = a_from; row < a_to; row++ ) {
+        items_[row].res_tuple_ = NULL;
+    }
+    if ( NULL != tupdesc_ && NULL != SPI_tuptable && tupdesc_ == SPI_tuptable->tupdesc ) {
+        tupdesc_ = CreateTupleDescCopy(tupdesc_);
+    }
+    deformed_row_ = -1;
+}
+
+/**
+ * @brief Text representation of a column from the deformed row.
+ *
+ * @return palloc'ed string or NULL if value is null
+ */
+char* pg_jsonapi::ResourceData::GetValue (int a_col)
+{
+    if ( nulls_[a_col] ) {
+        return NULL;
+    }
+    return OutputFunctionCall(&out_funcs_[a_col], values_[a_col]);
+}
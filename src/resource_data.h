@@ -26,6 +26,7 @@
 #include <string>
 #include <set>
 #include <map>
+#include <vector>
 
 #include "json/json.h"
 
@@ -34,6 +35,8 @@ extern "C" {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-qual"
 #include "executor/spi.h"
+#include "access/htup_details.h"
+#include "fmgr.h"
 #pragma GCC diagnostic pop
 } // extern "C"
 
@@ -47,7 +50,10 @@ namespace pg_jsonapi
         const char*     id_;
         std::string     internal_id_;
         bool            serialized_;
-        HeapTuple       res_tuple_;
+        HeapTuple       res_tuple_;      // NULL once the batch it was fetched in is released
+        int             head_batch_;     // batch of ResourceData::heads_ with serialized type, id and attributes, -1 if none
+        int             head_offset_;
+        int             head_len_;
         StringVectorMap relationships_;
 
     public: // Methods
@@ -57,6 +63,7 @@ namespace pg_jsonapi
 
     typedef std::vector<ResourceItem>      ResourceItemVector;
     typedef std::map<std::string, uint32>  IdIndexMap;
+    typedef std::vector<int>               ColumnVector;
 
     /**
      * @brief Resource data obtained from postgresql database.
@@ -72,10 +79,29 @@ namespace pg_jsonapi
         StringSet          processed_ids_; // all processed ids
         StringSetMap       inclusion_path_;
         uint32             top_processed_; // SPI_processed as top resources
+        size_t             serialized_bytes_; // bytes written by SerializeResource
+        uint32             serialized_rows_;  // rows written by SerializeResource
+        std::vector<StringInfoData> heads_;   // by released batch, type, id and attributes of its rows
+        std::vector<uint32> heads_pending_;   // by released batch, rows not yet serialized, freed when none is left
+
+    public: // Column positions - resolved once per tupdesc
+        int                id_col_;        // 0-based position of 'id' column, -1 if missing
+        ColumnVector       rel_cols_;      // 0-based positions of relationship columns
+        int                version_col_;   // 0-based position of row version column, -1 if missing
+        std::string        columns_signature_; // column names and types, part of fragment cache keys
+        Datum*             values_;        // deformed values of current row
+        bool*              nulls_;         // deformed nulls of current row
+        FmgrInfo*          out_funcs_;     // output functions per column
+        int                deformed_row_;  // row currently deformed, -1 if none
 
     public: // Methods
         ResourceData ();
         virtual ~ResourceData ();
+
+        void  SetTupleDesc    (TupleDesc a_tupdesc, const ResourceConfig& a_rc);
+        void  DeformRow       (uint32 a_row);
+        void  ReleaseTuples   (uint32 a_from, uint32 a_to);
+        char* GetValue        (int a_col);
     };
 
     typedef std::map<std::string, ResourceData> ResourceDataMap;
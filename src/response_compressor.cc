@@ -0,0 +1,423 @@
+/**
+ * @file response_compressor.cc Implementation of ResponseCompressor
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "response_compressor.h"
+
+#include <ctype.h>
+#include <strings.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * @brief Constructor, encoding must be available.
+ *
+ * Compressed response and library state are allocated in the current memory context.
+ */
+pg_jsonapi::ResponseCompressor::ResponseCompressor (Encoding a_encoding) : ResponseStream(NULL, NULL)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s %s", __FUNCTION__, EncodingName(a_encoding))));
+
+    state_ = (State*) palloc0(sizeof(State));
+    state_->encoding_ = a_encoding;
+    state_->callback_.func = ReleaseState;
+    state_->callback_.arg  = state_;
+    MemoryContextRegisterResetCallback(CurrentMemoryContext, &state_->callback_);
+
+    initStringInfo(&output_);
+    appendStringInfoSpaces(&output_, VARHDRSZ);
+
+    switch ( a_encoding ) {
+#ifdef HAVE_LIBZ
+        case E_ENCODING_GZIP:
+        {
+            z_stream* zs = (z_stream*) palloc0(sizeof(z_stream));
+            /* window bits above 15 select the gzip wrapper */
+            if ( Z_OK != deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) ) {
+                ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("jsonapi: could not initialize gzip compression")));
+            }
+            state_->handle_ = zs;
+            break;
+        }
+#endif
+#ifdef USE_LZ4
+        case E_ENCODING_LZ4:
+        {
+            LZ4F_cctx* cctx = NULL;
+            size_t     rv;
+
+            if ( LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION)) ) {
+                ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("jsonapi: could not initialize lz4 compression")));
+            }
+            state_->handle_ = cctx;
+            enlargeStringInfo(&output_, LZ4F_HEADER_SIZE_MAX);
+            rv = LZ4F_compressBegin(cctx, output_.data + output_.len, output_.maxlen - output_.len - 1, NULL);
+            if ( LZ4F_isError(rv) ) {
+                ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("jsonapi: lz4 compression failed: %s", LZ4F_getErrorName(rv))));
+            }
+            output_.len += (int) rv;
+            break;
+        }
+#endif
+#ifdef USE_ZSTD
+        case E_ENCODING_ZSTD:
+        {
+            ZSTD_CCtx* cctx = ZSTD_createCCtx();
+            if ( NULL == cctx ) {
+                ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("jsonapi: could not initialize zstd compression")));
+            }
+            state_->handle_ = cctx;
+            break;
+        }
+#endif
+        default:
+            state_->encoding_ = E_ENCODING_IDENTITY;
+            break;
+    }
+}
+
+/**
+ * @brief Destructor
+ */
+pg_jsonapi::ResponseCompressor::~ResponseCompressor ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+}
+
+/**
+ * @brief Free library state, called by Finish() or when the memory context is reset.
+ */
+void pg_jsonapi::ResponseCompressor::ReleaseState (void* a_state)
+{
+    State* state = (State*) a_state;
+
+    if ( NULL == state->handle_ ) {
+        return;
+    }
+    switch ( state->encoding_ ) {
+#ifdef HAVE_LIBZ
+        case E_ENCODING_GZIP:
+            deflateEnd((z_stream*) state->handle_);
+            break;
+#endif
+#ifdef USE_LZ4
+        case E_ENCODING_LZ4:
+            LZ4F_freeCompressionContext((LZ4F_cctx*) state->handle_);
+            break;
+#endif
+#ifdef USE_ZSTD
+        case E_ENCODING_ZSTD:
+            ZSTD_freeCCtx((ZSTD_CCtx*) state->handle_);
+            break;
+#endif
+        default:
+            break;
+    }
+    state->handle_ = NULL;
+}
+
+void pg_jsonapi::ResponseCompressor::WriteChunk (const char* a_data, int a_len, int /* a_http_status */)
+{
+    Compress(a_data, (size_t) a_len, false);
+}
+
+/**
+ * @brief Append compressed data to output, a_end flushes everything still buffered by the compressor.
+ */
+void pg_jsonapi::ResponseCompressor::Compress (const char* a_data, size_t a_len, bool a_end)
+{
+    switch ( state_->encoding_ ) {
+#ifdef HAVE_LIBZ
+        case E_ENCODING_GZIP:
+        {
+            z_stream* zs = (z_stream*) state_->handle_;
+            int       rv;
+
+            zs->next_in  = (Bytef*) a_data;
+            zs->avail_in = (uInt) a_len;
+            do {
+                enlargeStringInfo(&output_, (int) deflateBound(zs, zs->avail_in) + 64);
+                zs->next_out  = (Bytef*) ( output_.data + output_.len );
+                zs->avail_out = (uInt) ( output_.maxlen - output_.len - 1 );
+                rv = deflate(zs, a_end ? Z_FINISH : Z_NO_FLUSH);
+                if ( Z_STREAM_ERROR == rv ) {
+                    ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("jsonapi: gzip compression failed")));
+                }
+                output_.len = (int) ( (char*) zs->next_out - output_.data );
+            } while ( a_end ? Z_STREAM_END != rv : zs->avail_in > 0 );
+            break;
+        }
+#endif
+#ifdef USE_LZ4
+        case E_ENCODING_LZ4:
+        {
+            LZ4F_cctx* cctx = (LZ4F_cctx*) state_->handle_;
+            size_t     rv;
+
+            enlargeStringInfo(&output_, (int) LZ4F_compressBound(a_len, NULL));
+            if ( a_end ) {
+                rv = LZ4F_compressEnd(cctx, output_.data + output_.len, output_.maxlen - output_.len - 1, NULL);
+            } else {
+                rv = LZ4F_compressUpdate(cctx, output_.data + output_.len, output_.maxlen - output_.len - 1, a_data, a_len, NULL);
+            }
+            if ( LZ4F_isError(rv) ) {
+                ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("jsonapi: lz4 compression failed: %s", LZ4F_getErrorName(rv))));
+            }
+            output_.len += (int) rv;
+            break;
+        }
+#endif
+#ifdef USE_ZSTD
+        case E_ENCODING_ZSTD:
+        {
+            ZSTD_inBuffer  in  = { a_data, a_len, 0 };
+            size_t         rv;
+
+            do {
+                enlargeStringInfo(&output_, (int) ZSTD_CStreamOutSize());
+                ZSTD_outBuffer out = { output_.data + output_.len, (size_t) ( output_.maxlen - output_.len - 1 ), 0 };
+                rv = ZSTD_compressStream2((ZSTD_CCtx*) state_->handle_, &out, &in, a_end ? ZSTD_e_end : ZSTD_e_continue);
+                if ( ZSTD_isError(rv) ) {
+                    ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("jsonapi: zstd compression failed: %s", ZSTD_getErrorName(rv))));
+                }
+                output_.len += (int) out.pos;
+            } while ( a_end ? 0 != rv : in.pos < in.size );
+            break;
+        }
+#endif
+        default:
+            appendBinaryStringInfo(&output_, a_data, (int) a_len);
+            break;
+    }
+}
+
+/**
+ * @brief Finish compression.
+ *
+ * @return compressed response, allocated in the memory context current when the compressor was created
+ */
+bytea* pg_jsonapi::ResponseCompressor::Finish ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    Compress(NULL, 0, true);
+    ReleaseState(state_);
+    SET_VARSIZE(output_.data, output_.len);
+
+    ereport(DEBUG2, (errmsg_internal("jsonapi: %s %zu bytes compressed to %d bytes using %s",
+                                     __FUNCTION__, Bytes(), output_.len - VARHDRSZ, EncodingName(state_->encoding_))));
+
+    return (bytea*) output_.data;
+}
+
+/**
+ * @brief Choose the encoding from a list in the format of an HTTP Accept-Encoding header.
+ *
+ * The available encoding with the highest quality value is chosen, ties are broken by the order
+ * of the list; '*' stands for every encoding not listed, in the order zstd, lz4, gzip.
+ * A quality of 0 excludes an encoding, identity is acceptable unless excluded by 'identity;q=0'
+ * or by '*;q=0' without identity listed; when it's excluded and nothing listed is available,
+ * the best available encoding is used instead.
+ *
+ * @return chosen encoding, E_ENCODING_IDENTITY if no available encoding is acceptable
+ */
+pg_jsonapi::ResponseCompressor::Encoding pg_jsonapi::ResponseCompressor::Negotiate (const char* a_accept, size_t a_accept_len)
+{
+    static const struct {
+        const char* name_;
+        Encoding    encoding_;
+    } k_names[] = {
+        { "zstd",     E_ENCODING_ZSTD     },
+        { "lz4",      E_ENCODING_LZ4      },
+        { "gzip",     E_ENCODING_GZIP     },
+        { "x-gzip",   E_ENCODING_GZIP     },
+        { "identity", E_ENCODING_IDENTITY }
+    };
+    static const size_t k_encodings = E_ENCODING_ZSTD + 1;
+    static const int    k_unlisted  = -1;
+
+    int         quality[k_encodings];      // in thousandths, k_unlisted if not in the list
+    size_t      position[k_encodings];     // in the list
+    int         star_quality  = k_unlisted;
+    size_t      star_position = 0;
+    size_t      count         = 0;
+    const char* end           = a_accept + a_accept_len;
+    const char* token         = a_accept;
+
+    for ( size_t e = 0; e < k_encodings; ++e ) {
+        quality[e]  = k_unlisted;
+        position[e] = 0;
+    }
+
+    while ( token < end ) {
+        const char* next   = (const char*) memchr(token, ',', end - token);
+        const char* stop   = ( NULL != next ) ? next : end;
+        const char* params = (const char*) memchr(token, ';', stop - token);
+        const char* name   = token;
+        size_t      len;
+        int         q      = 1000;
+
+        /* parameters: only q is known, a malformed value is taken as 0 */
+        for ( const char* param = params; NULL != param && param < stop; ) {
+            const char* param_end = (const char*) memchr(param + 1, ';', stop - param - 1);
+            const char* p         = param + 1;
+
+            if ( NULL == param_end ) {
+                param_end = stop;
+            }
+            while ( p < param_end && ( ' ' == *p || '\t' == *p ) ) {
+                p++;
+            }
+            if ( param_end - p >= 2 && ( 'q' == *p || 'Q' == *p ) && '=' == p[1] ) {
+                p += 2;
+                q = 0;
+                if ( p < param_end && '1' == *p ) {
+                    q = 1000;
+                } else if ( p < param_end && '0' == *p ) {
+                    p++;
+                    if ( p < param_end && '.' == *p ) {
+                        int scale = 100;
+                        for ( p++; p < param_end && scale > 0 && isdigit((unsigned char) *p); p++, scale /= 10 ) {
+                            q += ( *p - '0' ) * scale;
+                        }
+                    }
+                }
+            }
+            param = param_end;
+        }
+
+        if ( NULL != params ) {
+            stop = params;
+        }
+        while ( name < stop && ( ' ' == *name || '\t' == *name ) ) {
+            name++;
+        }
+        while ( stop > name && ( ' ' == stop[-1] || '\t' == stop[-1] ) ) {
+            stop--;
+        }
+        len = stop - name;
+
+        if ( 1 == len && '*' == *name ) {
+            if ( k_unlisted == star_quality ) {
+                star_quality  = q;
+                star_position = count;
+            }
+        } else {
+            for ( size_t i = 0; i < sizeof(k_names)/sizeof(k_names[0]); ++i ) {
+                if ( len == strlen(k_names[i].name_) && 0 == strncasecmp(name, k_names[i].name_, len) ) {
+                    if ( k_unlisted == quality[k_names[i].encoding_] ) {
+                        quality[k_names[i].encoding_]  = q;
+                        position[k_names[i].encoding_] = count;
+                    }
+                    break;
+                }
+            }
+        }
+        count++;
+        token = ( NULL != next ) ? next + 1 : end;
+    }
+
+    /* identity is implicitly acceptable, after everything listed */
+    if ( k_unlisted == quality[E_ENCODING_IDENTITY] ) {
+        quality[E_ENCODING_IDENTITY]  = ( 0 == star_quality ) ? 0 : 1;
+        position[E_ENCODING_IDENTITY] = count;
+    }
+
+    Encoding best          = E_ENCODING_IDENTITY;
+    int      best_quality  = quality[E_ENCODING_IDENTITY];
+    size_t   best_position = position[E_ENCODING_IDENTITY];
+
+    for ( size_t i = 0; i < sizeof(k_names)/sizeof(k_names[0]); ++i ) {
+        Encoding encoding = k_names[i].encoding_;
+        int      q        = ( k_unlisted != quality[encoding] ) ? quality[encoding] : star_quality;
+        size_t   pos      = ( k_unlisted != quality[encoding] ) ? position[encoding] : star_position;
+
+        if ( E_ENCODING_IDENTITY == encoding || q <= 0 || ! IsAvailable(encoding) ) {
+            continue;
+        }
+        if ( q > best_quality || ( q == best_quality && pos < best_position ) ) {
+            best          = encoding;
+            best_quality  = q;
+            best_position = pos;
+        }
+    }
+
+    /* identity was excluded and no listed encoding is available: any compression is closer to what was asked */
+    if ( E_ENCODING_IDENTITY == best && 0 == best_quality ) {
+        for ( size_t i = 0; i < sizeof(k_names)/sizeof(k_names[0]) && E_ENCODING_IDENTITY == best; ++i ) {
+            if ( IsAvailable(k_names[i].encoding_) ) {
+                best = k_names[i].encoding_;
+            }
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @return @li true if PostgreSQL was built with the library needed by the encoding
+ *         @li false otherwise
+ */
+bool pg_jsonapi::ResponseCompressor::IsAvailable (Encoding a_encoding)
+{
+    switch ( a_encoding ) {
+#ifdef HAVE_LIBZ
+        case E_ENCODING_GZIP:
+            return true;
+#endif
+#ifdef USE_LZ4
+        case E_ENCODING_LZ4:
+            return true;
+#endif
+#ifdef USE_ZSTD
+        case E_ENCODING_ZSTD:
+            return true;
+#endif
+        case E_ENCODING_IDENTITY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @return name to be used in the Content-Encoding header
+ */
+const char* pg_jsonapi::ResponseCompressor::EncodingName (Encoding a_encoding)
+{
+    switch ( a_encoding ) {
+        case E_ENCODING_GZIP:
+            return "gzip";
+        case E_ENCODING_LZ4:
+            return "lz4";
+        case E_ENCODING_ZSTD:
+            return "zstd";
+        default:
+            return "identity";
+    }
+}
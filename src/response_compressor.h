@@ -0,0 +1,86 @@
+/**
+ * @file response_compressor.h Declaration of ResponseCompressor
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CLD_PG_JSONAPI_RESPONSE_COMPRESSOR_H
+#define CLD_PG_JSONAPI_RESPONSE_COMPRESSOR_H
+
+#include "response_stream.h"
+
+namespace pg_jsonapi
+{
+
+    /**
+     * @brief Response compressed while it's serialized, returned as a single bytea value.
+     *
+     * Chunks flushed by the serializer are fed to the compressor, so only the compressed response
+     * and one chunk are kept in memory. Available encodings depend on the libraries PostgreSQL
+     * was built with (HAVE_LIBZ, USE_LZ4 and USE_ZSTD in pg_config.h).
+     */
+    class ResponseCompressor : public ResponseStream
+    {
+    public:
+
+        typedef enum {
+            E_ENCODING_IDENTITY,
+            E_ENCODING_GZIP,
+            E_ENCODING_LZ4,
+            E_ENCODING_ZSTD
+        } Encoding;
+
+    private:
+
+        typedef struct {
+            MemoryContextCallback callback_;   // releases library state if the request is aborted
+            Encoding              encoding_;
+            void*                 handle_;     // z_stream*, LZ4F_cctx* or ZSTD_CCtx*
+        } State;
+
+    private: // Attributes
+        State*         state_;
+        StringInfoData output_;
+
+    private: // Methods
+        void         Compress   (const char* a_data, size_t a_len, bool a_end);
+        static void  ReleaseState (void* a_state);
+
+    protected: // Methods
+        virtual void WriteChunk (const char* a_data, int a_len, int a_http_status);
+
+    public: // Methods
+        ResponseCompressor (Encoding a_encoding);
+        virtual ~ResponseCompressor ();
+
+        bytea*       Finish     ();
+        Encoding     GetEncoding () const;
+
+        static Encoding    Negotiate    (const char* a_accept, size_t a_accept_len);
+        static bool        IsAvailable  (Encoding a_encoding);
+        static const char* EncodingName (Encoding a_encoding);
+    };
+
+    inline ResponseCompressor::Encoding ResponseCompressor::GetEncoding () const
+    {
+        return state_->encoding_;
+    }
+
+} // namespace pg_jsonapi
+
+#endif // CLD_PG_JSONAPI_RESPONSE_COMPRESSOR_H
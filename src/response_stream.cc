@@ -0,0 +1,94 @@
+/**
+ * @file response_stream.cc Implementation of ResponseStream
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "response_stream.h"
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "utils/builtins.h"
+#pragma GCC diagnostic pop
+} // extern "C"
+
+/**
+ * @brief Constructor
+ *
+ * @param a_store   Tuplestore returned by the set returning function, in materialize mode.
+ * @param a_tupdesc Descriptor of (http_status integer, chunk text) rows.
+ */
+pg_jsonapi::ResponseStream::ResponseStream (Tuplestorestate* a_store, TupleDesc a_tupdesc)
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    store_      = a_store;
+    tupdesc_    = a_tupdesc;
+    chunk_size_ = DocumentConfig::DefaultStreamChunkSize();
+    chunks_     = 0;
+    bytes_      = 0;
+}
+
+/**
+ * @brief Destructor
+ */
+pg_jsonapi::ResponseStream::~ResponseStream ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+}
+
+void pg_jsonapi::ResponseStream::SetChunkSize (size_t a_chunk_size)
+{
+    chunk_size_ = a_chunk_size;
+}
+
+/**
+ * @brief Write buffer contents as a new row, if not empty, and reset the buffer.
+ */
+void pg_jsonapi::ResponseStream::Flush (StringInfoData& a_buffer, int a_http_status)
+{
+    if ( 0 == a_buffer.len ) {
+        return;
+    }
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s chunk %zu with %d bytes", __FUNCTION__, chunks_, a_buffer.len)));
+
+    WriteChunk(a_buffer.data, a_buffer.len, a_http_status);
+
+    chunks_ += 1;
+    bytes_  += a_buffer.len;
+    resetStringInfo(&a_buffer);
+}
+
+/**
+ * @brief Write chunk as a (http_status, chunk) row.
+ */
+void pg_jsonapi::ResponseStream::WriteChunk (const char* a_data, int a_len, int a_http_status)
+{
+    text*  chunk = cstring_to_text_with_len(a_data, a_len);
+    Datum  values[2];
+    bool   nulls[2];
+
+    values[0] = Int32GetDatum(a_http_status);
+    values[1] = PointerGetDatum(chunk);
+    nulls[0]  = nulls[1] = false;
+
+    /* tuplestore copies the row to its own memory context, spilling to disk above work_mem */
+    tuplestore_putvalues(store_, tupdesc_, values, nulls);
+    pfree(chunk);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file response_stream.h Declaration of ResponseStream
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CLD_PG_JSONAPI_RESPONSE_STREAM_H
+#define CLD_PG_JSONAPI_RESPONSE_STREAM_H
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "postgres.h"
+#include "lib/stringinfo.h"
+#include "access/tupdesc.h"
+#include "utils/tuplestore.h"
+#pragma GCC diagnostic pop
+} // extern "C"
+#include "document_config.h"
+
+namespace pg_jsonapi
+{
+
+    /**
+     * @brief Response written as (http_status, chunk) rows of a set returning function.
+     *
+     * Serialization flushes the response buffer into the tuplestore whenever it reaches the chunk size,
+     * so the response is never kept whole in memory and its size isn't limited to a single text value.
+     * Subclasses may override WriteChunk to send chunks elsewhere.
+     */
+    class ResponseStream
+    {
+    protected: // Attributes
+        Tuplestorestate* store_;
+        TupleDesc        tupdesc_;
+        size_t           chunk_size_;
+        size_t           chunks_;
+        size_t           bytes_;
+
+    protected: // Methods
+        virtual void WriteChunk (const char* a_data, int a_len, int a_http_status);
+
+    public: // Methods
+        ResponseStream (Tuplestorestate* a_store, TupleDesc a_tupdesc);
+        virtual ~ResponseStream ();
+
+        void   SetChunkSize (size_t a_chunk_size);
+        void   Flush        (StringInfoData& a_buffer, int a_http_status);
+
+        bool   IsFull       (const StringInfoData& a_buffer) const;
+        size_t ChunkSize    () const;
+        size_t Chunks       () const;
+        size_t Bytes        () const;
+    };
+
+    inline bool ResponseStream::IsFull (const StringInfoData& a_buffer) const
+    {
+        return (size_t) a_buffer.len >= chunk_size_;
+    }
+
+    inline size_t ResponseStream::ChunkSize () const
+    {
+        return chunk_size_;
+    }
+
+    inline size_t ResponseStream::Chunks () const
+    {
+        return chunks_;
+    }
+
+    inline size_t ResponseStream::Bytes () const
+    {
+        return bytes_;
+    }
+
+} // namespace pg_jsonapi
+
+#endif // CLD_PG_JSONAPI_RESPONSE_STREAM_H
@@ -470,23 +470,41 @@ pg_jsonapi::array_to_json_internal(Datum array, StringInfo result, bool use_line
  */
 std::string pg_jsonapi::Utils::urlDecode(const char* a_url, size_t a_url_len) {
 
-    std::string url = std::string(a_url, 0, a_url_len);
     std::string ret;
-    char ch;
-    size_t i;
-    int j;
-    for ( i=0; i < a_url_len; i++ ) {
-        if ( 37 == int(a_url[i])) {
-            sscanf(url.substr(i+1,2).c_str(), "%x", &j);
-            ch = static_cast<char>(j);
-            ret += ch;
+    urlDecode(ret, a_url, a_url_len);
+    return (ret);
+}
+
+/**
+ * @brief URL decode into an existing string, reusing its buffer.
+ *
+ * @li o_decoded The string replaced by the decoded url.
+ * @li a_url The url to decode.
+ * @li a_url_len The length of the url to decode.
+ */
+void pg_jsonapi::Utils::urlDecode(std::string& o_decoded, const char* a_url, size_t a_url_len) {
+
+    const char* escape = (const char*) memchr(a_url, '%', a_url_len);
+
+    if ( NULL == escape ) {
+        /* nothing to decode */
+        o_decoded.assign(a_url, a_url_len);
+        return;
+    }
+    o_decoded.assign(a_url, escape - a_url);
+    for ( size_t i = escape - a_url; i < a_url_len; i++ ) {
+        if ( '%' == a_url[i] ) {
+            int ch = 0;
+            for ( size_t k = i + 1; k < a_url_len && k <= i + 2 && isxdigit((unsigned char) a_url[k]); k++ ) {
+                ch = ( ch << 4 ) | ( isdigit((unsigned char) a_url[k]) ? a_url[k] - '0' : ( tolower((unsigned char) a_url[k]) - 'a' + 10 ) );
+            }
+            o_decoded += static_cast<char>(ch);
             i = i+2;
         } else {
-            ret += a_url[i];
+            o_decoded += a_url[i];
         }
     }
-    ereport(DEBUG4, (errmsg_internal("urlDecode: %s", ret.c_str())));
-    return (ret);
+    ereport(DEBUG4, (errmsg_internal("urlDecode: %s", o_decoded.c_str())));
 }
 
 /**
@@ -75,6 +75,7 @@ namespace pg_jsonapi
     public:
 
         static std::string urlDecode (const char* a_url, size_t a_url_len);
+        static void        urlDecode (std::string& o_decoded, const char* a_url, size_t a_url_len);
 
         static std::string collapseQuerySpaces(const std::string& a_query);
 
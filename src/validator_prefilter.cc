@@ -0,0 +1,271 @@
+/**
+ * @file validator_prefilter.cc Implementation of ValidatorPrefilter
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "validator_prefilter.h"
+
+#include <ctype.h>
+#include <deque>
+
+/**
+ * @brief Constructor
+ */
+pg_jsonapi::ValidatorPrefilter::ValidatorPrefilter ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    rules_   = 0;
+    symbols_ = 1;
+    memset(classes_, 0, sizeof(classes_));
+}
+
+/**
+ * @brief Destructor
+ */
+pg_jsonapi::ValidatorPrefilter::~ValidatorPrefilter ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+}
+
+/**
+ * @brief Add the next rule of the validator, in configuration order.
+ */
+void pg_jsonapi::ValidatorPrefilter::Add (const std::string& a_rule)
+{
+    literals_.push_back(RequiredLiteral(a_rule));
+    unfiltered_.push_back(literals_.back().empty());
+    rules_++;
+}
+
+/**
+ * @brief Build the automaton of the literals of all rules added.
+ */
+void pg_jsonapi::ValidatorPrefilter::Build ()
+{
+    ereport(DEBUG3, (errmsg_internal("jsonapi: %s", __FUNCTION__)));
+
+    /* bytes of literals, in both cases, are the only symbols told apart */
+    for ( size_t r = 0; r < rules_; r++ ) {
+        for ( size_t i = 0; i < literals_[r].length(); i++ ) {
+            unsigned char c = (unsigned char) literals_[r][i];
+            if ( 0 == classes_[c] ) {
+                classes_[c]          = (unsigned char) symbols_;
+                classes_[toupper(c)] = (unsigned char) symbols_;
+                symbols_++;
+            }
+        }
+    }
+
+    /* trie of literals */
+    next_.assign(symbols_, -1);
+    output_.assign(1, std::vector<size_t>());
+    for ( size_t r = 0; r < rules_; r++ ) {
+        if ( literals_[r].empty() ) {
+            continue;
+        }
+        int state = 0;
+        for ( size_t i = 0; i < literals_[r].length(); i++ ) {
+            size_t symbol = classes_[(unsigned char) literals_[r][i]];
+            if ( -1 == next_[state * symbols_ + symbol] ) {
+                next_[state * symbols_ + symbol] = (int) output_.size();
+                next_.resize(next_.size() + symbols_, -1);
+                output_.push_back(std::vector<size_t>());
+            }
+            state = next_[state * symbols_ + symbol];
+        }
+        output_[state].push_back(r);
+    }
+
+    /* failure links, folded into the transitions of each state */
+    std::vector<int> fail(output_.size(), 0);
+    std::deque<int>  queue;
+    for ( size_t symbol = 0; symbol < symbols_; symbol++ ) {
+        int child = next_[symbol];
+        if ( -1 == child ) {
+            next_[symbol] = 0;
+        } else {
+            fail[child] = 0;
+            queue.push_back(child);
+        }
+    }
+    while ( ! queue.empty() ) {
+        int state = queue.front();
+        queue.pop_front();
+        for ( size_t symbol = 0; symbol < symbols_; symbol++ ) {
+            int child = next_[state * symbols_ + symbol];
+            int other = next_[fail[state] * symbols_ + symbol];
+            if ( -1 == child ) {
+                next_[state * symbols_ + symbol] = other;
+            } else {
+                fail[child] = other;
+                output_[child].insert(output_[child].end(), output_[other].begin(), output_[other].end());
+                queue.push_back(child);
+            }
+        }
+    }
+
+    ereport(DEBUG1, (errmsg_internal("jsonapi: %s %zu rules, %zu states, %zu symbols", __FUNCTION__, rules_, output_.size(), symbols_)));
+}
+
+/**
+ * @brief Tell which rules may match a value, scanning it once.
+ *
+ * @param a_value The value.
+ * @param a_length Length of value.
+ * @param o_candidates By rule, false when the rule can't match the value.
+ */
+void pg_jsonapi::ValidatorPrefilter::Candidates (const char* a_value, size_t a_length, std::vector<bool>& o_candidates) const
+{
+    o_candidates = unfiltered_;
+
+    if ( output_.size() <= 1 ) {
+        return;
+    }
+    int state = 0;
+    for ( size_t i = 0; i < a_length; i++ ) {
+        state = next_[state * symbols_ + classes_[(unsigned char) a_value[i]]];
+        for ( size_t o = 0; o < output_[state].size(); o++ ) {
+            o_candidates[output_[state][o]] = true;
+        }
+    }
+}
+
+/**
+ * @brief Get the longest literal, in lowercase, that every match of an ECMAScript rule contains.
+ *
+ * Only characters outside of groups and classes, that can't be repeated zero times, are considered.
+ * When unsure, no literal is returned, so the rule is always searched.
+ *
+ * @return The literal, empty if none was found.
+ */
+std::string pg_jsonapi::ValidatorPrefilter::RequiredLiteral (const std::string& a_rule)
+{
+    std::string longest;
+    std::string run;
+    size_t      length = a_rule.length();
+    size_t      i      = 0;
+
+    while ( i < length ) {
+        const char c       = a_rule[i];
+        int        literal = -1;   // byte of a literal character, -1 for anything else
+
+        if ( '|' == c ) {
+            /* each alternative would need its own literal */
+            return std::string();
+        } else if ( '\\' == c ) {
+            if ( i + 1 >= length ) {
+                return std::string();
+            }
+            const char e = a_rule[i + 1];
+            i += 2;
+            if ( isalnum((unsigned char) e) ) {
+                /* classes, assertions, back references, control and code point escapes */
+                i += ( 'c' == e ) ? 1 : ( 'x' == e ) ? 2 : ( 'u' == e ) ? 4 : 0;
+            } else {
+                literal = (unsigned char) e;
+            }
+        } else if ( '[' == c ) {
+            for ( i++; i < length && ']' != a_rule[i]; i++ ) {
+                if ( '\\' == a_rule[i] ) {
+                    i++;
+                }
+            }
+            if ( i >= length ) {
+                return std::string();
+            }
+            i++;
+        } else if ( '(' == c ) {
+            int depth = 0;
+            for ( ; i < length; i++ ) {
+                if ( '\\' == a_rule[i] ) {
+                    i++;
+                } else if ( '[' == a_rule[i] ) {
+                    for ( i++; i < length && ']' != a_rule[i]; i++ ) {
+                        if ( '\\' == a_rule[i] ) {
+                            i++;
+                        }
+                    }
+                } else if ( '(' == a_rule[i] ) {
+                    depth++;
+                } else if ( ')' == a_rule[i] && 0 == --depth ) {
+                    break;
+                }
+            }
+            if ( i >= length ) {
+                return std::string();
+            }
+            i++;
+        } else if ( NULL != strchr("*+?{})]", c) ) {
+            /* quantifier without atom or unbalanced, let the regular expression deal with it */
+            return std::string();
+        } else {
+            /* '.', '^' and '$' are not literals, everything else is */
+            if ( NULL == strchr(".^$", c) ) {
+                literal = (unsigned char) c;
+            }
+            i++;
+        }
+
+        /* quantifier of the atom */
+        size_t minimum    = 1;
+        bool   quantified = false;
+        if ( i < length ) {
+            if ( '*' == a_rule[i] || '?' == a_rule[i] ) {
+                minimum    = 0;
+                quantified = true;
+                i++;
+            } else if ( '+' == a_rule[i] ) {
+                quantified = true;
+                i++;
+            } else if ( '{' == a_rule[i] && i + 1 < length && isdigit((unsigned char) a_rule[i + 1]) ) {
+                minimum = 0;
+                for ( i++; i < length && isdigit((unsigned char) a_rule[i]); i++ ) {
+                    minimum = minimum * 10 + (size_t) ( a_rule[i] - '0' );
+                }
+                for ( ; i < length && '}' != a_rule[i]; i++ ) {
+                }
+                if ( i >= length ) {
+                    return std::string();
+                }
+                quantified = true;
+                i++;
+            }
+            if ( quantified && i < length && '?' == a_rule[i] ) {
+                i++;
+            }
+        }
+
+        if ( literal >= 0 && literal < 0x80 && minimum > 0 ) {
+            run += (char) tolower(literal);
+            if ( ! quantified ) {
+                continue;
+            }
+        }
+        /* a repeated, optional or non literal atom ends the run */
+        if ( run.length() > longest.length() ) {
+            longest = run;
+        }
+        run.clear();
+    }
+    if ( run.length() > longest.length() ) {
+        longest = run;
+    }
+    return longest;
+}
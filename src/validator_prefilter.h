@@ -0,0 +1,77 @@
+/**
+ * @file validator_prefilter.h Declaration of ValidatorPrefilter
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of pg-jsonapi.
+ *
+ * pg-jsonapi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pg-jsonapi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#ifndef CLD_PG_JSONAPI_VALIDATOR_PREFILTER_H
+#define CLD_PG_JSONAPI_VALIDATOR_PREFILTER_H
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include "postgres.h"
+#pragma GCC diagnostic pop
+} // extern "C"
+
+namespace pg_jsonapi
+{
+
+    /**
+     * @brief Literal prefilter of the rules of a validator.
+     *
+     * Each rule is given the longest literal that any of its matches must contain, ignoring case.
+     * All literals are searched at once by an Aho-Corasick automaton, so a value is scanned a single
+     * time to tell which rules may match it; only those need their regular expression searched.
+     * Rules without such literal (top level alternations, only classes or groups, ...) are always candidates.
+     */
+    class ValidatorPrefilter
+    {
+    private: // Attributes
+        size_t                            rules_;
+        std::vector<std::string>          literals_;      // by rule, lowercase, empty if none
+        std::vector<bool>                 unfiltered_;    // by rule, true when rule has no literal
+        unsigned char                     classes_[256];  // byte to symbol of automaton, 0 for bytes not in literals
+        size_t                            symbols_;
+        std::vector<int>                  next_;          // state * symbols_ + symbol to state
+        std::vector<std::vector<size_t>>  output_;        // by state, rules whose literal ends there
+
+    public: // Methods
+        ValidatorPrefilter ();
+        virtual ~ValidatorPrefilter ();
+
+        void Add        (const std::string& a_rule);
+        void Build      ();
+        void Candidates (const char* a_value, size_t a_length, std::vector<bool>& o_candidates) const;
+
+        const std::string& Literal (size_t a_rule) const;
+
+        static std::string RequiredLiteral (const std::string& a_rule);
+    };
+
+    inline const std::string& ValidatorPrefilter::Literal (size_t a_rule) const
+    {
+        return literals_[a_rule];
+    }
+
+} // namespace pg_jsonapi
+
+#endif // CLD_PG_JSONAPI_VALIDATOR_PREFILTER_H
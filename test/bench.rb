@@ -0,0 +1,75 @@
+# encoding: utf-8
+#
+# Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+#
+# This file is part of pg-jsonapi.
+#
+# pg-jsonapi is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# pg-jsonapi is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public License
+# along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Compare serialization of large pages by the backend alone and with serialization-threads.
+#
+# Creates table bench_rows with 100000 rows and one configuration per number of threads,
+# then prints the median time of jsonapi() for pages of 10k, 50k and 100k rows.
+#
+require 'pg'
+require 'yaml'
+require 'json'
+require File.expand_path '../utils.rb', __FILE__
+
+config = YAML.load_file(File.expand_path '../config.yml', __FILE__)['pg']
+db     = PG.connect(host: config['host'], port: config['port'], dbname: config['dbname'], user: config['user'])
+
+rows    = [ 10000, 50000, 100000 ]
+threads = [ 0, 2, 4, 8 ]
+runs    = 5
+
+db.exec("DROP TABLE IF EXISTS public.bench_rows")
+db.exec("CREATE TABLE public.bench_rows (id serial PRIMARY KEY, name text, description text, quantity integer, amount float8, total bigint)")
+db.exec("INSERT INTO public.bench_rows (name, description, quantity, amount, total)
+         SELECT 'row ' || i, repeat('some \"quoted\" text ', 1 + i % 8), i % 1000, i * 1.37, i::bigint * 1000003
+           FROM generate_series(1, #{rows.max}) i")
+db.exec("ANALYZE public.bench_rows")
+
+threads.each do |count|
+  prefix = "http://bench-t#{count}.localhost"
+  db.exec_params("DELETE FROM public.jsonapi_config WHERE prefix = $1", [prefix])
+  db.exec_params("INSERT INTO public.jsonapi_config (prefix, config) VALUES ($1, $2)", [prefix, {
+    'serialization-threads'          => count,
+    'serialization-threads-min-rows' => rows.min,
+    'page-limit'                     => rows.max,
+    'page-size'                      => rows.max,
+    'resources'                      => [ { 'rows' => { 'pg-table' => 'bench_rows' } } ]
+  }.to_json])
+end
+
+printf("%10s %10s %12s %10s\n", 'rows', 'threads', 'median (ms)', 'speedup')
+rows.each do |count|
+  baseline = nil
+  threads.each do |nthreads|
+    url = "http://bench-t#{nthreads}.localhost/rows?page[size]=#{count}"
+    # first request loads configuration and warms up the cache
+    db.exec_params("SELECT http_status FROM jsonapi('GET',$1,'','','','','','','')", [url])
+    samples = (1..runs).map do
+      time { db.exec_params("SELECT length(response) FROM jsonapi('GET',$1,'','','','','','','')", [url]) } * 1000
+    end
+    median   = samples.sort[runs / 2]
+    baseline = median if baseline.nil?
+    printf("%10d %10d %12.1f %9.2fx\n", count, nthreads, median, baseline / median)
+  end
+end
+
+threads.each do |count|
+  db.exec_params("DELETE FROM public.jsonapi_config WHERE prefix = $1", ["http://bench-t#{count}.localhost"])
+end
+db.exec("DROP TABLE public.bench_rows")
@@ -0,0 +1,75 @@
+# encoding: utf-8
+#
+# Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+#
+# This file is part of pg-jsonapi.
+#
+# pg-jsonapi is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# pg-jsonapi is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public License
+# along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Measure the cost of xss_validators on request bodies.
+#
+# Creates table bench_notes and one configuration, then prints the median time of a POST whose
+# attributes hold clean text, first on a connection without validators and then with 20 rules.
+# Each POST is rolled back.
+#
+require 'pg'
+require 'yaml'
+require 'json'
+require File.expand_path '../utils.rb', __FILE__
+
+config = YAML.load_file(File.expand_path '../config.yml', __FILE__)['pg']
+connect = lambda { PG.connect(host: config['host'], port: config['port'], dbname: config['dbname'], user: config['user']) }
+
+rules = [ '<\s*script', 'javascript\s*:', 'on(load|error|click|mouse\w+)\s*=', '<\s*iframe', '<\s*img[^>]+src',
+          'expression\s*\(', 'document\.cookie', 'eval\s*\(', '<\s*object', 'vbscript:', 'data:text/html', '<svg',
+          'alert\(', '&#x?[0-9a-f]+;?', 'srcdoc\s*=', '<\/?embed', '<\s*link', '<\s*meta', '<\s*style', '<\s*form' ]
+sizes  = [ 1000, 10000, 100000 ]
+runs   = 9
+prefix = 'http://bench-validators.localhost'
+
+db = connect.call
+db.exec("DROP TABLE IF EXISTS public.bench_notes")
+db.exec("CREATE TABLE public.bench_notes (id serial PRIMARY KEY, title text, body text)")
+db.exec_params("DELETE FROM public.jsonapi_config WHERE prefix = $1", [prefix])
+db.exec_params("INSERT INTO public.jsonapi_config (prefix, config) VALUES ($1, $2)", [prefix, {
+  'resources' => [ { 'notes' => { 'pg-table' => 'bench_notes' } } ]
+}.to_json])
+db.close
+
+def measure(db, prefix, size, runs)
+  text = ('Lorem ipsum dolor sit amet, consectetur adipiscing elit. ' * (size / 57 + 1))[0, size]
+  body = { 'data' => { 'type' => 'notes', 'attributes' => { 'title' => 'note', 'body' => text } } }.to_json
+  samples = (1..runs).map do
+    db.exec("BEGIN")
+    elapsed = time { db.exec_params("SELECT http_status FROM jsonapi('POST',$1,$2,'','','','','','')", ["#{prefix}/notes", body]) }
+    db.exec("ROLLBACK")
+    elapsed * 1000
+  end
+  samples.sort[runs / 2]
+end
+
+printf("%10s %16s %16s\n", 'bytes', 'no rules (ms)', "#{rules.size} rules (ms)")
+plain     = connect.call
+validated = connect.call
+# validators are read once by backend, on its first request
+validated.exec("SET cloudware.xss_validators = #{validated.escape_literal(rules.to_json)}")
+sizes.each do |size|
+  printf("%10d %16.2f %16.2f\n", size, measure(plain, prefix, size, runs), measure(validated, prefix, size, runs))
+end
+plain.close
+validated.close
+
+db = connect.call
+db.exec_params("DELETE FROM public.jsonapi_config WHERE prefix = $1", [prefix])
+db.exec("DROP TABLE public.bench_notes")
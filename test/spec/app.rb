@@ -17,6 +17,8 @@
 # You should have received a copy of the GNU Affero General Public License
 # along with pg-jsonapi.  If not, see <http://www.gnu.org/licenses/>.
 #
+require 'stringio'
+require 'zlib'
 require File.expand_path '../spec_helper.rb', __FILE__
 
 describe "The JSON API" do
@@ -35,4 +37,74 @@ describe "The JSON API" do
     expect(valid_top_error?(parsed_body)).to be true
   end
 
+  it "should keep serializing a batch after a failed request" do
+    requests = [
+      { method: 'GET', url: 'http://example.org/oops' },
+      { method: 'GET', url: 'http://example.org/users' }
+    ].to_json
+    res = $db.exec_params("SELECT * FROM jsonapi_batch($1::jsonb,'','','','','','') ORDER BY index", [requests])
+    expect(res.ntuples).to eq 2
+    expect(res[0]['http_status'].to_i).not_to eq 200
+    expect(valid_top_error?(JSON.parse(res[0]['response']))).to be true
+    expect(res[1]['http_status'].to_i).to eq 200
+    expect(valid_top_data?(JSON.parse(res[1]['response']))).to be true
+  end
+
+  it "should continue a page cursor in a following request" do
+    url = 'http://example.org/users?page[size]=1&page[cursor]='
+    res = $db.exec_params("SELECT * FROM jsonapi('GET',$1,'','','','','','','')", [url + 'new'])
+    expect(res[0]['http_status'].to_i).to eq 200
+    first = JSON.parse(res[0]['response'])
+    expect(valid_top_data?(first)).to be true
+    cursor = first['meta']['cursor']
+    expect(cursor).not_to be_nil
+    res = $db.exec_params("SELECT * FROM jsonapi('GET',$1,'','','','','','','')", [url + cursor])
+    expect(res[0]['http_status'].to_i).to eq 200
+    expect(valid_top_data?(JSON.parse(res[0]['response']))).to be true
+  end
+
+  it "should export collections as ndjson" do
+    res = $db.exec("SELECT * FROM jsonapi('GET','http://example.org/users?format=ndjson','','','','','','','')")
+    expect(res[0]['http_status'].to_i).to eq 200
+    lines = res[0]['response'].split("\n")
+    expect(lines).not_to be_empty
+    lines.each do |line|
+      record = JSON.parse(line)
+      expect(record).to be_a(Hash)
+      expect(record['id']).not_to be_nil
+    end
+  end
+
+  it "should stream a response in chunks that join into the document" do
+    res = $db.exec("SELECT * FROM jsonapi_stream('GET','http://example.org/users','','','','','','','')")
+    expect(res.ntuples).to be > 0
+    expect(res[res.ntuples - 1]['http_status'].to_i).to eq 200
+    document = res.map { |row| row['chunk'] }.join
+    expect(valid_top_data?(JSON.parse(document))).to be true
+  end
+
+  it "should skip encodings with a quality of zero" do
+    res = $db.exec("SELECT * FROM jsonapi_compressed('GET','http://example.org/users','','','','','','','','zstd;q=0, gzip')")
+    expect(res[0]['http_status'].to_i).to eq 200
+    expect(res[0]['content_encoding']).not_to eq 'zstd'
+    response = PG::Connection.unescape_bytea(res[0]['response'])
+    if 'gzip' == res[0]['content_encoding']
+      response = Zlib::GzipReader.new(StringIO.new(response)).read
+    end
+    expect(valid_top_data?(JSON.parse(response))).to be true
+  end
+
+  it "should compress when identity is not acceptable" do
+    res = $db.exec("SELECT * FROM jsonapi_compressed('GET','http://example.org/users','','','','','','','','identity;q=0')")
+    expect(res[0]['http_status'].to_i).to eq 200
+    expect(res[0]['content_encoding']).not_to eq 'identity'
+  end
+
+  it "should export collections as csv" do
+    res = $db.exec("SELECT * FROM jsonapi('GET','http://example.org/users?format=csv','','','','','','','')")
+    expect(res[0]['http_status'].to_i).to eq 200
+    expect(res[0]['response']).not_to start_with('{')
+    expect(res[0]['response']).to end_with("\n")
+  end
+
 end